@@ -0,0 +1,153 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Wasm {
+namespace Common {
+
+// ClockCache is a bounded map from string keys to values, which evicts with the
+// CLOCK policy, an approximation of LRU. Every hit marks the entry as
+// referenced. When the cache is full, the clock hand sweeps over the entries,
+// clears the referenced marks it passes, and evicts the first entry that was
+// not referenced since the previous sweep. Hot entries therefore survive
+// eviction regardless of insertion order.
+// ClockCache is not thread safe, except that find may run concurrently with
+// other calls to find, e.g. under a shared lock.
+template <typename V>
+class ClockCache {
+ public:
+  explicit ClockCache(size_t capacity) { setCapacity(capacity); }
+
+  // Sets capacity and drops all entries.
+  void setCapacity(size_t capacity) {
+    capacity_ = capacity;
+    entries_.clear();
+    entries_.reserve(capacity_);
+    index_.clear();
+    index_.reserve(capacity_);
+    hand_ = 0;
+  }
+
+  // Raises the capacity to the given value, keeping all entries.
+  void grow(size_t capacity) {
+    if (capacity <= capacity_) {
+      return;
+    }
+    capacity_ = capacity;
+    entries_.reserve(capacity_);
+    index_.reserve(capacity_);
+  }
+
+  size_t capacity() const { return capacity_; }
+  size_t size() const { return entries_.size(); }
+
+  // Returns the value of key, or nullptr on a miss. The returned pointer is
+  // valid until the next insert.
+  V* get(const std::string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      misses_++;
+      return nullptr;
+    }
+    hits_++;
+    auto& entry = entries_[it->second];
+    entry.referenced.store(true, std::memory_order_relaxed);
+    return &entry.value;
+  }
+
+  // Same as get, but does not count the lookup, so that concurrent readers
+  // only write the referenced mark of the entry.
+  const V* find(const std::string& key) const {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    const auto& entry = entries_[it->second];
+    entry.referenced.store(true, std::memory_order_relaxed);
+    return &entry.value;
+  }
+
+  // Inserts a value for a key that is not in the cache, evicting an entry if
+  // the cache is full. Returns the inserted value, or nullptr if the capacity
+  // is zero.
+  V* insert(const std::string& key, V value) {
+    if (capacity_ == 0) {
+      return nullptr;
+    }
+    if (entries_.size() < capacity_) {
+      index_.emplace(key, entries_.size());
+      entries_.emplace_back(key, std::move(value));
+      return &entries_.back().value;
+    }
+
+    // Sweep until an entry that was not referenced since the last sweep. This
+    // terminates within two rounds, as the first round clears all marks.
+    while (entries_[hand_].referenced.exchange(false,
+                                               std::memory_order_relaxed)) {
+      advanceHand();
+    }
+    auto& victim = entries_[hand_];
+    index_.erase(victim.key);
+    evictions_++;
+
+    victim.key = key;
+    victim.value = std::move(value);
+    index_.emplace(key, hand_);
+    advanceHand();
+    return &victim.value;
+  }
+
+  // Cumulative counts of lookups that hit or missed, and of evicted entries.
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  uint64_t evictions() const { return evictions_; }
+
+ private:
+  struct Entry {
+    Entry(const std::string& key, V value)
+        : key(key), value(std::move(value)) {}
+    // Entries only move when the vector grows, which readers do not overlap.
+    Entry(Entry&& other)
+        : key(std::move(other.key)),
+          value(std::move(other.value)),
+          referenced(other.referenced.load(std::memory_order_relaxed)) {}
+
+    std::string key;
+    V value;
+    // Set by readers, cleared by the clock hand.
+    mutable std::atomic<bool> referenced{false};
+  };
+
+  void advanceHand() { hand_ = (hand_ + 1) % entries_.size(); }
+
+  size_t capacity_;
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+  size_t hand_ = 0;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+}  // namespace Common
+}  // namespace Wasm
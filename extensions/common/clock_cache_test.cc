@@ -0,0 +1,116 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/common/clock_cache.h"
+
+#include "gtest/gtest.h"
+
+namespace Wasm {
+namespace Common {
+namespace {
+
+TEST(ClockCacheTest, HitAndMiss) {
+  ClockCache<int> cache(2);
+  EXPECT_EQ(cache.get("a"), nullptr);
+  ASSERT_NE(cache.insert("a", 1), nullptr);
+  ASSERT_NE(cache.get("a"), nullptr);
+  EXPECT_EQ(*cache.get("a"), 1);
+  EXPECT_EQ(cache.hits(), 2u);
+  EXPECT_EQ(cache.misses(), 1u);
+  EXPECT_EQ(cache.evictions(), 0u);
+}
+
+TEST(ClockCacheTest, ZeroCapacity) {
+  ClockCache<int> cache(0);
+  EXPECT_EQ(cache.insert("a", 1), nullptr);
+  EXPECT_EQ(cache.get("a"), nullptr);
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(ClockCacheTest, BoundedSize) {
+  ClockCache<int> cache(4);
+  for (int i = 0; i < 100; i++) {
+    cache.insert(std::to_string(i), i);
+    EXPECT_LE(cache.size(), 4u);
+  }
+  EXPECT_EQ(cache.evictions(), 96u);
+  // The most recent insert is always kept.
+  ASSERT_NE(cache.get("99"), nullptr);
+  EXPECT_EQ(*cache.get("99"), 99);
+}
+
+// Entries that are hit between insertions survive a stream of one-off keys.
+TEST(ClockCacheTest, HotEntriesSurvive) {
+  ClockCache<int> cache(8);
+  cache.insert("hot0", 0);
+  cache.insert("hot1", 1);
+  for (int i = 0; i < 6; i++) {
+    cache.insert("fill" + std::to_string(i), i);
+  }
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_NE(cache.get("hot0"), nullptr);
+    ASSERT_NE(cache.get("hot1"), nullptr);
+    const std::string cold = "cold" + std::to_string(i);
+    if (cache.get(cold) == nullptr) {
+      cache.insert(cold, i);
+    }
+  }
+  EXPECT_EQ(*cache.get("hot0"), 0);
+  EXPECT_EQ(*cache.get("hot1"), 1);
+}
+
+TEST(ClockCacheTest, SetCapacityClears) {
+  ClockCache<int> cache(2);
+  cache.insert("a", 1);
+  cache.setCapacity(4);
+  EXPECT_EQ(cache.capacity(), 4u);
+  EXPECT_EQ(cache.size(), 0u);
+  EXPECT_EQ(cache.get("a"), nullptr);
+}
+
+// find marks entries like get, without counting the lookup.
+TEST(ClockCacheTest, FindMarksReferenced) {
+  ClockCache<int> cache(2);
+  cache.insert("a", 1);
+  cache.insert("b", 2);
+  ASSERT_NE(cache.find("a"), nullptr);
+  EXPECT_EQ(*cache.find("a"), 1);
+  EXPECT_EQ(cache.find("c"), nullptr);
+  EXPECT_EQ(cache.hits(), 0u);
+  EXPECT_EQ(cache.misses(), 0u);
+  // "a" is referenced, so "b" is evicted.
+  cache.insert("c", 3);
+  EXPECT_NE(cache.find("a"), nullptr);
+  EXPECT_EQ(cache.find("b"), nullptr);
+}
+
+TEST(ClockCacheTest, GrowKeepsEntries) {
+  ClockCache<int> cache(2);
+  cache.insert("a", 1);
+  cache.insert("b", 2);
+  cache.grow(1);
+  EXPECT_EQ(cache.capacity(), 2u);
+  cache.grow(3);
+  EXPECT_EQ(cache.capacity(), 3u);
+  EXPECT_NE(cache.get("a"), nullptr);
+  cache.insert("c", 3);
+  EXPECT_EQ(cache.size(), 3u);
+  EXPECT_EQ(cache.evictions(), 0u);
+  EXPECT_NE(cache.get("b"), nullptr);
+}
+
+}  // namespace
+}  // namespace Common
+}  // namespace Wasm
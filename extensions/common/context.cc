@@ -17,6 +17,7 @@
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
+#include "extensions/common/request_info.pb.h"
 #include "extensions/common/util.h"
 #include "google/protobuf/util/json_util.h"
 
@@ -38,6 +39,7 @@ using Envoy::Extensions::Common::Wasm::Null::Plugin::getHeaderMapValue;
 using Envoy::Extensions::Common::Wasm::Null::Plugin::getStringValue;
 using Envoy::Extensions::Common::Wasm::Null::Plugin::getStructValue;
 using Envoy::Extensions::Common::Wasm::Null::Plugin::getValue;
+using Envoy::Extensions::Common::Wasm::Null::Plugin::setFilterState;
 
 #endif  // NULL_PLUGIN
 
@@ -55,18 +57,18 @@ namespace {
 // Extract fqdn from Istio cluster name, e.g.
 // inbound|9080|http|productpage.default.svc.cluster.local. If cluster name does
 // not follow Istio convention, fqdn will be left as empty string.
-void extractFqdn(const std::string& cluster_name, std::string* fqdn) {
-  const std::vector<std::string>& parts = absl::StrSplit(cluster_name, '|');
+void extractFqdn(StringView cluster_name, std::string* fqdn) {
+  const std::vector<StringView> parts = absl::StrSplit(cluster_name, '|');
   if (parts.size() == 4) {
-    *fqdn = parts[3];
+    fqdn->assign(parts[3].data(), parts[3].size());
   }
 }
 
 // Extract service name from service fqdn.
-void extractServiceName(const std::string& fqdn, std::string* service_name) {
-  const std::vector<std::string>& parts = absl::StrSplit(fqdn, '.');
-  if (parts.size() > 0) {
-    *service_name = parts[0];
+void extractServiceName(StringView fqdn, std::string* service_name) {
+  if (!fqdn.empty()) {
+    const StringView name = fqdn.substr(0, fqdn.find('.'));
+    service_name->assign(name.data(), name.size());
   }
 }
 
@@ -156,87 +158,335 @@ google::protobuf::util::Status extractLocalNodeMetadata(
   return extractNodeMetadata(node, node_info);
 }
 
+namespace {
+
+// Fills destination service host from the Istio cluster name.
+void getDestinationServiceHost(RequestInfo* request_info) {
+  std::string cluster_name;
+  getStringValue({"cluster_name"}, &cluster_name);
+  extractFqdn(cluster_name, &request_info->destination_service_host);
+}
+
+// Derives destination service name from the service host. This is string work
+// only, so it runs only if the name is requested.
+void getDestinationServiceName(RequestInfo* request_info) {
+  // cluster name follows Istio convention, so extract out service name.
+  extractServiceName(request_info->destination_service_host,
+                     &request_info->destination_service_name);
+}
+
+// Fills the requested connection level fields, which are shared by HTTP and
+// TCP. Only called with fields that are not populated yet.
+void populateConnectionInfo(bool outbound, RequestInfo* request_info,
+                            RequestInfoFields fields) {
+  if (fields & kDestinationPortField) {
+    int64_t destination_port = 0;
+    getValue({outbound ? "upstream" : "destination", "port"},
+             &destination_port);
+    request_info->destination_port = destination_port;
+  }
+
+  if (fields & kPrincipalsField) {
+    if (outbound) {
+      getStringValue({"upstream", "uri_san_peer_certificate"},
+                     &request_info->destination_principal);
+      getStringValue({"upstream", "uri_san_local_certificate"},
+                     &request_info->source_principal);
+    } else {
+      getStringValue({"connection", "uri_san_local_certificate"},
+                     &request_info->destination_principal);
+      getStringValue({"connection", "uri_san_peer_certificate"},
+                     &request_info->source_principal);
+    }
+  }
+
+  if ((fields & kServiceAuthPolicyField) && !outbound) {
+    bool mtls = false;
+    if (getValue({"connection", "mtls"}, &mtls)) {
+      request_info->service_auth_policy =
+          mtls ? ::Wasm::Common::ServiceAuthenticationPolicy::MutualTLS
+               : ::Wasm::Common::ServiceAuthenticationPolicy::None;
+    }
+  }
+
+  if (fields & kResponseFlagField) {
+    uint64_t response_flags = 0;
+    getValue({"response", "flags"}, &response_flags);
+    request_info->response_flag = parseResponseFlag(response_flags);
+  }
+
+  request_info->populated_fields |= fields;
+}
+
+}  // namespace
+
 // use_host_header_fallback - If destination_service_host cannot be determined
 // using the cluster name, use the host header as a fallback.
 // For proxies that recieve traffic from outside clients, this should normally
 // be false. Example: ingress.
 void populateHTTPRequestInfo(bool outbound, bool use_host_header_fallback,
-                             RequestInfo* request_info) {
-  // TODO: switch to stream_info.requestComplete() to avoid extra compute.
-  request_info->end_timestamp = getCurrentTimeNanoseconds();
+                             RequestInfo* request_info,
+                             RequestInfoFields fields) {
+  fields &= ~request_info->populated_fields;
+  if (fields == 0) {
+    return;
+  }
+  // Service name is derived from service host.
+  if (fields & kDestinationServiceNameField) {
+    fields |= kDestinationServiceHostField & ~request_info->populated_fields;
+  }
+
+  if (fields & kEndTimestampField) {
+    // TODO: switch to stream_info.requestComplete() to avoid extra compute.
+    request_info->end_timestamp = getCurrentTimeNanoseconds();
+  }
 
   // Fill in request info.
-  int64_t response_code = 0;
-  if (getValue({"response", "code"}, &response_code)) {
-    request_info->response_code = response_code;
+  if (fields & kResponseCodeField) {
+    int64_t response_code = 0;
+    if (getValue({"response", "code"}, &response_code)) {
+      request_info->response_code = response_code;
+    }
   }
 
-  if (kGrpcContentTypes.count(getHeaderMapValue(HeaderMapType::RequestHeaders,
-                                                kContentTypeHeaderKey)
-                                  ->toString()) != 0) {
-    request_info->request_protocol = kProtocolGRPC;
-  } else {
-    // TODO Add http/1.1, http/1.0, http/2 in a separate attribute.
-    // http|grpc classification is compatible with Mixerclient
-    request_info->request_protocol = kProtocolHTTP;
+  if (fields & kRequestProtocolField) {
+    if (kGrpcContentTypes.count(getHeaderMapValue(HeaderMapType::RequestHeaders,
+                                                  kContentTypeHeaderKey)
+                                    ->toString()) != 0) {
+      request_info->request_protocol = kProtocolGRPC;
+    } else {
+      // TODO Add http/1.1, http/1.0, http/2 in a separate attribute.
+      // http|grpc classification is compatible with Mixerclient
+      request_info->request_protocol = kProtocolHTTP;
+    }
   }
 
   // Try to get fqdn of destination service from cluster name. If not found, use
   // host header instead.
-  std::string cluster_name = "";
-  getStringValue({"cluster_name"}, &cluster_name);
-  extractFqdn(cluster_name, &request_info->destination_service_host);
-  if (!request_info->destination_service_host.empty()) {
-    // cluster name follows Istio convention, so extract out service name.
-    extractServiceName(request_info->destination_service_host,
-                       &request_info->destination_service_name);
-  } else if (use_host_header_fallback) {
-    // fallback to host header if requested.
-    request_info->destination_service_host =
-        getHeaderMapValue(HeaderMapType::RequestHeaders, kAuthorityHeaderKey)
-            ->toString();
-    // TODO: what is the proper fallback for destination service name?
+  bool host_header_fallback = false;
+  if (fields & kDestinationServiceHostField) {
+    getDestinationServiceHost(request_info);
+    if (request_info->destination_service_host.empty() &&
+        use_host_header_fallback) {
+      // fallback to host header if requested.
+      request_info->destination_service_host =
+          getHeaderMapValue(HeaderMapType::RequestHeaders, kAuthorityHeaderKey)
+              ->toString();
+      // TODO: what is the proper fallback for destination service name?
+      host_header_fallback = true;
+    }
+  }
+  if ((fields & kDestinationServiceNameField) && !host_header_fallback) {
+    getDestinationServiceName(request_info);
   }
 
   // Get rbac labels from dynamic metadata.
-  getStringValue({"metadata", kRbacFilterName, kRbacPermissivePolicyIDField},
-                 &request_info->rbac_permissive_policy_id);
-  getStringValue(
-      {"metadata", kRbacFilterName, kRbacPermissiveEngineResultField},
-      &request_info->rbac_permissive_engine_result);
-
-  request_info->request_operation =
-      getHeaderMapValue(HeaderMapType::RequestHeaders, kMethodHeaderKey)
-          ->toString();
-
-  getStringValue({"request", "url_path"}, &request_info->request_url_path);
-
-  int64_t destination_port = 0;
-
-  if (outbound) {
-    getValue({"upstream", "port"}, &destination_port);
-    getStringValue({"upstream", "uri_san_peer_certificate"},
-                   &request_info->destination_principal);
-    getStringValue({"upstream", "uri_san_local_certificate"},
-                   &request_info->source_principal);
-  } else {
-    getValue({"destination", "port"}, &destination_port);
-    bool mtls = false;
-    if (getValue({"connection", "mtls"}, &mtls)) {
-      request_info->service_auth_policy =
-          mtls ? ::Wasm::Common::ServiceAuthenticationPolicy::MutualTLS
-               : ::Wasm::Common::ServiceAuthenticationPolicy::None;
-    }
-    getStringValue({"connection", "uri_san_local_certificate"},
-                   &request_info->destination_principal);
-    getStringValue({"connection", "uri_san_peer_certificate"},
-                   &request_info->source_principal);
+  if (fields & kRbacPermissiveField) {
+    getStringValue({"metadata", kRbacFilterName, kRbacPermissivePolicyIDField},
+                   &request_info->rbac_permissive_policy_id);
+    getStringValue(
+        {"metadata", kRbacFilterName, kRbacPermissiveEngineResultField},
+        &request_info->rbac_permissive_engine_result);
+  }
+
+  if (fields & kRequestOperationField) {
+    request_info->request_operation =
+        getHeaderMapValue(HeaderMapType::RequestHeaders, kMethodHeaderKey)
+            ->toString();
+  }
+
+  if (fields & kRequestUrlPathField) {
+    getStringValue({"request", "url_path"}, &request_info->request_url_path);
+  }
+
+  populateConnectionInfo(outbound, request_info, fields);
+}
+
+void populateTCPRequestInfo(bool outbound, RequestInfo* request_info,
+                            RequestInfoFields fields) {
+  fields &= ~request_info->populated_fields;
+  if (fields == 0) {
+    return;
+  }
+  if (fields & kDestinationServiceNameField) {
+    fields |= kDestinationServiceHostField & ~request_info->populated_fields;
+  }
+  if (fields & kRequestProtocolField) {
+    request_info->request_protocol = kProtocolTCP;
+  }
+  if (fields & kDestinationServiceHostField) {
+    getDestinationServiceHost(request_info);
+  }
+  if (fields & kDestinationServiceNameField) {
+    getDestinationServiceName(request_info);
+  }
+  populateConnectionInfo(outbound, request_info, fields);
+}
+
+void serializeSharedRequestInfo(const RequestInfo& request_info,
+                                StringView peer_id, std::string* out) {
+  wasm::common::SharedRequestInfo shared;
+  shared.set_destination_port(request_info.destination_port);
+  shared.set_request_protocol(request_info.request_protocol);
+  shared.set_response_code(request_info.response_code);
+  shared.set_response_flag(request_info.response_flag);
+  shared.set_request_operation(request_info.request_operation);
+  shared.set_request_url_path(request_info.request_url_path);
+  shared.set_service_auth_policy(
+      static_cast<int32_t>(request_info.service_auth_policy));
+  shared.set_source_principal(request_info.source_principal);
+  shared.set_destination_principal(request_info.destination_principal);
+  shared.set_rbac_permissive_policy_id(request_info.rbac_permissive_policy_id);
+  shared.set_rbac_permissive_engine_result(
+      request_info.rbac_permissive_engine_result);
+  shared.set_populated_fields(request_info.populated_fields &
+                              kSharedRequestInfoFields);
+  shared.set_peer_id(peer_id.data(), peer_id.size());
+  shared.SerializeToString(out);
+}
+
+bool parseSharedRequestInfo(StringView data, RequestInfo* request_info,
+                            std::string* peer_id) {
+  wasm::common::SharedRequestInfo shared;
+  if (!shared.ParseFromArray(data.data(), data.size())) {
+    return false;
+  }
+  // Only take the fields that the publisher populated. Fields of the reader
+  // are kept otherwise.
+  const RequestInfoFields fields =
+      shared.populated_fields() & kSharedRequestInfoFields;
+  if (fields & kDestinationPortField) {
+    request_info->destination_port = shared.destination_port();
+  }
+  if (fields & kRequestProtocolField) {
+    request_info->request_protocol = shared.request_protocol();
+  }
+  if (fields & kResponseCodeField) {
+    request_info->response_code = shared.response_code();
+  }
+  if (fields & kResponseFlagField) {
+    request_info->response_flag = shared.response_flag();
+  }
+  if (fields & kRequestOperationField) {
+    request_info->request_operation = shared.request_operation();
+  }
+  if (fields & kRequestUrlPathField) {
+    request_info->request_url_path = shared.request_url_path();
+  }
+  if (fields & kServiceAuthPolicyField) {
+    request_info->service_auth_policy =
+        static_cast<ServiceAuthenticationPolicy>(shared.service_auth_policy());
+  }
+  if (fields & kPrincipalsField) {
+    request_info->source_principal = shared.source_principal();
+    request_info->destination_principal = shared.destination_principal();
+  }
+  if (fields & kRbacPermissiveField) {
+    request_info->rbac_permissive_policy_id =
+        shared.rbac_permissive_policy_id();
+    request_info->rbac_permissive_engine_result =
+        shared.rbac_permissive_engine_result();
+  }
+  request_info->populated_fields |= fields;
+  *peer_id = shared.peer_id();
+  return true;
+}
+
+bool getSharedRequestInfo(RequestInfo* request_info, std::string* peer_id) {
+  std::string data;
+  if (!getStringValue({"filter_state", kSharedRequestInfoKey}, &data)) {
+    return false;
+  }
+  return parseSharedRequestInfo(data, request_info, peer_id);
+}
+
+void setSharedRequestInfo(const RequestInfo& request_info, StringView peer_id) {
+  std::string data;
+  serializeSharedRequestInfo(request_info, peer_id, &data);
+  setFilterState(kSharedRequestInfoKey, data);
+}
+
+bool serializeNodeInfoBinary(const wasm::common::NodeInfo& node_info,
+                             std::string* out) {
+  out->assign(1, kNodeInfoBinaryV1);
+  return node_info.AppendToString(out);
+}
+
+google::protobuf::util::Status parseNodeInfoBinary(
+    StringView data, wasm::common::NodeInfo* node_info) {
+  if (data.empty() || data[0] != kNodeInfoBinaryV1) {
+    return google::protobuf::util::Status(
+        google::protobuf::util::error::INVALID_ARGUMENT,
+        "unsupported node info format version");
+  }
+  if (!node_info->ParseFromArray(data.data() + 1, data.size() - 1)) {
+    return google::protobuf::util::Status(
+        google::protobuf::util::error::INVALID_ARGUMENT,
+        "cannot parse node info");
   }
-  request_info->destination_port = destination_port;
+  return google::protobuf::util::Status::OK;
+}
 
-  uint64_t response_flags = 0;
-  getValue({"response", "flags"}, &response_flags);
-  request_info->response_flag = parseResponseFlag(response_flags);
+void buildNodeMetadata(const wasm::common::NodeInfo& node_info,
+                       google::protobuf::Struct* metadata) {
+  auto* fields = metadata->mutable_fields();
+  const auto set_string = [fields](const char* key, const std::string& value) {
+    if (!value.empty()) {
+      (*fields)[key].set_string_value(value);
+    }
+  };
+  set_string("NAME", node_info.name());
+  set_string("NAMESPACE", node_info.namespace_());
+  set_string("OWNER", node_info.owner());
+  set_string("WORKLOAD_NAME", node_info.workload_name());
+  set_string("ISTIO_VERSION", node_info.istio_version());
+  set_string("MESH_ID", node_info.mesh_id());
+
+  const auto set_map =
+      [fields](const char* key,
+               const google::protobuf::Map<std::string, std::string>& map) {
+        if (map.empty()) {
+          return;
+        }
+        auto* map_fields =
+            (*fields)[key].mutable_struct_value()->mutable_fields();
+        for (const auto& it : map) {
+          (*map_fields)[it.first].set_string_value(it.second);
+        }
+      };
+  set_map("LABELS", node_info.labels());
+  set_map("PLATFORM_METADATA", node_info.platform_metadata());
+}
+
+google::protobuf::util::Status parsePeerDirectory(StringView json,
+                                                  PeerDirectory* directory) {
+  google::protobuf::Struct root;
+  auto status = JsonStringToMessage(std::string(json), &root);
+  if (!status.ok()) {
+    return status;
+  }
+  const auto peers_it = root.fields().find("peers");
+  if (peers_it == root.fields().end() ||
+      peers_it->second.kind_case() != google::protobuf::Value::kStructValue) {
+    return google::protobuf::util::Status(
+        google::protobuf::util::error::INVALID_ARGUMENT,
+        "peer directory has no peers struct");
+  }
+  // Entries are added only if all of them are valid.
+  PeerDirectory parsed;
+  for (const auto& peer : peers_it->second.struct_value().fields()) {
+    if (peer.first.empty() ||
+        peer.second.kind_case() != google::protobuf::Value::kStructValue) {
+      return google::protobuf::util::Status(
+          google::protobuf::util::error::INVALID_ARGUMENT,
+          absl::StrCat("invalid peer directory entry ", peer.first));
+    }
+    parsed[peer.first] = peer.second.struct_value();
+  }
+  for (auto& peer : parsed) {
+    (*directory)[peer.first] = std::move(peer.second);
+  }
+  return google::protobuf::util::Status::OK;
 }
 
 google::protobuf::util::Status extractNodeMetadataValue(
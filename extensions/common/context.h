@@ -16,6 +16,7 @@
 #pragma once
 
 #include <set>
+#include <unordered_map>
 
 #include "absl/strings/string_view.h"
 #include "extensions/common/node_info.pb.h"
@@ -39,6 +40,19 @@ constexpr StringView kDownstreamMetadataIdKey =
 constexpr StringView kDownstreamMetadataKey =
     "envoy.wasm.metadata_exchange.downstream";
 
+// Peer node info in the binary format, see serializeNodeInfoBinary. Consumers
+// prefer these keys, and fall back to the google.protobuf.Struct keys above.
+constexpr StringView kUpstreamNodeInfoKey =
+    "envoy.wasm.metadata_exchange.upstream_node_info";
+constexpr StringView kDownstreamNodeInfoKey =
+    "envoy.wasm.metadata_exchange.downstream_node_info";
+
+// Version of the binary node info format.
+constexpr char kNodeInfoBinaryV1 = 1;
+
+// Filter state key of the request info shared by telemetry plugins.
+constexpr StringView kSharedRequestInfoKey = "envoy.wasm.request_info";
+
 // Header keys
 constexpr StringView kAuthorityHeaderKey = ":authority";
 constexpr StringView kMethodHeaderKey = ":method";
@@ -46,6 +60,7 @@ constexpr StringView kContentTypeHeaderKey = "content-type";
 
 const std::string kProtocolHTTP = "http";
 const std::string kProtocolGRPC = "grpc";
+const std::string kProtocolTCP = "tcp";
 
 const std::set<std::string> kGrpcContentTypes{
     "application/grpc", "application/grpc+proto", "application/grpc+json"};
@@ -61,6 +76,37 @@ constexpr StringView kNone = "NONE";
 
 StringView AuthenticationPolicyString(ServiceAuthenticationPolicy policy);
 
+// RequestInfoField selects the RequestInfo fields that are populated from
+// host properties. Each plugin declares the fields it consumes at configure
+// time, so fields nobody reads cost neither host calls nor string work.
+enum RequestInfoField : uint32_t {
+  kEndTimestampField = 1 << 0,
+  kResponseCodeField = 1 << 1,
+  kRequestProtocolField = 1 << 2,
+  kDestinationServiceHostField = 1 << 3,
+  // Derived from destination service host.
+  kDestinationServiceNameField = 1 << 4,
+  kRequestOperationField = 1 << 5,
+  kRequestUrlPathField = 1 << 6,
+  kDestinationPortField = 1 << 7,
+  kPrincipalsField = 1 << 8,
+  kServiceAuthPolicyField = 1 << 9,
+  kResponseFlagField = 1 << 10,
+  kRbacPermissiveField = 1 << 11,
+};
+
+using RequestInfoFields = uint32_t;
+constexpr RequestInfoFields kAllRequestInfoFields = (1 << 12) - 1;
+
+// Fields that do not depend on the plugin configuration, and are shared
+// between telemetry plugins of a stream. The end timestamp is read when each
+// plugin logs, and destination service depends on the host header fallback
+// setting of each plugin.
+constexpr RequestInfoFields kSharedRequestInfoFields =
+    kAllRequestInfoFields &
+    ~(kEndTimestampField | kDestinationServiceHostField |
+      kDestinationServiceNameField);
+
 // RequestInfo represents the information collected from filter stream
 // callbacks. This is used to fill metrics and logs.
 struct RequestInfo {
@@ -102,7 +148,8 @@ struct RequestInfo {
   std::string request_url_path;
 
   // Service authentication policy (NONE, MUTUAL_TLS)
-  ServiceAuthenticationPolicy service_auth_policy;
+  ServiceAuthenticationPolicy service_auth_policy =
+      ServiceAuthenticationPolicy::Unspecified;
 
   // Principal of source and destination workload extracted from TLS
   // certificate.
@@ -112,6 +159,22 @@ struct RequestInfo {
   // Rbac filter policy id and result.
   std::string rbac_permissive_policy_id;
   std::string rbac_permissive_engine_result;
+
+  // The following fields are only used by TCP connections. Byte counters and
+  // connection events are accumulated since the last report and reset by the
+  // reporter after every flush.
+  uint64_t tcp_connections_opened = 0;
+  uint64_t tcp_connections_closed = 0;
+  uint64_t tcp_sent_bytes = 0;
+  uint64_t tcp_received_bytes = 0;
+
+  // Total bytes over the lifetime of the TCP connection.
+  uint64_t tcp_total_sent_bytes = 0;
+  uint64_t tcp_total_received_bytes = 0;
+
+  // Fields already populated from host properties. Populating again only
+  // fetches the fields that are still missing.
+  RequestInfoFields populated_fields = 0;
 };
 
 // RequestContext contains all the information available in the request.
@@ -148,10 +211,66 @@ google::protobuf::util::Status extractNodeMetadataGeneric(
 google::protobuf::util::Status extractLocalNodeMetadata(
     wasm::common::NodeInfo* node_info);
 
-// populateHTTPRequestInfo populates the RequestInfo struct. It needs access to
-// the request context.
+// populateHTTPRequestInfo populates the requested fields of the RequestInfo
+// struct that are not populated yet. It needs access to the request context.
 void populateHTTPRequestInfo(bool outbound, bool use_host_header,
-                             RequestInfo* request_info);
+                             RequestInfo* request_info,
+                             RequestInfoFields fields = kAllRequestInfoFields);
+
+// getSharedRequestInfo reads the request info and peer id published in the
+// stream filter state by a telemetry plugin that ran earlier in the stream.
+// Only the shared fields are set, and others are left as they are. Returns
+// false if nothing is published. Fields that are not populated yet can be
+// added with populateHTTPRequestInfo.
+bool getSharedRequestInfo(RequestInfo* request_info, std::string* peer_id);
+
+// setSharedRequestInfo publishes the shared fields of the request info and peer
+// id in the stream filter state, so that telemetry plugins that run later in
+// the stream reuse them instead of fetching host properties again. Plugins
+// only publish if configured to share request info, as the filter state write
+// costs more than it saves if no other plugin reads it.
+void setSharedRequestInfo(const RequestInfo& request_info, StringView peer_id);
+
+// Serialization of the shared request info. Exposed for testing.
+void serializeSharedRequestInfo(const RequestInfo& request_info,
+                                StringView peer_id, std::string* out);
+bool parseSharedRequestInfo(StringView data, RequestInfo* request_info,
+                            std::string* peer_id);
+
+// serializeNodeInfoBinary encodes node info in the binary peer metadata format,
+// which is a version byte followed by the serialized wasm.common.NodeInfo. It
+// is smaller than the google.protobuf.Struct format, and is read without the
+// Struct to NodeInfo conversion.
+bool serializeNodeInfoBinary(const wasm::common::NodeInfo& node_info,
+                             std::string* out);
+
+// parseNodeInfoBinary decodes node info in the binary peer metadata format.
+google::protobuf::util::Status parseNodeInfoBinary(
+    StringView data, wasm::common::NodeInfo* node_info);
+
+// buildNodeMetadata is the inverse of extractNodeMetadata. It restores the
+// exchanged node metadata struct of a peer that sent the binary format. Keys
+// that NodeInfo does not carry are not restored.
+void buildNodeMetadata(const wasm::common::NodeInfo& node_info,
+                       google::protobuf::Struct* metadata);
+
+// PeerDirectory holds the exchanged node metadata of peers that are known
+// ahead of time, by peer ID. It lets the metadata exchange resolve peers that
+// send their ID only.
+using PeerDirectory =
+    std::unordered_map<std::string, google::protobuf::Struct>;
+
+// parsePeerDirectory parses a peer directory in JSON, of the form
+// {"peers": {"<peer id>": {<exchanged node metadata>}}}, and adds its entries
+// to directory. On error, directory is left as it was.
+google::protobuf::util::Status parsePeerDirectory(StringView json,
+                                                  PeerDirectory* directory);
+
+// populateTCPRequestInfo populates the connection level fields of the
+// RequestInfo struct for a TCP connection. It needs access to the connection
+// context, and is expected to be called once per connection.
+void populateTCPRequestInfo(bool outbound, RequestInfo* request_info,
+                            RequestInfoFields fields = kAllRequestInfoFields);
 
 // Extracts node metadata value. It looks for values of all the keys
 // corresponding to EXCHANGE_KEYS in node_metadata and populates it in
@@ -19,7 +19,9 @@
 #include "google/protobuf/stubs/status.h"
 #include "google/protobuf/text_format.h"
 #include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/message_differencer.h"
 #include "gtest/gtest.h"
+#include "test/test_common/environment.h"
 
 // WASM_PROLOG
 #ifdef NULL_PLUGIN
@@ -134,6 +136,194 @@ TEST(ContextTest, extractNodeMetadataValue) {
   EXPECT_EQ(label_iter->second.string_value(), "{app, details}");
 }
 
+// Test that two plugins reading the shared request info see the values
+// populated by the plugin that published it, and keep their own timestamps,
+// sizes and destination service.
+TEST(ContextTest, SharedRequestInfoTwoReaders) {
+  RequestInfo published;
+  published.start_timestamp = 1000;
+  published.end_timestamp = 3000;
+  published.request_size = 10;
+  published.response_size = 20;
+  published.destination_port = 9080;
+  published.request_protocol = kProtocolGRPC;
+  published.response_code = 200;
+  published.response_flag = "-";
+  published.destination_service_host = "productpage.default.svc.cluster.local";
+  published.destination_service_name = "productpage";
+  published.request_operation = "GET";
+  published.request_url_path = "/productpage";
+  published.service_auth_policy = ServiceAuthenticationPolicy::MutualTLS;
+  published.source_principal = "spiffe://cluster.local/ns/default/sa/source";
+  published.destination_principal =
+      "spiffe://cluster.local/ns/default/sa/destination";
+  published.rbac_permissive_policy_id = "policy";
+  published.rbac_permissive_engine_result = "allowed";
+  published.populated_fields = kAllRequestInfoFields;
+
+  std::string data;
+  serializeSharedRequestInfo(published, "peer_id", &data);
+
+  // Each reading plugin has its own partially filled request info.
+  RequestInfo first;
+  first.start_timestamp = 1100;
+  first.request_size = 5;
+  first.response_size = 7;
+  RequestInfo second;
+  second.start_timestamp = 1200;
+  second.request_size = 6;
+  second.destination_service_host = "second.host";
+  second.populated_fields = kDestinationServiceHostField;
+  std::string first_peer_id;
+  std::string second_peer_id;
+  ASSERT_TRUE(parseSharedRequestInfo(data, &first, &first_peer_id));
+  ASSERT_TRUE(parseSharedRequestInfo(data, &second, &second_peer_id));
+
+  for (const RequestInfo* received : {&first, &second}) {
+    EXPECT_EQ(received->destination_port, published.destination_port);
+    EXPECT_EQ(received->request_protocol, published.request_protocol);
+    EXPECT_EQ(received->response_code, published.response_code);
+    EXPECT_EQ(received->response_flag, published.response_flag);
+    EXPECT_EQ(received->request_operation, published.request_operation);
+    EXPECT_EQ(received->request_url_path, published.request_url_path);
+    EXPECT_EQ(received->service_auth_policy, published.service_auth_policy);
+    EXPECT_EQ(received->source_principal, published.source_principal);
+    EXPECT_EQ(received->destination_principal,
+              published.destination_principal);
+    EXPECT_EQ(received->rbac_permissive_policy_id,
+              published.rbac_permissive_policy_id);
+    EXPECT_EQ(received->rbac_permissive_engine_result,
+              published.rbac_permissive_engine_result);
+    // Plugin specific fields are still populated by each plugin.
+    EXPECT_EQ(received->end_timestamp, 0);
+    EXPECT_EQ(received->populated_fields & kEndTimestampField, 0);
+    EXPECT_EQ(received->populated_fields & kDestinationServiceNameField, 0);
+  }
+  EXPECT_EQ(first_peer_id, "peer_id");
+  EXPECT_EQ(second_peer_id, "peer_id");
+
+  // Own fields are kept.
+  EXPECT_EQ(first.start_timestamp, 1100);
+  EXPECT_EQ(first.request_size, 5);
+  EXPECT_EQ(first.response_size, 7);
+  EXPECT_EQ(first.destination_service_host, "");
+  EXPECT_EQ(first.populated_fields & kDestinationServiceHostField, 0);
+  EXPECT_EQ(second.start_timestamp, 1200);
+  EXPECT_EQ(second.request_size, 6);
+  EXPECT_EQ(second.destination_service_host, "second.host");
+  EXPECT_EQ(second.populated_fields, kSharedRequestInfoFields |
+                                         kDestinationServiceHostField);
+}
+
+// Only fields that the publisher populated are taken.
+TEST(ContextTest, SharedRequestInfoPartial) {
+  RequestInfo published;
+  published.response_code = 503;
+  published.populated_fields = kResponseCodeField | kEndTimestampField;
+  std::string data;
+  serializeSharedRequestInfo(published, "", &data);
+
+  RequestInfo received;
+  received.request_protocol = kProtocolHTTP;
+  std::string peer_id;
+  ASSERT_TRUE(parseSharedRequestInfo(data, &received, &peer_id));
+  EXPECT_EQ(received.response_code, 503);
+  EXPECT_EQ(received.request_protocol, kProtocolHTTP);
+  EXPECT_EQ(received.populated_fields, kResponseCodeField);
+}
+
+TEST(ContextTest, SharedRequestInfoInvalid) {
+  RequestInfo received;
+  std::string peer_id;
+  EXPECT_FALSE(parseSharedRequestInfo("\xff\xff", &received, &peer_id));
+}
+
+TEST(ContextTest, NodeInfoBinaryRoundTrip) {
+  NodeInfo node_info;
+  node_info.set_name("ratings-v1-84975bc778-pxz2w");
+  node_info.set_namespace_("default");
+  node_info.set_workload_name("ratings-v1");
+  (*node_info.mutable_labels())["app"] = "ratings";
+
+  std::string out;
+  ASSERT_TRUE(serializeNodeInfoBinary(node_info, &out));
+  EXPECT_EQ(out[0], kNodeInfoBinaryV1);
+
+  NodeInfo received;
+  ASSERT_TRUE(parseNodeInfoBinary(out, &received).ok());
+  EXPECT_TRUE(MessageDifferencer::Equals(node_info, received));
+}
+
+TEST(ContextTest, buildNodeMetadata) {
+  google::protobuf::Struct metadata_struct;
+  JsonStringToMessage(std::string(node_metadata_json), &metadata_struct);
+  NodeInfo node_info;
+  ASSERT_TRUE(extractNodeMetadata(metadata_struct, &node_info).ok());
+
+  google::protobuf::Struct built;
+  buildNodeMetadata(node_info, &built);
+  EXPECT_TRUE(MessageDifferencer::Equals(built, metadata_struct));
+
+  NodeInfo round_trip;
+  ASSERT_TRUE(extractNodeMetadata(built, &round_trip).ok());
+  EXPECT_TRUE(MessageDifferencer::Equals(round_trip, node_info));
+}
+
+TEST(ContextTest, PeerDirectoryFromFile) {
+  const std::string json =
+      ::Envoy::TestEnvironment::readFileToStringForTest(
+          ::Envoy::TestEnvironment::runfilesPath(
+              "extensions/common/testdata/peer_directory.json",
+              "io_istio_proxy"));
+  PeerDirectory directory;
+  ASSERT_TRUE(parsePeerDirectory(json, &directory).ok());
+  ASSERT_EQ(directory.size(), 2u);
+
+  const auto it = directory.find(
+      "sidecar~10.44.2.15~ratings-v1-84975bc778-pxz2w.default~default.svc."
+      "cluster.local");
+  ASSERT_NE(it, directory.end());
+  NodeInfo node_info;
+  ASSERT_TRUE(extractNodeMetadata(it->second, &node_info).ok());
+  EXPECT_EQ(node_info.workload_name(), "ratings-v1");
+  EXPECT_EQ(node_info.namespace_(), "default");
+  EXPECT_EQ(node_info.labels().at("app"), "ratings");
+}
+
+TEST(ContextTest, PeerDirectoryInvalid) {
+  PeerDirectory directory;
+  EXPECT_FALSE(parsePeerDirectory("not json", &directory).ok());
+  EXPECT_FALSE(parsePeerDirectory(R"({"nodes": {}})", &directory).ok());
+  EXPECT_FALSE(parsePeerDirectory(R"({"peers": {"a": "b"}})", &directory).ok());
+  EXPECT_TRUE(parsePeerDirectory(R"({"peers": {}})", &directory).ok());
+  EXPECT_TRUE(directory.empty());
+}
+
+TEST(ContextTest, PeerDirectoryInvalidEntryKeepsDirectory) {
+  PeerDirectory directory;
+  ASSERT_TRUE(
+      parsePeerDirectory(R"({"peers": {"a": {"NAME": "a"}}})", &directory)
+          .ok());
+  EXPECT_FALSE(parsePeerDirectory(
+                   R"({"peers": {"b": {"NAME": "b"}, "c": "d", "e": {}}})",
+                   &directory)
+                   .ok());
+  ASSERT_EQ(directory.size(), 1u);
+  EXPECT_EQ(directory.count("a"), 1u);
+}
+
+TEST(ContextTest, NodeInfoBinaryBadVersion) {
+  NodeInfo node_info;
+  node_info.set_name("ratings");
+  std::string out;
+  ASSERT_TRUE(serializeNodeInfoBinary(node_info, &out));
+  out[0] = kNodeInfoBinaryV1 + 1;
+
+  NodeInfo received;
+  EXPECT_FALSE(parseNodeInfoBinary(out, &received).ok());
+  EXPECT_FALSE(parseNodeInfoBinary("", &received).ok());
+}
+
 }  // namespace Common
 
 // WASM_EPILOG
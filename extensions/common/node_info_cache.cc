@@ -23,10 +23,16 @@ using google::protobuf::util::Status;
 
 #ifdef NULL_PLUGIN
 
+#include "extensions/common/shared_node_info_store.h"
+
 using Envoy::Extensions::Common::Wasm::Null::Plugin::getStringValue;
 using Envoy::Extensions::Common::Wasm::Null::Plugin::getStructValue;
+using Envoy::Extensions::Common::Wasm::Null::Plugin::incrementMetric;
 using Envoy::Extensions::Common::Wasm::Null::Plugin::logDebug;
 using Envoy::Extensions::Common::Wasm::Null::Plugin::logInfo;
+using Envoy::Extensions::Common::Wasm::Null::Plugin::Metric;
+using Envoy::Extensions::Common::Wasm::Null::Plugin::MetricTag;
+using Envoy::Extensions::Common::Wasm::Null::Plugin::MetricType;
 
 #endif  // NULL_PLUGIN
 
@@ -36,9 +42,22 @@ namespace Common {
 namespace {
 
 // getNodeInfo fetches peer node info from host filter state. It returns true if
-// no error occurs.
+// no error occurs. Node info in the binary format is preferred, as it is read
+// without a round trip through google.protobuf.Struct.
 bool getNodeInfo(StringView peer_metadata_key,
                  wasm::common::NodeInfo* node_info) {
+  const StringView node_info_key = peer_metadata_key == kUpstreamMetadataKey
+                                       ? kUpstreamNodeInfoKey
+                                       : kDownstreamNodeInfoKey;
+  std::string node_info_bytes;
+  if (getStringValue({"filter_state", node_info_key}, &node_info_bytes)) {
+    auto status = parseNodeInfoBinary(node_info_bytes, node_info);
+    if (status == Status::OK) {
+      return true;
+    }
+    LOG_DEBUG(absl::StrCat("cannot parse peer node info: ", status.ToString()));
+  }
+
   google::protobuf::Struct metadata;
   if (!getStructValue({"filter_state", peer_metadata_key}, &metadata)) {
     LOG_DEBUG(absl::StrCat("cannot get metadata for: ", peer_metadata_key));
@@ -58,6 +77,18 @@ bool getNodeInfo(StringView peer_metadata_key,
 
 NodeInfoPtr NodeInfoCache::getPeerById(StringView peer_metadata_id_key,
                                        StringView peer_metadata_key) {
+  std::string peer_id;
+  // Peer ID is not needed if the cache is disabled.
+  if (max_cache_size_ >= 0 &&
+      !getStringValue({"filter_state", peer_metadata_id_key}, &peer_id)) {
+    LOG_DEBUG(absl::StrCat("cannot get metadata for: ", peer_metadata_id_key));
+    return nullptr;
+  }
+  return getPeer(peer_id, peer_metadata_key);
+}
+
+NodeInfoPtr NodeInfoCache::getPeer(StringView peer_id,
+                                   StringView peer_metadata_key) {
   if (max_cache_size_ < 0) {
     // Cache is disabled, fetch node info from host.
     auto node_info_ptr = std::make_shared<wasm::common::NodeInfo>();
@@ -66,29 +97,70 @@ NodeInfoPtr NodeInfoCache::getPeerById(StringView peer_metadata_id_key,
     }
     return nullptr;
   }
-
-  std::string peer_id;
-  if (!getStringValue({"filter_state", peer_metadata_id_key}, &peer_id)) {
-    LOG_DEBUG(absl::StrCat("cannot get metadata for: ", peer_metadata_id_key));
+  if (peer_id.empty()) {
     return nullptr;
   }
-  auto nodeinfo_it = cache_.find(peer_id);
-  if (nodeinfo_it != cache_.end()) {
-    return nodeinfo_it->second;
+
+  const std::string key(peer_id);
+  auto cached = cache_.get(key);
+  if (cached != nullptr) {
+    return *cached;
   }
 
-  // Do not let the cache grow beyond max_cache_size_.
-  if (int32_t(cache_.size()) > max_cache_size_) {
-    auto it = cache_.begin();
-    cache_.erase(cache_.begin(), std::next(it, max_cache_size_ / 4));
-    LOG_INFO(absl::StrCat("cleaned cache, new cache_size:", cache_.size()));
+#ifdef NULL_PLUGIN
+  auto& store = SharedNodeInfoStore::instance();
+  NodeInfoPtr shared_node_info = store.find(key);
+  if (shared_node_info) {
+    cache_.insert(key, shared_node_info);
+    return shared_node_info;
   }
+#endif
+
   auto node_info_ptr = std::make_shared<wasm::common::NodeInfo>();
-  if (getNodeInfo(peer_metadata_key, node_info_ptr.get())) {
-    auto emplacement = cache_.emplace(peer_id, std::move(node_info_ptr));
-    return emplacement.first->second;
+  if (!getNodeInfo(peer_metadata_key, node_info_ptr.get())) {
+    return nullptr;
+  }
+  NodeInfoPtr result = std::move(node_info_ptr);
+#ifdef NULL_PLUGIN
+  result = store.insert(key, std::move(result));
+#endif
+  // The cache evicts a cold entry if it is full.
+  cache_.insert(key, result);
+  return result;
+}
+
+void NodeInfoCache::setMaxCacheSize(int32_t size) {
+  max_cache_size_ = size == 0 ? DefaultNodeCacheMaxSize : size;
+  cache_.setCapacity(max_cache_size_ < 0 ? 0 : max_cache_size_);
+#ifdef NULL_PLUGIN
+  if (max_cache_size_ > 0) {
+    SharedNodeInfoStore::instance().reserve(max_cache_size_);
+  }
+#endif
+}
+
+void NodeInfoCache::flushMetrics(StringView metric_name) {
+  if (!metrics_defined_) {
+    Metric cache_count(MetricType::Counter, std::string(metric_name),
+                       {MetricTag{"result", MetricTag::TagType::String}});
+    hits_metric_ = cache_count.resolve("hit");
+    misses_metric_ = cache_count.resolve("miss");
+    evictions_metric_ = cache_count.resolve("eviction");
+    metrics_defined_ = true;
+  }
+  if (cache_.hits() > flushed_hits_) {
+    incrementMetric(hits_metric_, cache_.hits() - flushed_hits_);
+    flushed_hits_ = cache_.hits();
+  }
+  if (cache_.misses() > flushed_misses_) {
+    incrementMetric(misses_metric_, cache_.misses() - flushed_misses_);
+    flushed_misses_ = cache_.misses();
+  }
+  if (cache_.evictions() > flushed_evictions_) {
+    incrementMetric(evictions_metric_,
+                    cache_.evictions() - flushed_evictions_);
+    flushed_evictions_ = cache_.evictions();
   }
-  return nullptr;
 }
 
 }  // namespace Common
@@ -16,6 +16,7 @@
 #include <unordered_map>
 
 #include "absl/strings/string_view.h"
+#include "extensions/common/clock_cache.h"
 #include "extensions/common/node_info.pb.h"
 
 #ifndef NULL_PLUGIN
@@ -36,8 +37,15 @@ const wasm::common::NodeInfo EmptyNodeInfo;
 
 typedef std::shared_ptr<const wasm::common::NodeInfo> NodeInfoPtr;
 
+// NodeInfoCache caches peer node info by peer ID. It evicts with the CLOCK
+// policy, so peers that keep sending requests stay cached when the cache is
+// full. In the null VM, a miss is looked up in the process-wide
+// SharedNodeInfoStore before peer metadata is decoded, so workers and plugins
+// share one decoded copy of every peer.
 class NodeInfoCache {
  public:
+  NodeInfoCache() : cache_(DefaultNodeCacheMaxSize) {}
+
   // Fetches and caches Peer information by peerId. An empty ptr will be
   // returned if any error conditions.
   // TODO Remove this when it is cheap to directly get it from StreamInfo.
@@ -47,13 +55,30 @@ class NodeInfoCache {
   NodeInfoPtr getPeerById(absl::string_view peer_metadata_id_key,
                           absl::string_view peer_metadata_key);
 
-  inline void setMaxCacheSize(int32_t size) {
-    max_cache_size_ = size == 0 ? DefaultNodeCacheMaxSize : size;
-  }
+  // Same as getPeerById, for a peer ID that is already known, e.g. from the
+  // request info shared by another plugin. An empty peer_id is a miss.
+  NodeInfoPtr getPeer(absl::string_view peer_id,
+                      absl::string_view peer_metadata_key);
+
+  void setMaxCacheSize(int32_t size);
+
+  // Exports cache hits, misses and evictions since the previous call as
+  // counters with the given name and a "result" tag. Counts are accumulated
+  // locally, so this should be called off the request path, e.g. on tick.
+  void flushMetrics(absl::string_view metric_name);
 
  private:
-  std::unordered_map<std::string, NodeInfoPtr> cache_;
+  ClockCache<NodeInfoPtr> cache_;
   int32_t max_cache_size_ = DefaultNodeCacheMaxSize;
+
+  // Metrics are defined on the first flush.
+  bool metrics_defined_ = false;
+  uint32_t hits_metric_ = 0;
+  uint32_t misses_metric_ = 0;
+  uint32_t evictions_metric_ = 0;
+  uint64_t flushed_hits_ = 0;
+  uint64_t flushed_misses_ = 0;
+  uint64_t flushed_evictions_ = 0;
 };
 
 }  // namespace Common
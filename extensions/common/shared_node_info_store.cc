@@ -0,0 +1,88 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/common/shared_node_info_store.h"
+
+#include <mutex>
+
+namespace Wasm {
+namespace Common {
+
+namespace {
+
+// Default capacity of the process-wide store. Plugins raise it to their
+// configured peer cache size.
+const size_t kDefaultSharedStoreCapacity = 500;
+
+}  // namespace
+
+SharedNodeInfoStore& SharedNodeInfoStore::instance() {
+  // Never destroyed, so that worker threads can use it during shutdown.
+  static SharedNodeInfoStore* store =
+      new SharedNodeInfoStore(kDefaultSharedStoreCapacity);
+  return *store;
+}
+
+std::shared_ptr<const wasm::common::NodeInfo> SharedNodeInfoStore::find(
+    const std::string& peer_id) const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  auto it = pinned_.find(peer_id);
+  if (it != pinned_.end()) {
+    return it->second;
+  }
+  const auto* node_info = entries_.find(peer_id);
+  return node_info == nullptr ? nullptr : *node_info;
+}
+
+std::shared_ptr<const wasm::common::NodeInfo> SharedNodeInfoStore::insert(
+    const std::string& peer_id,
+    std::shared_ptr<const wasm::common::NodeInfo> node_info) {
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  auto it = pinned_.find(peer_id);
+  if (it != pinned_.end()) {
+    return it->second;
+  }
+  const auto* stored = entries_.find(peer_id);
+  if (stored != nullptr) {
+    return *stored;
+  }
+  stored = entries_.insert(peer_id, node_info);
+  return stored == nullptr ? node_info : *stored;
+}
+
+void SharedNodeInfoStore::pin(
+    const std::string& peer_id,
+    std::shared_ptr<const wasm::common::NodeInfo> node_info) {
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  pinned_[peer_id] = std::move(node_info);
+}
+
+void SharedNodeInfoStore::reserve(size_t capacity) {
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  entries_.grow(capacity);
+}
+
+size_t SharedNodeInfoStore::size() const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  return pinned_.size() + entries_.size();
+}
+
+size_t SharedNodeInfoStore::capacity() const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  return entries_.capacity();
+}
+
+}  // namespace Common
+}  // namespace Wasm
@@ -0,0 +1,82 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "extensions/common/clock_cache.h"
+#include "extensions/common/node_info.pb.h"
+
+namespace Wasm {
+namespace Common {
+
+// SharedNodeInfoStore holds decoded peer node info for all workers and plugins
+// of a process, so that every peer is decoded and stored once instead of once
+// per worker and plugin. Node info is immutable once stored, and is handed out
+// as shared pointers that stay valid after eviction.
+//
+// The store is a ClockCache behind a reader-writer lock. Lookups take a shared
+// lock and can run concurrently. Inserts take an exclusive lock, and evict
+// with the CLOCK policy when the store is full.
+// The store is meant to back the per-worker NodeInfoCache, so it is only
+// consulted on a worker cache miss.
+class SharedNodeInfoStore {
+ public:
+  explicit SharedNodeInfoStore(size_t capacity) : entries_(capacity) {}
+
+  // Returns the process-wide store.
+  static SharedNodeInfoStore& instance();
+
+  // Returns node info of the peer, or nullptr if it is not stored.
+  std::shared_ptr<const wasm::common::NodeInfo> find(
+      const std::string& peer_id) const;
+
+  // Stores node info of the peer. If another thread stored or pinned the peer
+  // first, the stored node info is returned instead, so that all readers share
+  // one copy.
+  std::shared_ptr<const wasm::common::NodeInfo> insert(
+      const std::string& peer_id,
+      std::shared_ptr<const wasm::common::NodeInfo> node_info);
+
+  // Stores node info of the peer that is known ahead of time, e.g. from a
+  // peer directory. Pinned node info replaces node info stored before, is
+  // returned ahead of it, and is never evicted, so that a reloaded directory
+  // takes effect and directory peers are never decoded.
+  void pin(const std::string& peer_id,
+           std::shared_ptr<const wasm::common::NodeInfo> node_info);
+
+  // Raises the capacity to at least the given value. Capacity never shrinks,
+  // because the store serves all plugins of the process.
+  void reserve(size_t capacity);
+
+  // Number of stored peers, pinned or not.
+  size_t size() const;
+  // Capacity of peers that are not pinned.
+  size_t capacity() const;
+
+ private:
+  mutable std::shared_timed_mutex mutex_;
+  ClockCache<std::shared_ptr<const wasm::common::NodeInfo>> entries_;
+  // Pinned node info by peer ID, not bounded by the capacity.
+  std::unordered_map<std::string, std::shared_ptr<const wasm::common::NodeInfo>>
+      pinned_;
+};
+
+}  // namespace Common
+}  // namespace Wasm
@@ -0,0 +1,126 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/common/shared_node_info_store.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace Wasm {
+namespace Common {
+namespace {
+
+std::shared_ptr<const wasm::common::NodeInfo> makeNode(
+    const std::string& name) {
+  auto node_info = std::make_shared<wasm::common::NodeInfo>();
+  node_info->set_name(name);
+  return node_info;
+}
+
+TEST(SharedNodeInfoStoreTest, FindAndInsert) {
+  SharedNodeInfoStore store(2);
+  EXPECT_EQ(store.find("a"), nullptr);
+  auto stored = store.insert("a", makeNode("a"));
+  ASSERT_NE(store.find("a"), nullptr);
+  EXPECT_EQ(store.find("a"), stored);
+  EXPECT_EQ(store.find("a")->name(), "a");
+}
+
+// The first insert wins, so all readers share one copy.
+TEST(SharedNodeInfoStoreTest, FirstInsertWins) {
+  SharedNodeInfoStore store(2);
+  auto first = store.insert("a", makeNode("first"));
+  auto second = store.insert("a", makeNode("second"));
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(store.find("a")->name(), "first");
+}
+
+TEST(SharedNodeInfoStoreTest, EvictsUnreferenced) {
+  SharedNodeInfoStore store(2);
+  store.insert("a", makeNode("a"));
+  store.insert("b", makeNode("b"));
+  // First sweep clears all marks, and evicts "a".
+  store.insert("c", makeNode("c"));
+  EXPECT_EQ(store.size(), 2u);
+  EXPECT_EQ(store.find("a"), nullptr);
+  // "b" is referenced now, so "c" is evicted next.
+  ASSERT_NE(store.find("b"), nullptr);
+  store.insert("d", makeNode("d"));
+  EXPECT_NE(store.find("b"), nullptr);
+  EXPECT_EQ(store.find("c"), nullptr);
+  EXPECT_NE(store.find("d"), nullptr);
+}
+
+// Evicted node info stays valid for holders.
+TEST(SharedNodeInfoStoreTest, EvictedStaysValid) {
+  SharedNodeInfoStore store(1);
+  auto a = store.insert("a", makeNode("a"));
+  store.insert("b", makeNode("b"));
+  EXPECT_EQ(store.find("a"), nullptr);
+  EXPECT_EQ(a->name(), "a");
+}
+
+// Pinned node info replaces stored node info, and is never evicted.
+TEST(SharedNodeInfoStoreTest, PinReplacesAndStays) {
+  SharedNodeInfoStore store(1);
+  store.insert("a", makeNode("decoded"));
+  store.pin("a", makeNode("directory"));
+  EXPECT_EQ(store.find("a")->name(), "directory");
+  EXPECT_EQ(store.insert("a", makeNode("decoded"))->name(), "directory");
+
+  // A reloaded directory replaces the pinned node info.
+  store.pin("a", makeNode("reloaded"));
+  EXPECT_EQ(store.find("a")->name(), "reloaded");
+
+  for (int i = 0; i < 4; i++) {
+    store.insert(std::to_string(i), makeNode(std::to_string(i)));
+  }
+  ASSERT_NE(store.find("a"), nullptr);
+  EXPECT_EQ(store.find("a")->name(), "reloaded");
+}
+
+TEST(SharedNodeInfoStoreTest, ReserveOnlyGrows) {
+  SharedNodeInfoStore store(2);
+  store.reserve(1);
+  EXPECT_EQ(store.capacity(), 2u);
+  store.reserve(4);
+  EXPECT_EQ(store.capacity(), 4u);
+}
+
+TEST(SharedNodeInfoStoreTest, ConcurrentAccess) {
+  SharedNodeInfoStore store(16);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&store, t]() {
+      for (int i = 0; i < 1000; i++) {
+        const std::string id = std::to_string((i + t) % 32);
+        auto node_info = store.find(id);
+        if (node_info == nullptr) {
+          node_info = store.insert(id, makeNode(id));
+        }
+        EXPECT_EQ(node_info->name(), id);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(store.size(), 16u);
+}
+
+}  // namespace
+}  // namespace Common
+}  // namespace Wasm
@@ -0,0 +1,185 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/common/test_host.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_join.h"
+#include "extensions/common/context.h"
+#include "google/protobuf/util/json_util.h"
+
+namespace Wasm {
+namespace Common {
+namespace Testing {
+
+namespace {
+
+constexpr absl::string_view kFilterStatePrefix("filter_state\0", 13);
+
+}  // namespace
+
+const absl::string_view kLocalNodeJson = R"###(
+{
+   "NAME":"productpage-v1-84975bc778-pxz2w",
+   "NAMESPACE":"default",
+   "LABELS": {
+      "app": "productpage",
+      "version": "v1"
+   },
+   "WORKLOAD_NAME":"productpage-v1",
+   "MESH_ID":"test-mesh",
+   "PLATFORM_METADATA": {
+      "gcp_project": "test-project",
+      "gcp_gke_cluster_name": "test-cluster",
+      "gcp_location": "us-east4-b"
+   },
+   "EXCHANGE_KEYS":"NAME,NAMESPACE,LABELS,WORKLOAD_NAME",
+   "STACKDRIVER_MONITORING_ENDPOINT": "localhost:1",
+   "STACKDRIVER_LOGGING_ENDPOINT": "localhost:1",
+   "STACKDRIVER_MESH_TELEMETRY_ENDPOINT": "localhost:1"
+}
+)###";
+
+const absl::string_view kPeerNodeJson = R"###(
+{
+   "NAME":"ratings-v1-84975bc778-pxz2w",
+   "NAMESPACE":"default",
+   "LABELS": {
+      "app": "ratings",
+      "version": "v1"
+   },
+   "WORKLOAD_NAME":"ratings-v1",
+   "MESH_ID":"test-mesh"
+}
+)###";
+
+const absl::string_view kPeerId = "ratings-v1-84975bc778-pxz2w.default";
+
+google::protobuf::Struct parseStruct(absl::string_view json) {
+  google::protobuf::Struct metadata;
+  google::protobuf::util::JsonStringToMessage(std::string(json), &metadata);
+  return metadata;
+}
+
+std::string structBytes(absl::string_view json) {
+  return parseStruct(json).SerializeAsString();
+}
+
+std::string int64Bytes(int64_t value) {
+  return std::string(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+MockHost::MockHost() : peer_metadata_(structBytes(kPeerNodeJson)) {
+  set({"node", "metadata"}, structBytes(kLocalNodeJson));
+}
+
+std::string MockHost::propertyPath(
+    std::initializer_list<absl::string_view> parts) {
+  return absl::StrJoin(parts, absl::string_view("\0", 1));
+}
+
+void MockHost::set(std::initializer_list<absl::string_view> parts,
+                   std::string value) {
+  properties_[propertyPath(parts)] = std::move(value);
+}
+
+void MockHost::setInboundRequest() {
+  set({"listener_direction"},
+      int64Bytes(static_cast<int64_t>(TrafficDirection::Inbound)));
+  set({"cluster_name"},
+      "inbound|9080|http|productpage.default.svc.cluster.local");
+  set({"destination", "port"}, int64Bytes(9080));
+  set({"response", "code"}, int64Bytes(200));
+  set({"response", "flags"}, int64Bytes(0));
+  set({"request", "url_path"}, "/productpage");
+  setPeer(std::string(kPeerId));
+}
+
+void MockHost::setPeer(const std::string& peer_id) {
+  set({"filter_state", kDownstreamMetadataIdKey}, peer_id);
+  set({"filter_state", kDownstreamMetadataKey}, peer_metadata_);
+}
+
+void MockHost::clearPeer() {
+  for (auto key : {kDownstreamMetadataIdKey, kDownstreamMetadataKey}) {
+    properties_.erase(propertyPath({"filter_state", key}));
+  }
+}
+
+void MockHost::setResponseCode(int64_t code) {
+  set({"response", "code"}, int64Bytes(code));
+}
+
+WasmResult MockHost::getProperty(absl::string_view path,
+                                 std::string* result) const {
+  // Path may carry a trailing separator.
+  if (!path.empty() && path.back() == '\0') {
+    path.remove_suffix(1);
+  }
+  // Filter state set by plugins on the stream hides the static table.
+  if (absl::StartsWith(path, kFilterStatePrefix)) {
+    auto it = filter_state_.find(
+        std::string(path.substr(kFilterStatePrefix.size())));
+    if (it != filter_state_.end()) {
+      *result = it->second;
+      return WasmResult::Ok;
+    }
+  }
+  auto it = properties_.find(std::string(path));
+  if (it == properties_.end()) {
+    return WasmResult::NotFound;
+  }
+  *result = it->second;
+  return WasmResult::Ok;
+}
+
+WasmResult MockHost::setProperty(absl::string_view key,
+                                 absl::string_view value) {
+  filter_state_[std::string(key)] = std::string(value);
+  return WasmResult::Ok;
+}
+
+std::string MockHost::filterState(absl::string_view key) const {
+  auto it = filter_state_.find(std::string(key));
+  return it == filter_state_.end() ? "" : it->second;
+}
+
+TestPlugin::TestPlugin()
+    : api_(::Envoy::Api::createApiForTest(stats_store_)),
+      dispatcher_(api_->allocateDispatcher()),
+      scope_(stats_store_.createScope("wasm.")) {}
+
+void TestPlugin::load(const std::string& name, const std::string& code,
+                      const std::string& root_id,
+                      envoy::api::v2::core::TrafficDirection direction,
+                      const std::string& configuration,
+                      TestRootContext* root_context) {
+  plugin_ = std::make_shared<::Envoy::Extensions::Common::Wasm::Plugin>(
+      name, root_id, "", direction, local_info_, nullptr);
+  plugin_->plugin_configuration_ = configuration;
+
+  envoy::config::wasm::v2::VmConfig vm_config;
+  vm_config.set_runtime("envoy.wasm.runtime.null");
+  vm_config.mutable_code()->mutable_local()->set_inline_string(code);
+
+  root_context_ = root_context;
+  wasm_ = ::Envoy::Extensions::Common::Wasm::createWasmForTesting(
+      vm_config, plugin_, scope_, cluster_manager_, *dispatcher_, *api_,
+      std::unique_ptr<HostContext>(root_context_));
+}
+
+}  // namespace Testing
+}  // namespace Common
+}  // namespace Wasm
@@ -0,0 +1,151 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "absl/strings/string_view.h"
+#include "common/stats/isolated_store_impl.h"
+#include "extensions/common/wasm/wasm.h"
+#include "google/protobuf/struct.pb.h"
+#include "test/mocks/local_info/mocks.h"
+#include "test/mocks/upstream/mocks.h"
+#include "test/test_common/utility.h"
+
+namespace Wasm {
+namespace Common {
+namespace Testing {
+
+using HostContext = ::Envoy::Extensions::Common::Wasm::Context;
+using WasmResult = ::Envoy::Extensions::Common::Wasm::WasmResult;
+
+// Node metadata of the proxy that runs the plugins. Stackdriver endpoints are
+// only used to pick insecure channels.
+extern const absl::string_view kLocalNodeJson;
+// Node metadata of the peer proxy.
+extern const absl::string_view kPeerNodeJson;
+// ID of the peer proxy, as set by setInboundRequest.
+extern const absl::string_view kPeerId;
+
+google::protobuf::Struct parseStruct(absl::string_view json);
+std::string structBytes(absl::string_view json);
+std::string int64Bytes(int64_t value);
+
+// MockHost answers property lookups of plugins from a static table, so that
+// tests and benchmarks exercise the plugin and not the host property
+// providers. It also keeps the filter state set by plugins, which plugins on
+// the same stream read back. Property paths are the path segments separated
+// by '\0'.
+class MockHost {
+ public:
+  // Starts with the local node metadata only.
+  MockHost();
+
+  void set(std::initializer_list<absl::string_view> parts, std::string value);
+
+  // Sets the properties of an inbound HTTP request from kPeerId, with the
+  // peer metadata in the filter state as metadata exchange stores it.
+  void setInboundRequest();
+  void setPeer(const std::string& peer_id);
+  // Removes the peer, as before metadata exchange completes.
+  void clearPeer();
+  void setResponseCode(int64_t code);
+
+  WasmResult getProperty(absl::string_view path, std::string* result) const;
+  WasmResult setProperty(absl::string_view key, absl::string_view value);
+
+  // Returns the filter state of the current stream, or an empty string.
+  std::string filterState(absl::string_view key) const;
+  void clearFilterState() { filter_state_.clear(); }
+
+ private:
+  static std::string propertyPath(
+      std::initializer_list<absl::string_view> parts);
+
+  const std::string peer_metadata_;
+  std::unordered_map<std::string, std::string> properties_;
+  std::unordered_map<std::string, std::string> filter_state_;
+};
+
+class TestRootContext : public HostContext {
+ public:
+  explicit TestRootContext(MockHost* host) : host_(host) {}
+  WasmResult getProperty(absl::string_view path,
+                         std::string* result) override {
+    return host_->getProperty(path, result);
+  }
+
+ private:
+  MockHost* host_;
+};
+
+// TestPlugin loads a plugin in the null VM. Host stats are backed by an
+// isolated store.
+class TestPlugin {
+ public:
+  TestPlugin();
+
+  // Loads the plugin registered with the null VM under the given code name.
+  // The root context takes the host calls of the root context, and is owned by
+  // the VM.
+  void load(const std::string& name, const std::string& code,
+            const std::string& root_id,
+            envoy::api::v2::core::TrafficDirection direction,
+            const std::string& configuration, TestRootContext* root_context);
+
+  ::Envoy::Extensions::Common::Wasm::Wasm* wasm() { return wasm_.get(); }
+  const ::Envoy::Extensions::Common::Wasm::PluginSharedPtr& plugin() {
+    return plugin_;
+  }
+  TestRootContext* rootContext() { return root_context_; }
+  ::Envoy::Stats::IsolatedStoreImpl& statsStore() { return stats_store_; }
+
+ private:
+  ::Envoy::Stats::IsolatedStoreImpl stats_store_;
+  ::Envoy::Api::ApiPtr api_;
+  ::Envoy::Event::DispatcherPtr dispatcher_;
+  ::Envoy::Stats::ScopeSharedPtr scope_;
+  ::testing::NiceMock<::Envoy::Upstream::MockClusterManager> cluster_manager_;
+  ::testing::NiceMock<::Envoy::LocalInfo::MockLocalInfo> local_info_;
+  ::Envoy::Extensions::Common::Wasm::PluginSharedPtr plugin_;
+  TestRootContext* root_context_ = nullptr;
+  std::shared_ptr<::Envoy::Extensions::Common::Wasm::Wasm> wasm_;
+};
+
+class TestStreamContext : public HostContext {
+ public:
+  TestStreamContext(TestPlugin* plugin, MockHost* host)
+      : HostContext(plugin->wasm(), plugin->rootContext()->id(),
+                    plugin->plugin()),
+        host_(host) {}
+  WasmResult getProperty(absl::string_view path,
+                         std::string* result) override {
+    return host_->getProperty(path, result);
+  }
+  WasmResult setProperty(absl::string_view key,
+                         absl::string_view value) override {
+    return host_->setProperty(key, value);
+  }
+
+ private:
+  MockHost* host_;
+};
+
+}  // namespace Testing
+}  // namespace Common
+}  // namespace Wasm
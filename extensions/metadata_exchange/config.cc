@@ -13,7 +13,6 @@
  * limitations under the License.
  */
 
-#include "common/common/base64.h"
 #include "extensions/metadata_exchange/plugin.h"
 
 namespace Envoy {
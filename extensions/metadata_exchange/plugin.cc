@@ -18,17 +18,19 @@
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
 #include "extensions/common/node_info.pb.h"
 #include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/time_util.h"
+#include "src/istio/utils/base64.h"
 
-#ifndef NULL_PLUGIN
-
-#include "base64.h"
+#ifdef NULL_PLUGIN
 
-#else
+#include <fstream>
+#include <sstream>
 
-#include "common/common/base64.h"
+#include "extensions/common/shared_node_info_store.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -59,6 +61,9 @@ bool serializeToStringDeterministic(const google::protobuf::Message& metadata,
   return true;
 }
 
+constexpr size_t kDefaultMaxPeerCacheSize = 500;
+constexpr uint64_t kDefaultFallbackDurationNanos = 60 * 1000000000ull;
+
 }  // namespace
 
 static RegisterContextFactory register_MetadataExchange(
@@ -82,11 +87,84 @@ void PluginRootContext::updateMetadataValue() {
   // store serialized form
   std::string metadata_bytes;
   serializeToStringDeterministic(metadata, &metadata_bytes);
-  metadata_value_ =
-      Base64::encode(metadata_bytes.data(), metadata_bytes.size());
+  metadata_value_ = ::istio::utils::Base64Codec::encode(metadata_bytes);
+
+  // The binary format carries the same exchanged keys.
+  wasm::common::NodeInfo node_info;
+  const auto node_info_status =
+      ::Wasm::Common::extractNodeMetadata(metadata, &node_info);
+  std::string node_info_bytes;
+  if (!node_info_status.ok() ||
+      !::Wasm::Common::serializeNodeInfoBinary(node_info, &node_info_bytes)) {
+    logWarn("cannot serialize node info, using metadata struct only");
+    node_info_value_.clear();
+    return;
+  }
+  // Peers restore the Struct from the node info, so the binary format is only
+  // offered if that yields the exchanged Struct.
+  google::protobuf::Struct restored;
+  ::Wasm::Common::buildNodeMetadata(node_info, &restored);
+  std::string restored_bytes;
+  serializeToStringDeterministic(restored, &restored_bytes);
+  if (restored_bytes != metadata_bytes) {
+    logDebug("exchanged keys are not all in node info, using metadata struct");
+    node_info_value_.clear();
+    return;
+  }
+  node_info_value_ = ::istio::utils::Base64Codec::encode(node_info_bytes);
 }
 
-bool PluginRootContext::onConfigure(std::unique_ptr<WasmData>) {
+bool PluginRootContext::onConfigure(std::unique_ptr<WasmData> configuration) {
+  // Configuration is optional, and may be an opaque string in older
+  // deployments, so parse errors fall back to the defaults.
+  config_.Clear();
+  const std::string configuration_string = configuration->toString();
+  if (!configuration_string.empty()) {
+    google::protobuf::util::JsonParseOptions json_options;
+    if (!google::protobuf::util::JsonStringToMessage(configuration_string,
+                                                     &config_, json_options)
+             .ok()) {
+      logDebug(absl::StrCat("using default configuration, cannot parse ",
+                            configuration_string));
+      config_.Clear();
+    }
+  }
+
+  size_t max_peer_cache_size = 0;
+  if (config_.connection_scoped_exchange() || config_.id_only_exchange()) {
+    max_peer_cache_size = config_.max_peer_cache_size() > 0
+                              ? config_.max_peer_cache_size()
+                              : kDefaultMaxPeerCacheSize;
+  }
+  peers_.setCapacity(max_peer_cache_size);
+  node_infos_.setCapacity(config_.max_peer_cache_size() > 0
+                              ? config_.max_peer_cache_size()
+                              : kDefaultMaxPeerCacheSize);
+  downstream_connections_.setCapacity(max_peer_cache_size);
+  upstreams_.setCapacity(max_peer_cache_size);
+
+  // Peers send the full metadata on every response during the fallback.
+  std::vector<StringView> accept_tokens;
+  if (config_.node_info_exchange()) {
+    accept_tokens.push_back(ExchangeNodeInfoFormatV1);
+  }
+  fallback_accept_value_ = absl::StrJoin(accept_tokens, ",");
+  if (config_.connection_scoped_exchange()) {
+    accept_tokens.push_back(ExchangeConnectionScoped);
+  }
+  if (config_.id_only_exchange()) {
+    accept_tokens.push_back(ExchangeIdOnly);
+  }
+  accept_value_ = absl::StrJoin(accept_tokens, ",");
+
+  fallback_duration_nanos_ = kDefaultFallbackDurationNanos;
+  if (config_.has_fallback_duration()) {
+    fallback_duration_nanos_ =
+        ::google::protobuf::util::TimeUtil::DurationToNanoseconds(
+            config_.fallback_duration());
+  }
+
+  loadPeerDirectory();
   updateMetadataValue();
   if (!getStringValue({"node", "id"}, &node_id_)) {
     logDebug("cannot get node ID");
@@ -96,39 +174,281 @@ bool PluginRootContext::onConfigure(std::unique_ptr<WasmData>) {
   return true;
 }
 
+void PluginRootContext::loadPeerDirectory() {
+  peer_directory_.clear();
+  ::Wasm::Common::PeerDirectory directory;
+  if (!config_.peer_directory().empty()) {
+    const auto status = ::Wasm::Common::parsePeerDirectory(
+        config_.peer_directory(), &directory);
+    if (!status.ok()) {
+      logWarn(absl::StrCat("cannot parse peer directory: ",
+                           status.message().ToString()));
+    }
+  }
+  if (!config_.peer_directory_path().empty()) {
+#ifdef NULL_PLUGIN
+    std::ifstream file(config_.peer_directory_path());
+    std::stringstream json;
+    json << file.rdbuf();
+    const auto status =
+        file ? ::Wasm::Common::parsePeerDirectory(json.str(), &directory)
+             : google::protobuf::util::Status(
+                   google::protobuf::util::error::NOT_FOUND, "cannot read");
+    if (!status.ok()) {
+      logWarn(absl::StrCat("cannot load peer directory ",
+                           config_.peer_directory_path(), ": ",
+                           status.message().ToString()));
+    }
+#else
+    logWarn("peer directory files are only read by the native plugin");
+#endif
+  }
+
+  for (const auto& peer : directory) {
+    wasm::common::NodeInfo node_info;
+    PeerMetadata metadata;
+    if (!::Wasm::Common::extractNodeMetadata(peer.second, &node_info).ok() ||
+        !serializeToStringDeterministic(peer.second, &metadata.metadata) ||
+        !::Wasm::Common::serializeNodeInfoBinary(node_info,
+                                                 &metadata.node_info)) {
+      logWarn(absl::StrCat("skipping peer directory entry ", peer.first));
+      continue;
+    }
+#ifdef NULL_PLUGIN
+    // Telemetry plugins resolve the peer without decoding, and see the
+    // directory entry even if the peer was decoded before.
+    ::Wasm::Common::SharedNodeInfoStore::instance().pin(
+        peer.first,
+        std::make_shared<const wasm::common::NodeInfo>(std::move(node_info)));
+#endif
+    peer_directory_.emplace(peer.first, std::move(metadata));
+  }
+  logDebug(absl::StrCat("peer directory size: ", peer_directory_.size()));
+}
+
+const PeerMetadata* PluginRootContext::findPeer(const std::string& peer_id) {
+  const PeerMetadata* peer = peers_.get(peer_id);
+  if (peer != nullptr) {
+    return peer;
+  }
+  auto it = peer_directory_.find(peer_id);
+  return it == peer_directory_.end() ? nullptr : &it->second;
+}
+
+bool PluginRootContext::inFallback(const UpstreamState& upstream) {
+  return upstream.fallback_until_nanos != 0 &&
+         getCurrentTimeNanoseconds() < upstream.fallback_until_nanos;
+}
+
+void PluginRootContext::startFallback(const std::string& cluster) {
+  if (!tracksUpstreams()) {
+    return;
+  }
+  logDebug(absl::StrCat("peer ID not known, exchanging full metadata with ",
+                        cluster));
+  UpstreamState* upstream = upstreams_.get(cluster);
+  if (upstream == nullptr) {
+    upstream = upstreams_.insert(cluster, UpstreamState());
+  }
+  upstream->fallback_until_nanos =
+      getCurrentTimeNanoseconds() + fallback_duration_nanos_;
+}
+
+void PluginRootContext::setAcceptsIdOnly(const std::string& cluster,
+                                         bool accepts_id_only) {
+  if (!tracksUpstreams()) {
+    return;
+  }
+  UpstreamState* upstream = upstreams_.get(cluster);
+  if (upstream == nullptr) {
+    if (!accepts_id_only) {
+      return;
+    }
+    upstream = upstreams_.insert(cluster, UpstreamState());
+  }
+  upstream->accepts_id_only = accepts_id_only;
+}
+
+StringView PluginRootContext::acceptValue(const std::string& cluster) {
+  if (!tracksUpstreams()) {
+    return accept_value_;
+  }
+  const UpstreamState* upstream = upstreams_.get(cluster);
+  return upstream != nullptr && inFallback(*upstream) ? fallback_accept_value_
+                                                      : accept_value_;
+}
+
+bool PluginRootContext::sendIdOnly(const std::string& cluster) {
+  if (!config_.id_only_exchange()) {
+    return false;
+  }
+  // Older upstreams neither resolve the ID nor report that they did not, so
+  // the ID is sent alone only to clusters that advertised resolving it.
+  const UpstreamState* upstream = upstreams_.get(cluster);
+  return upstream != nullptr && upstream->accepts_id_only &&
+         !inFallback(*upstream);
+}
+
+bool PluginRootContext::markDownstreamConnection(int64_t connection_id) {
+  const std::string key = std::to_string(connection_id);
+  if (downstream_connections_.get(key) != nullptr) {
+    return true;
+  }
+  downstream_connections_.insert(key, true);
+  return false;
+}
+
+WasmDataPtr PluginContext::takeHeader(bool response, StringView key) {
+  auto value = response ? getResponseHeader(key) : getRequestHeader(key);
+  if (value == nullptr || value->view().empty()) {
+    return nullptr;
+  }
+  if (response) {
+    removeResponseHeader(key);
+  } else {
+    removeRequestHeader(key);
+  }
+  return value;
+}
+
+bool PluginContext::storePeerMetadata(bool response, StringView metadata_id_key,
+                                      StringView metadata_key,
+                                      StringView node_info_key) {
+  std::string peer_id;
+  auto metadata_id = takeHeader(response, ExchangeMetadataHeaderId);
+  if (metadata_id != nullptr) {
+    peer_id = std::string(metadata_id->view());
+    setFilterState(metadata_id_key, peer_id);
+  }
+  auto metadata_value = takeHeader(response, ExchangeMetadataHeader);
+  auto node_info_value = takeHeader(response, ExchangeNodeInfoHeader);
+
+  // A known peer does not need decoding, and may have sent its ID only.
+  const PeerMetadata* peer = nullptr;
+  if (!peer_id.empty()) {
+    peer = rootContext()->findPeer(peer_id);
+  }
+
+  PeerMetadata decoded;
+  if (peer == nullptr) {
+    if (metadata_value != nullptr) {
+      ::istio::utils::Base64Codec::decode(metadata_value->view(),
+                                          &decoded.metadata);
+      if (node_info_value != nullptr) {
+        ::istio::utils::Base64Codec::decode(node_info_value->view(),
+                                            &decoded.node_info);
+      }
+      peer = &decoded;
+    } else if (node_info_value != nullptr) {
+      peer = decodeNodeInfo(node_info_value->view(), &decoded);
+    }
+    if (peer == nullptr ||
+        (peer->metadata.empty() && peer->node_info.empty())) {
+      return peer_id.empty();
+    }
+    if (!peer_id.empty() && rootContext()->cachesPeers()) {
+      peer = peer == &decoded
+                 ? rootContext()->insertPeer(peer_id, std::move(decoded))
+                 : rootContext()->insertPeer(peer_id, *peer);
+    }
+  }
+
+  if (!peer->metadata.empty()) {
+    setFilterState(metadata_key, peer->metadata);
+  }
+  if (!peer->node_info.empty()) {
+    setFilterState(node_info_key, peer->node_info);
+  }
+  return true;
+}
+
+const PeerMetadata* PluginContext::decodeNodeInfo(StringView node_info_value,
+                                                  PeerMetadata* decoded) {
+  const std::string key(node_info_value);
+  const PeerMetadata* peer = rootContext()->findNodeInfo(key);
+  if (peer != nullptr) {
+    return peer;
+  }
+  ::istio::utils::Base64Codec::decode(node_info_value, &decoded->node_info);
+  if (decoded->node_info.empty()) {
+    return decoded;
+  }
+  // Access logs and older plugins read the Struct filter state, so it is
+  // restored for peers that sent the binary format only. Peers only send it
+  // if the Struct is restored exactly.
+  wasm::common::NodeInfo node_info;
+  if (!::Wasm::Common::parseNodeInfoBinary(decoded->node_info, &node_info)
+           .ok()) {
+    logWarn("cannot parse peer node info");
+    return nullptr;
+  }
+  google::protobuf::Struct metadata;
+  ::Wasm::Common::buildNodeMetadata(node_info, &metadata);
+  serializeToStringDeterministic(metadata, &decoded->metadata);
+  peer = rootContext()->insertNodeInfo(key, *decoded);
+  return peer != nullptr ? peer : decoded;
+}
+
+bool PluginContext::downstreamHasMetadata() {
+  if (!downstream_accepts_connection_scoped_ ||
+      !rootContext()->connectionScoped()) {
+    return false;
+  }
+  // Connection IDs are not reused while the proxy runs, unlike source
+  // addresses, so a new connection always starts with the full metadata.
+  int64_t connection_id;
+  if (!getValue({"connection", "id"}, &connection_id)) {
+    return false;
+  }
+  return rootContext()->markDownstreamConnection(connection_id);
+}
+
 FilterHeadersStatus PluginContext::onRequestHeaders() {
   // strip and store downstream peer metadata
-  auto downstream_metadata_value = getRequestHeader(ExchangeMetadataHeader);
-  if (downstream_metadata_value != nullptr &&
-      !downstream_metadata_value->view().empty()) {
-    removeRequestHeader(ExchangeMetadataHeader);
-    auto downstream_metadata_bytes =
-        Base64::decodeWithoutPadding(downstream_metadata_value->view());
-    setFilterState(::Wasm::Common::kDownstreamMetadataKey,
-                   downstream_metadata_bytes);
-  }
+  downstream_peer_unknown_ =
+      !storePeerMetadata(false, ::Wasm::Common::kDownstreamMetadataIdKey,
+                         ::Wasm::Common::kDownstreamMetadataKey,
+                         ::Wasm::Common::kDownstreamNodeInfoKey);
 
-  auto downstream_metadata_id = getRequestHeader(ExchangeMetadataHeaderId);
-  if (downstream_metadata_id != nullptr &&
-      !downstream_metadata_id->view().empty()) {
-    removeRequestHeader(ExchangeMetadataHeaderId);
-    setFilterState(::Wasm::Common::kDownstreamMetadataIdKey,
-                   downstream_metadata_id->view());
+  auto downstream_accept = takeHeader(false, ExchangeMetadataAcceptHeader);
+  if (downstream_accept != nullptr) {
+    for (absl::string_view token :
+         absl::StrSplit(downstream_accept->view(), ',')) {
+      if (token == ExchangeNodeInfoFormatV1) {
+        downstream_accepts_node_info_ = true;
+      } else if (token == ExchangeConnectionScoped) {
+        downstream_accepts_connection_scoped_ = true;
+      } else if (token == ExchangeIdOnly) {
+        downstream_accepts_id_only_ = true;
+      }
+    }
   }
 
   // do not send request internal headers to sidecar app if it is an inbound
   // proxy
   if (direction_ != ::Wasm::Common::TrafficDirection::Inbound) {
-    auto metadata = metadataValue();
-    // insert peer metadata struct for upstream
-    if (!metadata.empty()) {
-      replaceRequestHeader(ExchangeMetadataHeader, metadata);
+    if (rootContext()->tracksUpstreams()) {
+      getStringValue({"cluster_name"}, &upstream_cluster_);
     }
 
     auto nodeid = nodeId();
     if (!nodeid.empty()) {
       replaceRequestHeader(ExchangeMetadataHeaderId, nodeid);
     }
+
+    auto metadata = metadataValue();
+    // insert peer metadata struct for upstream
+    if (!metadata.empty() &&
+        (nodeid.empty() || !rootContext()->sendIdOnly(upstream_cluster_))) {
+      replaceRequestHeader(ExchangeMetadataHeader, metadata);
+    }
+
+    // The upstream may be an older proxy, so requests carry the struct, and
+    // advertise the binary format for the response.
+    auto accept = rootContext()->acceptValue(upstream_cluster_);
+    if (!accept.empty()) {
+      replaceRequestHeader(ExchangeMetadataAcceptHeader, accept);
+    }
   }
 
   return FilterHeadersStatus::Continue;
@@ -136,37 +456,57 @@ FilterHeadersStatus PluginContext::onRequestHeaders() {
 
 FilterHeadersStatus PluginContext::onResponseHeaders() {
   // strip and store upstream peer metadata
-  auto upstream_metadata_value = getResponseHeader(ExchangeMetadataHeader);
-  if (upstream_metadata_value != nullptr &&
-      !upstream_metadata_value->view().empty()) {
-    removeResponseHeader(ExchangeMetadataHeader);
-    auto upstream_metadata_bytes =
-        Base64::decodeWithoutPadding(upstream_metadata_value->view());
-    setFilterState(::Wasm::Common::kUpstreamMetadataKey,
-                   upstream_metadata_bytes);
+  const bool upstream_peer_known =
+      storePeerMetadata(true, ::Wasm::Common::kUpstreamMetadataIdKey,
+                        ::Wasm::Common::kUpstreamMetadataKey,
+                        ::Wasm::Common::kUpstreamNodeInfoKey);
+  // Either side not knowing the other's ID falls back to the full exchange.
+  if (takeHeader(true, ExchangeMetadataMissHeader) != nullptr ||
+      !upstream_peer_known) {
+    rootContext()->startFallback(upstream_cluster_);
   }
-
-  auto upstream_metadata_id = getResponseHeader(ExchangeMetadataHeaderId);
-  if (upstream_metadata_id != nullptr &&
-      !upstream_metadata_id->view().empty()) {
-    removeResponseHeader(ExchangeMetadataHeaderId);
-    setFilterState(::Wasm::Common::kUpstreamMetadataIdKey,
-                   upstream_metadata_id->view());
+  if (rootContext()->idOnly()) {
+    bool upstream_accepts_id_only = false;
+    auto upstream_accept = takeHeader(true, ExchangeMetadataAcceptHeader);
+    if (upstream_accept != nullptr) {
+      for (absl::string_view token :
+           absl::StrSplit(upstream_accept->view(), ',')) {
+        upstream_accepts_id_only |= token == ExchangeIdOnly;
+      }
+    }
+    rootContext()->setAcceptsIdOnly(upstream_cluster_,
+                                    upstream_accepts_id_only);
   }
 
   // do not send response internal headers to sidecar app if it is an outbound
   // proxy
   if (direction_ != ::Wasm::Common::TrafficDirection::Outbound) {
-    auto metadata = metadataValue();
-    // insert peer metadata struct for downstream
-    if (!metadata.empty()) {
-      replaceResponseHeader(ExchangeMetadataHeader, metadata);
-    }
-
     auto nodeid = nodeId();
     if (!nodeid.empty()) {
       replaceResponseHeader(ExchangeMetadataHeaderId, nodeid);
     }
+    if (downstream_peer_unknown_) {
+      replaceResponseHeader(ExchangeMetadataMissHeader, "1");
+    }
+    // Only downstreams that resolve IDs read the accept header on responses.
+    if (downstream_accepts_id_only_ && rootContext()->idOnly()) {
+      replaceResponseHeader(ExchangeMetadataAcceptHeader, ExchangeIdOnly);
+    }
+
+    // The downstream restores the metadata from the node ID if it resolves
+    // IDs, or after the first response on a connection.
+    if (nodeid.empty() ||
+        (!downstream_accepts_id_only_ && !downstreamHasMetadata())) {
+      auto node_info = nodeInfoValue();
+      auto metadata = metadataValue();
+      if (downstream_accepts_node_info_ && !node_info.empty()) {
+        // insert peer node info in the binary format for downstream
+        replaceResponseHeader(ExchangeNodeInfoHeader, node_info);
+      } else if (!metadata.empty()) {
+        // insert peer metadata struct for downstream
+        replaceResponseHeader(ExchangeMetadataHeader, metadata);
+      }
+    }
   }
 
   return FilterHeadersStatus::Continue;
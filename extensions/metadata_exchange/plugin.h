@@ -15,7 +15,9 @@
 
 #pragma once
 
+#include "extensions/common/clock_cache.h"
 #include "extensions/common/context.h"
+#include "extensions/metadata_exchange/config.pb.h"
 
 #ifndef NULL_PLUGIN
 
@@ -48,13 +50,60 @@ using NullPluginRootRegistry =
 constexpr StringView ExchangeMetadataHeader = "x-envoy-peer-metadata";
 constexpr StringView ExchangeMetadataHeaderId = "x-envoy-peer-metadata-id";
 
+// Peer node info in the binary format, see
+// Wasm::Common::serializeNodeInfoBinary. A proxy advertises what it reads with
+// a comma separated list in the accept header on requests. Responses to such
+// requests carry the binary header instead of the google.protobuf.Struct
+// header, so older proxies keep receiving the Struct format. The binary format
+// is only asked for with PluginConfig.node_info_exchange.
+constexpr StringView ExchangeNodeInfoHeader = "x-envoy-peer-node-info";
+constexpr StringView ExchangeMetadataAcceptHeader =
+    "x-envoy-peer-metadata-accept";
+constexpr StringView ExchangeNodeInfoFormatV1 = "node-info-v1";
+// The downstream restores peer metadata from the peer ID, so responses after
+// the first one on a connection may carry the peer ID only.
+constexpr StringView ExchangeConnectionScoped = "connection-scoped";
+// The downstream resolves peer IDs it does not know by asking for the full
+// metadata, so responses may carry the peer ID only. Responses to such
+// requests carry the token as well if the upstream resolves peer IDs, so that
+// requests to it may carry the peer ID only. Older upstreams never send the
+// token, and keep receiving the full metadata.
+constexpr StringView ExchangeIdOnly = "id-only";
+
+// Set on a response if the request carried a peer ID only, and the peer was
+// not known. The downstream then sends the full metadata for a while.
+constexpr StringView ExchangeMetadataMissHeader = "x-envoy-peer-metadata-miss";
+
+// Decoded metadata of a peer, as stored in the filter state.
+struct PeerMetadata {
+  // Serialized google.protobuf.Struct.
+  std::string metadata;
+  // Node info in the binary format.
+  std::string node_info;
+};
+
+// Exchange state of the proxies behind an upstream cluster. Request headers
+// are processed before the upstream host is picked, so the cluster is the
+// closest known peer.
+struct UpstreamState {
+  // Set if the last response from the cluster resolved peer IDs.
+  bool accepts_id_only = false;
+  // End of the full metadata exchange, after either side did not know the
+  // peer ID.
+  uint64_t fallback_until_nanos = 0;
+};
+
 // PluginRootContext is the root context for all streams processed by the
 // thread. It has the same lifetime as the worker thread and acts as target for
 // interactions that outlives individual stream, e.g. timer, async calls.
 class PluginRootContext : public RootContext {
  public:
   PluginRootContext(uint32_t id, StringView root_id)
-      : RootContext(id, root_id) {}
+      : RootContext(id, root_id),
+        peers_(0),
+        node_infos_(0),
+        downstream_connections_(0),
+        upstreams_(0) {}
   ~PluginRootContext() = default;
 
   bool onConfigure(std::unique_ptr<WasmData>) override;
@@ -62,12 +111,79 @@ class PluginRootContext : public RootContext {
   void onTick() override{};
 
   StringView metadataValue() { return metadata_value_; };
+  StringView nodeInfoValue() { return node_info_value_; };
   StringView nodeId() { return node_id_; };
+  // Returns the accept header value of requests to the upstream cluster.
+  StringView acceptValue(const std::string& cluster);
+  bool connectionScoped() const {
+    return config_.connection_scoped_exchange();
+  };
+  bool idOnly() const { return config_.id_only_exchange(); };
+  bool cachesPeers() const { return peers_.capacity() > 0; };
+  bool tracksUpstreams() const { return upstreams_.capacity() > 0; };
+  // Returns true if requests to the upstream cluster carry the peer ID only.
+  bool sendIdOnly(const std::string& cluster);
+  // Records whether a response from the upstream cluster advertised that it
+  // resolves peer IDs.
+  void setAcceptsIdOnly(const std::string& cluster, bool accepts_id_only);
+  // Exchanges the full metadata with the upstream cluster for the fallback
+  // duration, after a peer did not know the ID of this proxy, or sent an ID
+  // that is not known. Requests carry the full metadata, and ask for it on
+  // responses.
+  void startFallback(const std::string& cluster);
+
+  // Returns the metadata of a peer from the peer cache or the peer directory,
+  // or nullptr. The returned pointer is valid until the next call to
+  // insertPeer.
+  const PeerMetadata* findPeer(const std::string& peer_id);
+  const PeerMetadata* insertPeer(const std::string& peer_id,
+                                 PeerMetadata peer) {
+    return peers_.insert(peer_id, std::move(peer));
+  };
+
+  // Returns the metadata decoded from a node info header value, or nullptr.
+  // The returned pointer is valid until the next call to insertNodeInfo.
+  const PeerMetadata* findNodeInfo(const std::string& node_info_value) {
+    return node_infos_.get(node_info_value);
+  };
+  const PeerMetadata* insertNodeInfo(const std::string& node_info_value,
+                                     PeerMetadata peer) {
+    return node_infos_.insert(node_info_value, std::move(peer));
+  };
+
+  // Returns true if the full metadata was already sent on the downstream
+  // connection, and records it otherwise.
+  bool markDownstreamConnection(int64_t connection_id);
 
  private:
   void updateMetadataValue();
+  void loadPeerDirectory();
+  bool inFallback(const UpstreamState& upstream);
+
   std::string metadata_value_;
+  // Base64 encoded node info in the binary format.
+  std::string node_info_value_;
   std::string node_id_;
+  std::string accept_value_;
+  // Accept header value during the fallback duration.
+  std::string fallback_accept_value_;
+
+  metadata_exchange::PluginConfig config_;
+  // Peers by peer ID, only used with connection scoped or ID-only exchange.
+  ::Wasm::Common::ClockCache<PeerMetadata> peers_;
+  // Peers that sent node info in the binary format only, by the encoded
+  // header value, so that the Struct is restored once per peer in any
+  // exchange mode.
+  ::Wasm::Common::ClockCache<PeerMetadata> node_infos_;
+  // IDs of downstream connections that received the full metadata. The host
+  // does not report closed connections, so their entries are evicted by newer
+  // ones. An evicted open connection gets the full metadata again.
+  ::Wasm::Common::ClockCache<bool> downstream_connections_;
+  // Peers known ahead of time, by peer ID.
+  std::unordered_map<std::string, PeerMetadata> peer_directory_;
+  // Exchange state by upstream cluster name.
+  ::Wasm::Common::ClockCache<UpstreamState> upstreams_;
+  uint64_t fallback_duration_nanos_ = 0;
 };
 
 // Per-stream context.
@@ -86,9 +202,36 @@ class PluginContext : public Context {
     return dynamic_cast<PluginRootContext*>(this->root());
   };
   inline StringView metadataValue() { return rootContext()->metadataValue(); };
+  inline StringView nodeInfoValue() { return rootContext()->nodeInfoValue(); };
   inline StringView nodeId() { return rootContext()->nodeId(); }
 
+  // Removes and returns a non-empty exchange header.
+  WasmDataPtr takeHeader(bool response, StringView key);
+  // Strips peer metadata headers and stores the peer metadata in the filter
+  // state under the given keys. Returns false if the peer sent an ID that is
+  // not known.
+  bool storePeerMetadata(bool response, StringView metadata_id_key,
+                         StringView metadata_key, StringView node_info_key);
+  // Returns the peer metadata of a binary node info header value, decoded
+  // into the given struct or taken from the node info cache, or nullptr if
+  // the value cannot be parsed.
+  const PeerMetadata* decodeNodeInfo(StringView node_info_value,
+                                     PeerMetadata* decoded);
+  // Returns true if the downstream already has the full metadata of this
+  // proxy.
+  bool downstreamHasMetadata();
+
   ::Wasm::Common::TrafficDirection direction_;
+  // Upstream cluster name, only set if upstreams are tracked.
+  std::string upstream_cluster_;
+  // Set if the downstream reads node info in the binary format.
+  bool downstream_accepts_node_info_ = false;
+  // Set if the downstream restores peer metadata from the peer ID.
+  bool downstream_accepts_connection_scoped_ = false;
+  // Set if the downstream resolves peer IDs it does not know.
+  bool downstream_accepts_id_only_ = false;
+  // Set if the downstream sent an ID that is not known.
+  bool downstream_peer_unknown_ = false;
 };
 
 #ifdef NULL_PLUGIN
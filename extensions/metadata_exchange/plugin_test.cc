@@ -0,0 +1,428 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/metadata_exchange/plugin.h"
+
+#include "absl/strings/str_cat.h"
+#include "extensions/common/node_info.pb.h"
+#include "extensions/common/test_host.h"
+#include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "gtest/gtest.h"
+#include "src/istio/utils/base64.h"
+#include "test/test_common/utility.h"
+
+// WASM_PROLOG
+#ifdef NULL_PLUGIN
+namespace Envoy {
+namespace Extensions {
+namespace Wasm {
+namespace MetadataExchange {
+namespace Plugin {
+#endif  // NULL_PLUGIN
+
+// END WASM_PROLOG
+
+namespace {
+
+using ::Envoy::Http::TestHeaderMapImpl;
+using ::Wasm::Common::TrafficDirection;
+using ::Wasm::Common::Testing::int64Bytes;
+using ::Wasm::Common::Testing::kPeerNodeJson;
+using ::Wasm::Common::Testing::MockHost;
+using ::Wasm::Common::Testing::parseStruct;
+using ::Wasm::Common::Testing::TestPlugin;
+using ::Wasm::Common::Testing::TestRootContext;
+using ::Wasm::Common::Testing::TestStreamContext;
+
+constexpr absl::string_view local_id = "sidecar~10.44.2.14~productpage";
+constexpr absl::string_view peer_id = "sidecar~10.44.2.15~ratings";
+
+// Peer metadata headers as a peer proxy sends them.
+std::string peerMetadataHeader() {
+  return ::istio::utils::Base64Codec::encode(
+      parseStruct(kPeerNodeJson).SerializeAsString());
+}
+
+std::string peerNodeInfoHeader() {
+  wasm::common::NodeInfo node_info;
+  ::Wasm::Common::extractNodeMetadata(parseStruct(kPeerNodeJson), &node_info);
+  std::string node_info_bytes;
+  ::Wasm::Common::serializeNodeInfoBinary(node_info, &node_info_bytes);
+  return ::istio::utils::Base64Codec::encode(node_info_bytes);
+}
+
+std::string header(const TestHeaderMapImpl& headers, absl::string_view key) {
+  return headers.get_(std::string(key));
+}
+
+bool hasHeader(const TestHeaderMapImpl& headers, absl::string_view key) {
+  return headers.has(std::string(key));
+}
+
+// MetadataExchangeTest loads the plugin in the null VM, and runs streams
+// through it. Tests play the peer proxy by setting and reading the exchange
+// headers.
+class MetadataExchangeTest : public testing::Test {
+ protected:
+  MetadataExchangeTest() {
+    host_.set({"node", "id"}, std::string(local_id));
+    setDirection(TrafficDirection::Outbound);
+  }
+
+  void setDirection(TrafficDirection direction) {
+    host_.set({"listener_direction"},
+              int64Bytes(static_cast<int64_t>(direction)));
+  }
+
+  // Loads the plugin with a JSON configuration.
+  void configure(const std::string& configuration) {
+    plugin_.load("metadata_exchange", "envoy.wasm.metadata_exchange", "",
+                 envoy::api::v2::core::TrafficDirection::UNSPECIFIED,
+                 configuration, new TestRootContext(&host_));
+  }
+
+  // Runs a stream with the given headers through the plugin, which updates
+  // the headers in place.
+  void run(TestHeaderMapImpl& request_headers,
+           TestHeaderMapImpl& response_headers) {
+    host_.clearFilterState();
+    TestStreamContext context(&plugin_, &host_);
+    context.onCreate(plugin_.rootContext()->id());
+    context.decodeHeaders(request_headers, false);
+    context.encodeHeaders(response_headers, false);
+  }
+
+  MockHost host_;
+  TestPlugin plugin_;
+};
+
+TEST_F(MetadataExchangeTest, StructFormatByDefault) {
+  configure("");
+
+  TestHeaderMapImpl request_headers;
+  TestHeaderMapImpl response_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataHeader), peerMetadataHeader()}};
+  run(request_headers, response_headers);
+
+  EXPECT_EQ(header(request_headers, ExchangeMetadataHeaderId), local_id);
+  EXPECT_TRUE(hasHeader(request_headers, ExchangeMetadataHeader));
+  EXPECT_FALSE(hasHeader(request_headers, ExchangeMetadataAcceptHeader));
+
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeMetadataHeader));
+  EXPECT_EQ(host_.filterState(::Wasm::Common::kUpstreamMetadataIdKey),
+            peer_id);
+  google::protobuf::Struct upstream;
+  ASSERT_TRUE(upstream.ParseFromString(
+      host_.filterState(::Wasm::Common::kUpstreamMetadataKey)));
+  EXPECT_EQ(upstream.fields().at("WORKLOAD_NAME").string_value(),
+            "ratings-v1");
+  EXPECT_EQ(host_.filterState(::Wasm::Common::kUpstreamNodeInfoKey), "");
+}
+
+TEST_F(MetadataExchangeTest, NodeInfoFormatKeepsStructFilterState) {
+  configure(R"({"node_info_exchange": true})");
+
+  TestHeaderMapImpl request_headers;
+  TestHeaderMapImpl response_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeNodeInfoHeader), peerNodeInfoHeader()}};
+  run(request_headers, response_headers);
+
+  EXPECT_EQ(header(request_headers, ExchangeMetadataAcceptHeader),
+            ExchangeNodeInfoFormatV1);
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeNodeInfoHeader));
+
+  wasm::common::NodeInfo node_info;
+  ASSERT_TRUE(::Wasm::Common::parseNodeInfoBinary(
+                  host_.filterState(::Wasm::Common::kUpstreamNodeInfoKey),
+                  &node_info)
+                  .ok());
+  EXPECT_EQ(node_info.workload_name(), "ratings-v1");
+
+  // Access logs read the Struct, which is restored from the node info.
+  google::protobuf::Struct upstream;
+  ASSERT_TRUE(upstream.ParseFromString(
+      host_.filterState(::Wasm::Common::kUpstreamMetadataKey)));
+  EXPECT_EQ(upstream.fields().at("WORKLOAD_NAME").string_value(),
+            "ratings-v1");
+  EXPECT_EQ(upstream.fields()
+                .at("LABELS")
+                .struct_value()
+                .fields()
+                .at("app")
+                .string_value(),
+            "ratings");
+}
+
+TEST_F(MetadataExchangeTest, NodeInfoFormatRepeatedWithoutPeerCache) {
+  configure(R"({"node_info_exchange": true})");
+
+  // Peers are only cached by ID with connection scoped or ID-only exchange,
+  // while node info is kept decoded in any mode.
+  for (int i = 0; i < 3; i++) {
+    TestHeaderMapImpl request_headers;
+    TestHeaderMapImpl response_headers{
+        {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+        {std::string(ExchangeNodeInfoHeader), peerNodeInfoHeader()}};
+    run(request_headers, response_headers);
+
+    google::protobuf::Struct upstream;
+    ASSERT_TRUE(upstream.ParseFromString(
+        host_.filterState(::Wasm::Common::kUpstreamMetadataKey)));
+    EXPECT_TRUE(google::protobuf::util::MessageDifferencer::Equals(
+        upstream, parseStruct(kPeerNodeJson)));
+    EXPECT_NE(host_.filterState(::Wasm::Common::kUpstreamNodeInfoKey), "");
+  }
+}
+
+TEST_F(MetadataExchangeTest, NodeInfoFormatOnlyIfStructRestored) {
+  // INSTANCE_IPS is not in the node info, so the downstream could not restore
+  // the exchanged Struct from it.
+  host_.set({"node", "metadata"}, parseStruct(R"###(
+{
+   "NAME":"productpage-v1-84975bc778-pxz2w",
+   "WORKLOAD_NAME":"productpage-v1",
+   "INSTANCE_IPS":"10.44.2.14",
+   "EXCHANGE_KEYS":"NAME,WORKLOAD_NAME,INSTANCE_IPS"
+}
+)###")
+                                      .SerializeAsString());
+  setDirection(TrafficDirection::Inbound);
+  configure("");
+
+  TestHeaderMapImpl request_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataHeader), peerMetadataHeader()},
+      {std::string(ExchangeMetadataAcceptHeader),
+       std::string(ExchangeNodeInfoFormatV1)}};
+  TestHeaderMapImpl response_headers;
+  run(request_headers, response_headers);
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeNodeInfoHeader));
+  EXPECT_TRUE(hasHeader(response_headers, ExchangeMetadataHeader));
+}
+
+TEST_F(MetadataExchangeTest, ResponseFormatFollowsDownstream) {
+  setDirection(TrafficDirection::Inbound);
+  configure("");
+
+  // An older downstream gets the Struct.
+  TestHeaderMapImpl request_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataHeader), peerMetadataHeader()}};
+  TestHeaderMapImpl response_headers;
+  run(request_headers, response_headers);
+  EXPECT_TRUE(hasHeader(response_headers, ExchangeMetadataHeader));
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeNodeInfoHeader));
+  EXPECT_NE(host_.filterState(::Wasm::Common::kDownstreamMetadataKey), "");
+
+  // A downstream that asks for the binary format gets it instead.
+  TestHeaderMapImpl binary_request_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataHeader), peerMetadataHeader()},
+      {std::string(ExchangeMetadataAcceptHeader),
+       std::string(ExchangeNodeInfoFormatV1)}};
+  TestHeaderMapImpl binary_response_headers;
+  run(binary_request_headers, binary_response_headers);
+  EXPECT_FALSE(hasHeader(binary_response_headers, ExchangeMetadataHeader));
+  EXPECT_TRUE(hasHeader(binary_response_headers, ExchangeNodeInfoHeader));
+  EXPECT_FALSE(
+      hasHeader(binary_request_headers, ExchangeMetadataAcceptHeader));
+}
+
+TEST_F(MetadataExchangeTest, ConnectionScopedKeyedByConnection) {
+  setDirection(TrafficDirection::Inbound);
+  configure(R"({"connection_scoped_exchange": true})");
+  host_.set({"source", "address"}, "10.44.2.15:41000");
+
+  const auto respond = [this](int64_t connection_id) {
+    host_.set({"connection", "id"}, int64Bytes(connection_id));
+    TestHeaderMapImpl request_headers{
+        {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+        {std::string(ExchangeMetadataHeader), peerMetadataHeader()},
+        {std::string(ExchangeMetadataAcceptHeader),
+         std::string(ExchangeConnectionScoped)}};
+    TestHeaderMapImpl response_headers;
+    run(request_headers, response_headers);
+    EXPECT_EQ(header(response_headers, ExchangeMetadataHeaderId), local_id);
+    return hasHeader(response_headers, ExchangeMetadataHeader);
+  };
+
+  EXPECT_TRUE(respond(1));
+  EXPECT_FALSE(respond(1));
+  // A new connection from the same source address gets the full metadata.
+  EXPECT_TRUE(respond(2));
+  EXPECT_FALSE(respond(2));
+}
+
+TEST_F(MetadataExchangeTest, ConnectionScopedRecoversFromUnknownPeer) {
+  configure(R"({"connection_scoped_exchange": true})");
+
+  // The upstream sent its ID only, e.g. after this proxy evicted it.
+  TestHeaderMapImpl request_headers;
+  TestHeaderMapImpl response_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)}};
+  run(request_headers, response_headers);
+  EXPECT_EQ(header(request_headers, ExchangeMetadataAcceptHeader),
+            ExchangeConnectionScoped);
+  EXPECT_EQ(host_.filterState(::Wasm::Common::kUpstreamMetadataKey), "");
+
+  // Later requests ask for the full metadata, which is then cached.
+  TestHeaderMapImpl fallback_request_headers;
+  TestHeaderMapImpl fallback_response_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataHeader), peerMetadataHeader()}};
+  run(fallback_request_headers, fallback_response_headers);
+  EXPECT_FALSE(
+      hasHeader(fallback_request_headers, ExchangeMetadataAcceptHeader));
+  EXPECT_NE(host_.filterState(::Wasm::Common::kUpstreamMetadataKey), "");
+
+  TestHeaderMapImpl id_request_headers;
+  TestHeaderMapImpl id_response_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)}};
+  run(id_request_headers, id_response_headers);
+  EXPECT_NE(host_.filterState(::Wasm::Common::kUpstreamMetadataKey), "");
+}
+
+// Responses from an upstream that resolves peer IDs, or from an older one.
+TestHeaderMapImpl idOnlyResponseHeaders() {
+  return TestHeaderMapImpl{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataHeader), peerMetadataHeader()},
+      {std::string(ExchangeMetadataAcceptHeader), std::string(ExchangeIdOnly)}};
+}
+
+TestHeaderMapImpl olderResponseHeaders() {
+  return TestHeaderMapImpl{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataHeader), peerMetadataHeader()}};
+}
+
+constexpr absl::string_view ratings_cluster =
+    "outbound|9080||ratings.default.svc.cluster.local";
+constexpr absl::string_view reviews_cluster =
+    "outbound|9080||reviews.default.svc.cluster.local";
+
+TEST_F(MetadataExchangeTest, IdOnlyRequestsNeedUpstreamSupport) {
+  configure(R"({"id_only_exchange": true})");
+  host_.set({"cluster_name"}, std::string(ratings_cluster));
+
+  // The upstream is not known to resolve IDs yet.
+  TestHeaderMapImpl request_headers;
+  TestHeaderMapImpl response_headers = idOnlyResponseHeaders();
+  run(request_headers, response_headers);
+  EXPECT_TRUE(hasHeader(request_headers, ExchangeMetadataHeader));
+  EXPECT_EQ(header(request_headers, ExchangeMetadataAcceptHeader),
+            ExchangeIdOnly);
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeMetadataAcceptHeader));
+
+  TestHeaderMapImpl id_request_headers;
+  TestHeaderMapImpl older_response_headers = olderResponseHeaders();
+  run(id_request_headers, older_response_headers);
+  EXPECT_EQ(header(id_request_headers, ExchangeMetadataHeaderId), local_id);
+  EXPECT_FALSE(hasHeader(id_request_headers, ExchangeMetadataHeader));
+
+  // An older upstream answered, which never reports unknown IDs.
+  TestHeaderMapImpl full_request_headers;
+  TestHeaderMapImpl full_response_headers = olderResponseHeaders();
+  run(full_request_headers, full_response_headers);
+  EXPECT_TRUE(hasHeader(full_request_headers, ExchangeMetadataHeader));
+}
+
+TEST_F(MetadataExchangeTest, IdOnlyFallbackPerUpstream) {
+  configure(R"({"id_only_exchange": true})");
+  for (const auto cluster : {ratings_cluster, reviews_cluster}) {
+    host_.set({"cluster_name"}, std::string(cluster));
+    TestHeaderMapImpl request_headers;
+    TestHeaderMapImpl response_headers = idOnlyResponseHeaders();
+    run(request_headers, response_headers);
+  }
+
+  // An upstream of one cluster did not know this proxy.
+  host_.set({"cluster_name"}, std::string(ratings_cluster));
+  TestHeaderMapImpl request_headers;
+  TestHeaderMapImpl response_headers = idOnlyResponseHeaders();
+  response_headers.addCopy(std::string(ExchangeMetadataMissHeader), "1");
+  run(request_headers, response_headers);
+  EXPECT_FALSE(hasHeader(request_headers, ExchangeMetadataHeader));
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeMetadataMissHeader));
+
+  TestHeaderMapImpl fallback_request_headers;
+  TestHeaderMapImpl fallback_response_headers = idOnlyResponseHeaders();
+  run(fallback_request_headers, fallback_response_headers);
+  EXPECT_TRUE(hasHeader(fallback_request_headers, ExchangeMetadataHeader));
+  EXPECT_FALSE(
+      hasHeader(fallback_request_headers, ExchangeMetadataAcceptHeader));
+
+  // The other cluster keeps receiving the ID only.
+  host_.set({"cluster_name"}, std::string(reviews_cluster));
+  TestHeaderMapImpl other_request_headers;
+  TestHeaderMapImpl other_response_headers = idOnlyResponseHeaders();
+  run(other_request_headers, other_response_headers);
+  EXPECT_FALSE(hasHeader(other_request_headers, ExchangeMetadataHeader));
+  EXPECT_EQ(header(other_request_headers, ExchangeMetadataAcceptHeader),
+            ExchangeIdOnly);
+}
+
+TEST_F(MetadataExchangeTest, IdOnlyResolvedFromPeerDirectory) {
+  setDirection(TrafficDirection::Inbound);
+  metadata_exchange::PluginConfig config;
+  config.set_id_only_exchange(true);
+  config.set_peer_directory(absl::StrCat(R"({"peers": {")", peer_id, R"(": )",
+                                         kPeerNodeJson, "}}"));
+  std::string configuration;
+  ASSERT_TRUE(
+      google::protobuf::util::MessageToJsonString(config, &configuration)
+          .ok());
+  configure(configuration);
+
+  TestHeaderMapImpl request_headers{
+      {std::string(ExchangeMetadataHeaderId), std::string(peer_id)},
+      {std::string(ExchangeMetadataAcceptHeader),
+       std::string(ExchangeIdOnly)}};
+  TestHeaderMapImpl response_headers;
+  run(request_headers, response_headers);
+  google::protobuf::Struct downstream;
+  ASSERT_TRUE(downstream.ParseFromString(
+      host_.filterState(::Wasm::Common::kDownstreamMetadataKey)));
+  EXPECT_EQ(downstream.fields().at("WORKLOAD_NAME").string_value(),
+            "ratings-v1");
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeMetadataMissHeader));
+  EXPECT_FALSE(hasHeader(response_headers, ExchangeMetadataHeader));
+  EXPECT_EQ(header(response_headers, ExchangeMetadataAcceptHeader),
+            ExchangeIdOnly);
+
+  // A peer that is not in the directory is asked for its metadata.
+  TestHeaderMapImpl unknown_request_headers{
+      {std::string(ExchangeMetadataHeaderId), "sidecar~10.44.2.16~details"},
+      {std::string(ExchangeMetadataAcceptHeader),
+       std::string(ExchangeIdOnly)}};
+  TestHeaderMapImpl unknown_response_headers;
+  run(unknown_request_headers, unknown_response_headers);
+  EXPECT_EQ(host_.filterState(::Wasm::Common::kDownstreamMetadataKey), "");
+  EXPECT_TRUE(hasHeader(unknown_response_headers, ExchangeMetadataMissHeader));
+}
+
+}  // namespace
+
+// WASM_EPILOG
+#ifdef NULL_PLUGIN
+}  // namespace Plugin
+}  // namespace MetadataExchange
+}  // namespace Wasm
+}  // namespace Extensions
+}  // namespace Envoy
+#endif
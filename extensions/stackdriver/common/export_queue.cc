@@ -0,0 +1,117 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/common/export_queue.h"
+
+#include <algorithm>
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Common {
+
+ExportQueue::ExportQueue(const ExportQueueOptions& options, NowFn now)
+    : options_(options), now_(std::move(now)) {}
+
+bool ExportQueue::enqueue(uint64_t bytes, SendFn send, DropFn dropped) {
+  // Make room by dropping the oldest queued requests. Requests in flight are
+  // kept, as their calls hold them anyway.
+  while (bytes_ + bytes > options_.max_bytes && !queue_.empty()) {
+    bytes_ -= queue_.front().bytes;
+    drop(queue_.front());
+    queue_.pop_front();
+  }
+  Request request{next_id_++, bytes, std::move(send), std::move(dropped), 0,
+                  0};
+  if (bytes_ + bytes > options_.max_bytes) {
+    drop(request);
+    return false;
+  }
+  bytes_ += bytes;
+  queue_.push_back(std::move(request));
+  this->send();
+  return true;
+}
+
+void ExportQueue::send() {
+  if (sending_) {
+    return;
+  }
+  sending_ = true;
+  const int64_t now = now_();
+  while (in_flight_.size() < options_.max_in_flight) {
+    auto iter = std::find_if(queue_.begin(), queue_.end(),
+                             [now](const Request& request) {
+                               return request.next_attempt_milliseconds <= now;
+                             });
+    if (iter == queue_.end()) {
+      break;
+    }
+    const uint64_t id = iter->id;
+    auto& request = in_flight_.emplace(id, std::move(*iter)).first->second;
+    queue_.erase(iter);
+    request.attempts++;
+    // The completion may run synchronously and release the request, so the
+    // send function is called on a copy.
+    SendFn send = request.send;
+    send([this, id](bool success) { onDone(id, success); });
+  }
+  sending_ = false;
+}
+
+void ExportQueue::onDone(uint64_t id, bool success) {
+  auto iter = in_flight_.find(id);
+  if (iter == in_flight_.end()) {
+    return;
+  }
+  Request request = std::move(iter->second);
+  in_flight_.erase(iter);
+
+  if (success) {
+    succeeded_++;
+    bytes_ -= request.bytes;
+  } else if (request.attempts >= options_.max_attempts) {
+    bytes_ -= request.bytes;
+    drop(request);
+  } else {
+    retried_++;
+    int64_t backoff = options_.initial_backoff_milliseconds;
+    for (uint32_t i = 1; i < request.attempts &&
+                         backoff < options_.max_backoff_milliseconds;
+         i++) {
+      backoff *= 2;
+    }
+    request.next_attempt_milliseconds =
+        now_() + std::max<int64_t>(
+                     1, std::min(backoff, options_.max_backoff_milliseconds));
+    // Retries go ahead of newer requests.
+    auto position = std::find_if(
+        queue_.begin(), queue_.end(),
+        [&request](const Request& queued) { return queued.id > request.id; });
+    queue_.insert(position, std::move(request));
+  }
+  send();
+}
+
+void ExportQueue::drop(const Request& request) {
+  dropped_++;
+  dropped_bytes_ += request.bytes;
+  if (request.dropped) {
+    request.dropped();
+  }
+}
+
+}  // namespace Common
+}  // namespace Stackdriver
+}  // namespace Extensions
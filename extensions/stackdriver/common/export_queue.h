@@ -0,0 +1,129 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Common {
+
+// Limits of an ExportQueue.
+struct ExportQueueOptions {
+  // Total size of the requests that are queued or in flight. Oldest queued
+  // requests are dropped to make room for new ones.
+  uint64_t max_bytes = 16 * 1024 * 1024;
+
+  // Number of requests in flight.
+  uint32_t max_in_flight = 4;
+
+  // Number of times a request is sent before it is dropped.
+  uint32_t max_attempts = 5;
+
+  // Backoff after the first failure, which doubles with every further failure
+  // up to max_backoff_milliseconds.
+  int64_t initial_backoff_milliseconds = 1000;
+  int64_t max_backoff_milliseconds = 60000;
+};
+
+// ExportQueue sends export requests to a backend, retries failed requests with
+// exponential backoff, and bounds both the memory held by requests and the
+// number of outstanding calls. Requests are sent in the order they were
+// enqueued, and requests in backoff do not hold back requests that are due.
+// Requests in backoff are only sent again by a later enqueue(), completion or
+// send(), so send() is expected to be called periodically, e.g. on tick.
+// ExportQueue is not thread safe. The completion callbacks given to send
+// functions refer to the queue, so the queue must outlive outstanding calls.
+class ExportQueue {
+ public:
+  // Called exactly once per send, with whether the call succeeded.
+  using DoneFn = std::function<void(bool success)>;
+  // Sends a request. The request is owned by the function, which is destroyed
+  // once the request succeeded or was dropped.
+  using SendFn = std::function<void(DoneFn done)>;
+  // Called when a request is dropped, before its send function is destroyed.
+  // It must not call into the queue.
+  using DropFn = std::function<void()>;
+  // Returns the current time in milliseconds.
+  using NowFn = std::function<int64_t()>;
+
+  ExportQueue(const ExportQueueOptions& options, NowFn now);
+
+  // Enqueues a request of the given size in bytes and sends due requests.
+  // Returns false if the request is dropped right away, because it does not
+  // fit within max_bytes next to the requests in flight. dropped is optional,
+  // and is called if the request is dropped, at once or later.
+  bool enqueue(uint64_t bytes, SendFn send, DropFn dropped = nullptr);
+
+  // Sends queued requests that are due, up to the in-flight limit.
+  void send();
+
+  // Returns whether a request of the given size fits without dropping others.
+  bool hasRoom(uint64_t bytes) const {
+    return bytes_ + bytes <= options_.max_bytes;
+  }
+
+  uint64_t bytes() const { return bytes_; }
+  size_t queued() const { return queue_.size(); }
+  size_t inFlight() const { return in_flight_.size(); }
+
+  // Cumulative counts of requests that succeeded, that failed and were
+  // scheduled for a retry, and that were dropped, either for lack of room or
+  // after max_attempts failures.
+  uint64_t succeeded() const { return succeeded_; }
+  uint64_t retried() const { return retried_; }
+  uint64_t dropped() const { return dropped_; }
+  uint64_t droppedBytes() const { return dropped_bytes_; }
+
+ private:
+  struct Request {
+    uint64_t id;
+    uint64_t bytes;
+    SendFn send;
+    DropFn dropped;
+    uint32_t attempts;
+    int64_t next_attempt_milliseconds;
+  };
+
+  void onDone(uint64_t id, bool success);
+  void drop(const Request& request);
+
+  const ExportQueueOptions options_;
+  NowFn now_;
+
+  // Requests waiting to be sent, oldest first.
+  std::deque<Request> queue_;
+  // Requests in flight by ID.
+  std::unordered_map<uint64_t, Request> in_flight_;
+
+  uint64_t next_id_ = 0;
+  uint64_t bytes_ = 0;
+  // Guards against sending from within a synchronous completion.
+  bool sending_ = false;
+
+  uint64_t succeeded_ = 0;
+  uint64_t retried_ = 0;
+  uint64_t dropped_ = 0;
+  uint64_t dropped_bytes_ = 0;
+};
+
+}  // namespace Common
+}  // namespace Stackdriver
+}  // namespace Extensions
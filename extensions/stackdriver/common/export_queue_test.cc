@@ -0,0 +1,204 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/common/export_queue.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Common {
+namespace {
+
+// Backend records the calls of requests, which are completed by the test.
+class Backend {
+ public:
+  ExportQueue::SendFn request(int id) {
+    return [this, id](ExportQueue::DoneFn done) {
+      calls_.push_back(id);
+      pending_.push_back(std::move(done));
+    };
+  }
+
+  // Completes the oldest outstanding call.
+  void complete(bool success) {
+    auto done = std::move(pending_.front());
+    pending_.erase(pending_.begin());
+    done(success);
+  }
+
+  const std::vector<int>& calls() const { return calls_; }
+  size_t outstanding() const { return pending_.size(); }
+
+ private:
+  std::vector<int> calls_;
+  std::vector<ExportQueue::DoneFn> pending_;
+};
+
+class ExportQueueTest : public ::testing::Test {
+ protected:
+  ExportQueueTest() {
+    options_.max_bytes = 100;
+    options_.max_in_flight = 2;
+    options_.max_attempts = 3;
+    options_.initial_backoff_milliseconds = 10;
+    options_.max_backoff_milliseconds = 15;
+  }
+
+  ExportQueue makeQueue() {
+    return ExportQueue(options_, [this] { return now_; });
+  }
+
+  ExportQueueOptions options_;
+  int64_t now_ = 0;
+  Backend backend_;
+};
+
+TEST_F(ExportQueueTest, InFlightLimit) {
+  auto queue = makeQueue();
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.enqueue(10, backend_.request(i)));
+  }
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0, 1}));
+  EXPECT_EQ(queue.inFlight(), 2u);
+  EXPECT_EQ(queue.queued(), 2u);
+  EXPECT_EQ(queue.bytes(), 40u);
+
+  // Completions start the next requests in order.
+  backend_.complete(true);
+  backend_.complete(true);
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0, 1, 2, 3}));
+  backend_.complete(true);
+  backend_.complete(true);
+  EXPECT_EQ(queue.succeeded(), 4u);
+  EXPECT_EQ(queue.bytes(), 0u);
+}
+
+TEST_F(ExportQueueTest, RetryWithBackoff) {
+  auto queue = makeQueue();
+  queue.enqueue(10, backend_.request(0));
+  backend_.complete(false);
+  EXPECT_EQ(queue.retried(), 1u);
+  EXPECT_EQ(queue.queued(), 1u);
+
+  // Not due before the backoff elapsed.
+  now_ = 9;
+  queue.send();
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0}));
+  now_ = 10;
+  queue.send();
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0, 0}));
+
+  // Backoff doubles, up to the maximum.
+  backend_.complete(false);
+  now_ = 24;
+  queue.send();
+  EXPECT_EQ(backend_.outstanding(), 0u);
+  now_ = 25;
+  queue.send();
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0, 0, 0}));
+
+  // Dropped after the last attempt.
+  backend_.complete(false);
+  EXPECT_EQ(queue.dropped(), 1u);
+  EXPECT_EQ(queue.droppedBytes(), 10u);
+  EXPECT_EQ(queue.queued(), 0u);
+  EXPECT_EQ(queue.bytes(), 0u);
+}
+
+// Requests in backoff do not hold back newer requests, and are sent ahead of
+// them once due.
+TEST_F(ExportQueueTest, RetryOrder) {
+  options_.max_in_flight = 1;
+  auto queue = makeQueue();
+  queue.enqueue(10, backend_.request(0));
+  queue.enqueue(10, backend_.request(1));
+  queue.enqueue(10, backend_.request(2));
+  backend_.complete(false);
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0, 1}));
+  now_ = 10;
+  backend_.complete(true);
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0, 1, 0}));
+  backend_.complete(true);
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0, 1, 0, 2}));
+}
+
+TEST_F(ExportQueueTest, DropOldestForRoom) {
+  options_.max_in_flight = 1;
+  auto queue = makeQueue();
+  EXPECT_TRUE(queue.enqueue(40, backend_.request(0)));
+  EXPECT_TRUE(queue.enqueue(30, backend_.request(1)));
+  EXPECT_TRUE(queue.enqueue(30, backend_.request(2)));
+  // Request 1 is dropped, request 0 is in flight.
+  EXPECT_TRUE(queue.enqueue(20, backend_.request(3)));
+  EXPECT_EQ(queue.dropped(), 1u);
+  EXPECT_EQ(queue.droppedBytes(), 30u);
+  EXPECT_EQ(queue.bytes(), 90u);
+  // Does not fit next to the request in flight.
+  EXPECT_FALSE(queue.enqueue(70, backend_.request(4)));
+  EXPECT_EQ(queue.dropped(), 4u);
+
+  backend_.complete(true);
+  EXPECT_EQ(backend_.calls(), std::vector<int>({0}));
+  EXPECT_EQ(queue.queued(), 0u);
+  EXPECT_EQ(queue.bytes(), 0u);
+}
+
+// Calls that fail synchronously are retried later rather than in a loop.
+TEST_F(ExportQueueTest, SynchronousFailure) {
+  auto queue = makeQueue();
+  int calls = 0;
+  queue.enqueue(10, [&calls](ExportQueue::DoneFn done) {
+    calls++;
+    done(false);
+  });
+  EXPECT_EQ(calls, 1);
+  EXPECT_EQ(queue.inFlight(), 0u);
+  EXPECT_EQ(queue.queued(), 1u);
+  now_ = 10;
+  queue.send();
+  EXPECT_EQ(calls, 2);
+}
+
+// Drop functions are called for requests dropped for room, right away, and
+// after the last attempt.
+TEST_F(ExportQueueTest, DropFunctions) {
+  options_.max_in_flight = 1;
+  options_.max_attempts = 1;
+  auto queue = makeQueue();
+  std::vector<int> dropped;
+  auto dropFn = [&dropped](int id) {
+    return [&dropped, id] { dropped.push_back(id); };
+  };
+  queue.enqueue(40, backend_.request(0), dropFn(0));
+  queue.enqueue(30, backend_.request(1), dropFn(1));
+  queue.enqueue(30, backend_.request(2), dropFn(2));
+  queue.enqueue(20, backend_.request(3), dropFn(3));
+  EXPECT_EQ(dropped, std::vector<int>({1}));
+  queue.enqueue(70, backend_.request(4), dropFn(4));
+  EXPECT_EQ(dropped, std::vector<int>({1, 2, 3, 4}));
+
+  backend_.complete(false);
+  EXPECT_EQ(dropped, std::vector<int>({1, 2, 3, 4, 0}));
+  EXPECT_EQ(queue.dropped(), 5u);
+  EXPECT_EQ(queue.bytes(), 0u);
+}
+
+}  // namespace
+}  // namespace Common
+}  // namespace Stackdriver
+}  // namespace Extensions
@@ -0,0 +1,223 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/common/spill_buffer.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Common {
+
+namespace {
+
+constexpr uint64_t kMagic = 0x4c4c495053545349;  // "ISTSPILL"
+constexpr uint32_t kVersion = 1;
+constexpr uint64_t kAlignment = 8;
+constexpr uint64_t kRecordHeaderSize = 8;
+// Length of the marker that fills the end of the ring when a record does not
+// fit before it.
+constexpr uint32_t kWrapMarker = 0xffffffff;
+
+uint64_t align(uint64_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+uint32_t crc32(absl::string_view data) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> table;
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 1) ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+      }
+      table[i] = crc;
+    }
+    return table;
+  }();
+  uint32_t crc = 0xffffffff;
+  for (unsigned char c : data) {
+    crc = table[(crc ^ c) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+}
+
+}  // namespace
+
+// Head and tail are offsets into an unbounded stream of records, which is
+// mapped onto the ring modulo the capacity.
+struct SpillBuffer::Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t capacity;
+  std::atomic<uint64_t> head;
+  std::atomic<uint64_t> tail;
+};
+
+std::unique_ptr<SpillBuffer> SpillBuffer::open(const std::string& path,
+                                               uint64_t capacity) {
+  capacity = align(capacity);
+  if (capacity < 2 * kRecordHeaderSize) {
+    return nullptr;
+  }
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat stat;
+  const uint64_t file_size = sizeof(Header) + capacity;
+  if (::flock(fd, LOCK_EX | LOCK_NB) != 0 || ::fstat(fd, &stat) != 0 ||
+      (static_cast<uint64_t>(stat.st_size) != file_size &&
+       ::ftruncate(fd, file_size) != 0)) {
+    ::close(fd);
+    return nullptr;
+  }
+  void* mapping =
+      ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  std::unique_ptr<SpillBuffer> buffer(
+      new SpillBuffer(fd, static_cast<char*>(mapping), capacity));
+  const Header& header = *buffer->header_;
+  const uint64_t head = header.head.load();
+  const uint64_t tail = header.tail.load();
+  if (header.magic != kMagic || header.version != kVersion ||
+      header.capacity != capacity || head > tail || tail - head > capacity ||
+      head % kAlignment != 0 || tail % kAlignment != 0) {
+    buffer->reset();
+  }
+  return buffer;
+}
+
+SpillBuffer::SpillBuffer(int fd, char* mapping, uint64_t capacity)
+    : fd_(fd),
+      mapping_(mapping),
+      capacity_(capacity),
+      header_(reinterpret_cast<Header*>(mapping)),
+      data_(mapping + sizeof(Header)) {}
+
+SpillBuffer::~SpillBuffer() {
+  ::munmap(mapping_, sizeof(Header) + capacity_);
+  ::close(fd_);
+}
+
+void SpillBuffer::reset() {
+  header_->magic = kMagic;
+  header_->version = kVersion;
+  header_->reserved = 0;
+  header_->capacity = capacity_;
+  header_->head.store(0);
+  header_->tail.store(0);
+}
+
+bool SpillBuffer::push(absl::string_view record) {
+  const uint64_t size = kRecordHeaderSize + align(record.size());
+  if (record.size() >= kWrapMarker || size > capacity_) {
+    return false;
+  }
+  const uint64_t head = header_->head.load();
+  uint64_t tail = header_->tail.load();
+  const uint64_t position = tail % capacity_;
+  // Records are contiguous, so the end of the ring is skipped if the record
+  // does not fit before it.
+  const uint64_t skip = capacity_ - position < size ? capacity_ - position : 0;
+  if (tail + skip + size - head > capacity_) {
+    return false;
+  }
+  if (skip > 0) {
+    std::memcpy(data_ + position, &kWrapMarker, sizeof(kWrapMarker));
+    tail += skip;
+  }
+
+  char* out = data_ + tail % capacity_;
+  const uint32_t length = record.size();
+  const uint32_t checksum = crc32(record);
+  std::memcpy(out, &length, sizeof(length));
+  std::memcpy(out + sizeof(length), &checksum, sizeof(checksum));
+  std::memcpy(out + kRecordHeaderSize, record.data(), record.size());
+  // Publish the record only after it is written.
+  header_->tail.store(tail + size, std::memory_order_release);
+  return true;
+}
+
+uint64_t SpillBuffer::frontOffset() const {
+  const uint64_t head = header_->head.load();
+  const uint64_t position = head % capacity_;
+  uint32_t length;
+  std::memcpy(&length, data_ + position, sizeof(length));
+  return length == kWrapMarker ? head + capacity_ - position : head;
+}
+
+bool SpillBuffer::front(std::string* record) {
+  if (empty()) {
+    return false;
+  }
+  const uint64_t offset = frontOffset();
+  const uint64_t tail = header_->tail.load(std::memory_order_acquire);
+  const char* in = data_ + offset % capacity_;
+  uint32_t length;
+  uint32_t checksum;
+  std::memcpy(&length, in, sizeof(length));
+  std::memcpy(&checksum, in + sizeof(length), sizeof(checksum));
+  if (offset >= tail || length >= kWrapMarker ||
+      kRecordHeaderSize + align(length) > tail - offset ||
+      offset % capacity_ + kRecordHeaderSize + align(length) > capacity_) {
+    corruptions_++;
+    header_->head.store(tail);
+    return false;
+  }
+  record->assign(in + kRecordHeaderSize, length);
+  if (crc32(*record) != checksum) {
+    corruptions_++;
+    header_->head.store(tail);
+    record->clear();
+    return false;
+  }
+  return true;
+}
+
+void SpillBuffer::pop() {
+  if (empty()) {
+    return;
+  }
+  const uint64_t offset = frontOffset();
+  uint32_t length;
+  std::memcpy(&length, data_ + offset % capacity_, sizeof(length));
+  header_->head.store(offset + kRecordHeaderSize + align(length));
+}
+
+bool SpillBuffer::empty() const {
+  return header_->head.load() == header_->tail.load();
+}
+
+uint64_t SpillBuffer::size() const {
+  return header_->tail.load() - header_->head.load();
+}
+
+}  // namespace Common
+}  // namespace Stackdriver
+}  // namespace Extensions
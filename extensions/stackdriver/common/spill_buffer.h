@@ -0,0 +1,93 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Common {
+
+// SpillBuffer is a fixed-size FIFO of records in a memory-mapped file, which
+// keeps export requests on local disk while they cannot be held in memory.
+// The file survives restarts of the proxy, and records are read back in the
+// order they were pushed.
+//
+// The file starts with a header that holds the capacity and the head and tail
+// offsets of the ring of records. Every record is a length and a CRC32 of the
+// payload, followed by the payload padded to 8 bytes. A record is written
+// before the tail is advanced past it, so a crash leaves either the whole
+// record or none of it. Records that fail the checksum on read, e.g. after a
+// torn write by the OS, invalidate the rest of the buffer, which is then
+// dropped.
+// SpillBuffer is not thread safe. The file is locked, so that one buffer per
+// file is open at a time.
+class SpillBuffer {
+ public:
+  // Opens the buffer at path, or creates it if it does not exist or does not
+  // match the capacity. Returns nullptr if the file cannot be opened or
+  // mapped, or is locked by another buffer.
+  static std::unique_ptr<SpillBuffer> open(const std::string& path,
+                                           uint64_t capacity);
+
+  ~SpillBuffer();
+
+  // Appends a record. Returns false if the record does not fit.
+  bool push(absl::string_view record);
+
+  // Reads the oldest record. Returns false if the buffer is empty, or if the
+  // record is corrupt, in which case the buffer is dropped.
+  bool front(std::string* record);
+
+  // Removes the oldest record, which must have been read by front().
+  void pop();
+
+  bool empty() const;
+
+  // Bytes in use, including record headers and padding.
+  uint64_t size() const;
+
+  uint64_t capacity() const { return capacity_; }
+
+  // Number of times corrupt records were found.
+  uint64_t corruptions() const { return corruptions_; }
+
+ private:
+  struct Header;
+
+  SpillBuffer(int fd, char* mapping, uint64_t capacity);
+
+  // Resets the buffer to empty.
+  void reset();
+
+  // Returns the offset of the oldest record, skipping a wrap marker.
+  uint64_t frontOffset() const;
+
+  const int fd_;
+  char* const mapping_;
+  const uint64_t capacity_;
+  Header* const header_;
+  char* const data_;
+  uint64_t corruptions_ = 0;
+};
+
+}  // namespace Common
+}  // namespace Stackdriver
+}  // namespace Extensions
@@ -0,0 +1,217 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/common/spill_buffer.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+
+#include "gtest/gtest.h"
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Common {
+namespace {
+
+class SpillBufferTest : public ::testing::Test {
+ protected:
+  SpillBufferTest() {
+    const char* tmpdir = std::getenv("TEST_TMPDIR");
+    path_ = std::string(tmpdir ? tmpdir : "/tmp") + "/spill_buffer_test." +
+            std::to_string(::getpid()) + "." +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    ::unlink(path_.c_str());
+  }
+
+  ~SpillBufferTest() { ::unlink(path_.c_str()); }
+
+  // Overwrites a byte of the file at the given offset from the start of the
+  // records.
+  void corrupt(uint64_t offset) {
+    std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(kHeaderSize + offset);
+    char c;
+    file.get(c);
+    file.seekp(kHeaderSize + offset);
+    file.put(c ^ 0x5a);
+  }
+
+  // Size of the file header.
+  static constexpr uint64_t kHeaderSize = 40;
+  std::string path_;
+};
+
+TEST_F(SpillBufferTest, PushAndPop) {
+  auto buffer = SpillBuffer::open(path_, 1024);
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_TRUE(buffer->empty());
+  std::string record;
+  EXPECT_FALSE(buffer->front(&record));
+
+  EXPECT_TRUE(buffer->push("first"));
+  EXPECT_TRUE(buffer->push(""));
+  EXPECT_TRUE(buffer->push("third record"));
+  // Record headers are 8 bytes and payloads are padded to 8 bytes.
+  EXPECT_EQ(buffer->size(), 16u + 8u + 24u);
+
+  ASSERT_TRUE(buffer->front(&record));
+  EXPECT_EQ(record, "first");
+  buffer->pop();
+  ASSERT_TRUE(buffer->front(&record));
+  EXPECT_EQ(record, "");
+  buffer->pop();
+  ASSERT_TRUE(buffer->front(&record));
+  EXPECT_EQ(record, "third record");
+  buffer->pop();
+  EXPECT_TRUE(buffer->empty());
+  EXPECT_EQ(buffer->corruptions(), 0u);
+}
+
+TEST_F(SpillBufferTest, FullAndWrap) {
+  auto buffer = SpillBuffer::open(path_, 64);
+  ASSERT_NE(buffer, nullptr);
+  const std::string record(16, 'a');
+  // 24 bytes per record.
+  EXPECT_TRUE(buffer->push(record));
+  EXPECT_TRUE(buffer->push(record));
+  EXPECT_FALSE(buffer->push(record));
+  EXPECT_FALSE(buffer->push(std::string(64, 'b')));
+
+  std::string read;
+  ASSERT_TRUE(buffer->front(&read));
+  buffer->pop();
+  // Does not fit before the end of the ring, which is skipped.
+  EXPECT_TRUE(buffer->push(std::string(16, 'c')));
+  EXPECT_FALSE(buffer->push("d"));
+  ASSERT_TRUE(buffer->front(&read));
+  EXPECT_EQ(read, record);
+  buffer->pop();
+  ASSERT_TRUE(buffer->front(&read));
+  EXPECT_EQ(read, std::string(16, 'c'));
+  buffer->pop();
+  EXPECT_TRUE(buffer->empty());
+
+  // Many rounds over the ring.
+  for (int i = 0; i < 100; i++) {
+    const std::string value = std::to_string(i) + std::string(i % 20, 'x');
+    ASSERT_TRUE(buffer->push(value));
+    ASSERT_TRUE(buffer->front(&read));
+    EXPECT_EQ(read, value);
+    buffer->pop();
+  }
+}
+
+// Records survive reopening, e.g. after a restart of the proxy.
+TEST_F(SpillBufferTest, Reopen) {
+  {
+    auto buffer = SpillBuffer::open(path_, 1024);
+    ASSERT_NE(buffer, nullptr);
+    buffer->push("first");
+    buffer->push("second");
+    std::string read;
+    buffer->front(&read);
+    buffer->pop();
+  }
+  auto buffer = SpillBuffer::open(path_, 1024);
+  ASSERT_NE(buffer, nullptr);
+  std::string read;
+  ASSERT_TRUE(buffer->front(&read));
+  EXPECT_EQ(read, "second");
+
+  // A different capacity starts over.
+  buffer.reset();
+  buffer = SpillBuffer::open(path_, 2048);
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_TRUE(buffer->empty());
+}
+
+TEST_F(SpillBufferTest, Locked) {
+  auto buffer = SpillBuffer::open(path_, 1024);
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_EQ(SpillBuffer::open(path_, 1024), nullptr);
+  buffer.reset();
+  EXPECT_NE(SpillBuffer::open(path_, 1024), nullptr);
+}
+
+// A corrupt record drops the buffer rather than returning bad data.
+TEST_F(SpillBufferTest, CorruptRecord) {
+  {
+    auto buffer = SpillBuffer::open(path_, 1024);
+    ASSERT_NE(buffer, nullptr);
+    buffer->push("first");
+    buffer->push("second");
+  }
+  // Payload of the second record.
+  corrupt(16 + 8 + 2);
+  auto buffer = SpillBuffer::open(path_, 1024);
+  ASSERT_NE(buffer, nullptr);
+  std::string read;
+  ASSERT_TRUE(buffer->front(&read));
+  EXPECT_EQ(read, "first");
+  buffer->pop();
+  EXPECT_FALSE(buffer->front(&read));
+  EXPECT_EQ(buffer->corruptions(), 1u);
+  EXPECT_TRUE(buffer->empty());
+  EXPECT_TRUE(buffer->push("third"));
+  ASSERT_TRUE(buffer->front(&read));
+  EXPECT_EQ(read, "third");
+}
+
+// A record that is written but not published, as after a crash in push(), is
+// not visible, and is overwritten by the next push.
+TEST_F(SpillBufferTest, UnpublishedRecord) {
+  {
+    auto buffer = SpillBuffer::open(path_, 1024);
+    ASSERT_NE(buffer, nullptr);
+    buffer->push("first");
+  }
+  {
+    // Writes the bytes of a second record past the tail.
+    std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(kHeaderSize + 16);
+    file.write("\x06\0\0\0garbagegarbage", 18);
+  }
+  auto buffer = SpillBuffer::open(path_, 1024);
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_EQ(buffer->size(), 16u);
+  std::string read;
+  ASSERT_TRUE(buffer->front(&read));
+  EXPECT_EQ(read, "first");
+  buffer->pop();
+  EXPECT_TRUE(buffer->empty());
+  EXPECT_TRUE(buffer->push("second"));
+  ASSERT_TRUE(buffer->front(&read));
+  EXPECT_EQ(read, "second");
+}
+
+TEST_F(SpillBufferTest, CorruptHeader) {
+  {
+    auto buffer = SpillBuffer::open(path_, 1024);
+    ASSERT_NE(buffer, nullptr);
+    buffer->push("first");
+  }
+  // Magic.
+  corrupt(-static_cast<int64_t>(kHeaderSize));
+  auto buffer = SpillBuffer::open(path_, 1024);
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_TRUE(buffer->empty());
+}
+
+}  // namespace
+}  // namespace Common
+}  // namespace Stackdriver
+}  // namespace Extensions
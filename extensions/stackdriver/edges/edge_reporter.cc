@@ -15,6 +15,8 @@
 
 #include "extensions/stackdriver/edges/edge_reporter.h"
 
+#include <unordered_map>
+
 #include "extensions/stackdriver/common/constants.h"
 #include "extensions/stackdriver/edges/edges.pb.h"
 
@@ -77,16 +79,9 @@ void instanceFromMetadata(const ::wasm::common::NodeInfo& node_info,
 
 }  // namespace
 
-EdgeReporter::EdgeReporter(const ::wasm::common::NodeInfo& local_node_info,
-                           std::unique_ptr<MeshEdgesServiceClient> edges_client)
-    : EdgeReporter(local_node_info, std::move(edges_client), []() {
-        return TimeUtil::NanosecondsToTimestamp(getCurrentTimeNanoseconds());
-      }) {}
-
-EdgeReporter::EdgeReporter(const ::wasm::common::NodeInfo& local_node_info,
-                           std::unique_ptr<MeshEdgesServiceClient> edges_client,
-                           TimestampFn now)
-    : edges_client_(std::move(edges_client)), now_(now) {
+EdgeSet::EdgeSet(const ::wasm::common::NodeInfo& local_node_info,
+                 TimestampFn now)
+    : now_(now) {
   current_request_ = std::make_unique<ReportTrafficAssertionsRequest>();
 
   const auto iter =
@@ -100,28 +95,57 @@ EdgeReporter::EdgeReporter(const ::wasm::common::NodeInfo& local_node_info,
     mesh_id = "unknown";
   }
   current_request_->set_mesh_uid(mesh_id);
+  epoch_request_ =
+      std::make_unique<ReportTrafficAssertionsRequest>(*current_request_);
 
   instanceFromMetadata(local_node_info, &node_instance_);
 };
 
-EdgeReporter::~EdgeReporter() {
-  // if (current_request_->traffic_assertions_size() == 0 ||
-  // !queued_requests_.empty()) {
-  //   logWarn("EdgeReporter had uncommitted TrafficAssertions when shutdown.");
-  // }
+std::shared_ptr<EdgeSet> EdgeSet::shared(
+    const std::string& endpoint,
+    const ::wasm::common::NodeInfo& local_node_info) {
+  static std::mutex* shared_mutex = new std::mutex();
+  static auto* shared_sets =
+      new std::unordered_map<std::string, std::weak_ptr<EdgeSet>>();
+
+  // sets are keyed by where and for whom their edges are reported.
+  std::string key = endpoint;
+  const auto iter =
+      local_node_info.platform_metadata().find(Common::kGCPProjectKey);
+  if (iter != local_node_info.platform_metadata().end()) {
+    key += "/projects/" + iter->second;
+  }
+  key += "/meshes/" + local_node_info.mesh_id();
+
+  std::lock_guard<std::mutex> lock(*shared_mutex);
+  auto& shared_set = (*shared_sets)[key];
+  auto edge_set = shared_set.lock();
+  if (!edge_set) {
+    edge_set = std::make_shared<EdgeSet>(local_node_info, []() {
+      return TimeUtil::NanosecondsToTimestamp(getCurrentTimeNanoseconds());
+    });
+    shared_set = edge_set;
+  }
+  return edge_set;
 }
 
 // ONLY inbound
-void EdgeReporter::addEdge(const ::Wasm::Common::RequestInfo& request_info,
-                           const std::string& peer_metadata_id_key,
-                           const ::wasm::common::NodeInfo& peer_node_info) {
-  const auto& peer = current_peers_.emplace(peer_metadata_id_key);
-  if (!peer.second) {
+void EdgeSet::addEdge(const ::Wasm::Common::RequestInfo& request_info,
+                      const std::string& peer_metadata_id_key,
+                      const ::wasm::common::NodeInfo& peer_node_info) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (epoch_peers_.find(peer_metadata_id_key) != epoch_peers_.end()) {
     // peer edge already exists
     return;
   }
+  epoch_peers_.insert(peer_metadata_id_key);
 
-  auto* traffic_assertions = current_request_->mutable_traffic_assertions();
+  // edges of peers that the backend knows from the previous epoch wait for
+  // the end of the epoch, new edges are sent with the next report.
+  const bool known_peer = previous_epoch_peers_.find(peer_metadata_id_key) !=
+                          previous_epoch_peers_.end();
+  auto& request = known_peer ? epoch_request_ : current_request_;
+  auto* traffic_assertions = request->mutable_traffic_assertions();
   auto* edge = traffic_assertions->Add();
 
   edge->set_destination_service_name(request_info.destination_service_name);
@@ -140,36 +164,121 @@ void EdgeReporter::addEdge(const ::Wasm::Common::RequestInfo& request_info,
     edge->set_protocol(TrafficAssertion_Protocol_PROTOCOL_TCP);
   }
 
-  if (current_request_->traffic_assertions_size() >
-      max_assertions_per_request_) {
-    reportEdges();
+  if (known_peer) {
+    if (epoch_request_->traffic_assertions_size() >=
+        max_assertions_per_request_) {
+      flush(epoch_request_, queued_epoch_requests_);
+    }
+  } else if (current_request_->traffic_assertions_size() >=
+             max_assertions_per_request_) {
+    flush(current_request_, queued_requests_);
   }
-};  // namespace Edges
+}
 
-void EdgeReporter::reportEdges() {
-  flush();
+void EdgeSet::takeRequests(
+    bool full_epoch,
+    std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>>* requests) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  flush(current_request_, queued_requests_);
+  if (full_epoch) {
+    flush(epoch_request_, queued_epoch_requests_);
+    for (auto& req : queued_epoch_requests_) {
+      queued_requests_.emplace_back(std::move(req));
+    }
+    queued_epoch_requests_.clear();
+    previous_epoch_peers_.swap(epoch_peers_);
+    epoch_peers_.clear();
+    epoch_.fetch_add(1, std::memory_order_release);
+  }
   for (auto& req : queued_requests_) {
-    edges_client_->reportTrafficAssertions(*req.get());
+    requests->emplace_back(std::move(req));
   }
   queued_requests_.clear();
-};
+}
 
-void EdgeReporter::flush() {
-  if (current_request_->traffic_assertions_size() == 0) {
+bool EdgeSet::claimExporter(const void* reporter) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (exporter_ == nullptr) {
+    exporter_ = reporter;
+  }
+  return exporter_ == reporter;
+}
+
+void EdgeSet::releaseExporter(const void* reporter) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (exporter_ == reporter) {
+    exporter_ = nullptr;
+  }
+}
+
+void EdgeSet::flush(
+    std::unique_ptr<ReportTrafficAssertionsRequest>& request,
+    std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>>& queue) {
+  if (request->traffic_assertions_size() == 0) {
     return;
   }
 
   std::unique_ptr<ReportTrafficAssertionsRequest> queued_request =
       std::make_unique<ReportTrafficAssertionsRequest>();
-  queued_request->set_parent(current_request_->parent());
-  queued_request->set_mesh_uid(current_request_->mesh_uid());
+  queued_request->set_parent(request->parent());
+  queued_request->set_mesh_uid(request->mesh_uid());
 
-  current_peers_.clear();
-  current_request_.swap(queued_request);
+  request.swap(queued_request);
 
   // set the timestamp and then send the queued request
   *queued_request->mutable_timestamp() = now_();
-  queued_requests_.emplace_back(std::move(queued_request));
+  queue.emplace_back(std::move(queued_request));
+}
+
+EdgeReporter::EdgeReporter(const ::wasm::common::NodeInfo& local_node_info,
+                           std::unique_ptr<MeshEdgesServiceClient> edges_client)
+    : EdgeReporter(local_node_info, std::move(edges_client), []() {
+        return TimeUtil::NanosecondsToTimestamp(getCurrentTimeNanoseconds());
+      }) {}
+
+EdgeReporter::EdgeReporter(const ::wasm::common::NodeInfo& local_node_info,
+                           std::unique_ptr<MeshEdgesServiceClient> edges_client,
+                           TimestampFn now)
+    : EdgeReporter(std::move(edges_client),
+                   std::make_shared<EdgeSet>(local_node_info, now)) {}
+
+EdgeReporter::EdgeReporter(std::unique_ptr<MeshEdgesServiceClient> edges_client,
+                           std::shared_ptr<EdgeSet> edge_set)
+    : edges_client_(std::move(edges_client)),
+      edge_set_(std::move(edge_set)),
+      local_epoch_(edge_set_->epoch()) {}
+
+EdgeReporter::~EdgeReporter() {
+  // another reporter of the set takes over with its next report.
+  edge_set_->releaseExporter(this);
+}
+
+// ONLY inbound
+void EdgeReporter::addEdge(const ::Wasm::Common::RequestInfo& request_info,
+                           const std::string& peer_metadata_id_key,
+                           const ::wasm::common::NodeInfo& peer_node_info) {
+  const uint64_t epoch = edge_set_->epoch();
+  if (epoch != local_epoch_) {
+    local_peers_.clear();
+    local_epoch_ = epoch;
+  }
+  if (local_peers_.find(peer_metadata_id_key) != local_peers_.end()) {
+    // peer edge already published by this reporter
+    return;
+  }
+  local_peers_.insert(peer_metadata_id_key);
+  edge_set_->addEdge(request_info, peer_metadata_id_key, peer_node_info);
+}
+
+void EdgeReporter::reportEdges(bool full_epoch) {
+  if (!edge_set_->claimExporter(this)) {
+    return;
+  }
+  std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>> requests;
+  edge_set_->takeRequests(full_epoch, &requests);
+  for (auto& req : requests) {
+    edges_client_->reportTrafficAssertions(*req.get());
+  }
 }
 
 }  // namespace Edges
@@ -15,7 +15,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "extensions/common/context.h"
@@ -37,15 +41,97 @@ using google::cloud::meshtelemetry::v1alpha1::ReportTrafficAssertionsRequest;
 using google::cloud::meshtelemetry::v1alpha1::WorkloadInstance;
 using google::protobuf::util::TimeUtil;
 
+typedef std::function<google::protobuf::Timestamp()> TimestampFn;
+
+// EdgeSet holds the traffic "edges" of the current and the previous epoch of a
+// proxy, and the requests that report them. Edge reporters of all workers may
+// publish into one set, so that every edge is built and reported once per
+// proxy instead of once per worker. EdgeSet is thread safe.
+class EdgeSet {
+ public:
+  EdgeSet(const ::wasm::common::NodeInfo &local_node_info, TimestampFn now);
+
+  // Returns the set shared by the workers of the proxy that report edges to
+  // the same endpoint, project and mesh. The set is released with the last
+  // reporter that uses it.
+  static std::shared_ptr<EdgeSet> shared(
+      const std::string &endpoint,
+      const ::wasm::common::NodeInfo &local_node_info);
+
+  // Increases at the end of every epoch.
+  uint64_t epoch() const { return epoch_.load(std::memory_order_acquire); }
+
+  // Adds an edge for the peer if there is none in the current epoch.
+  void addEdge(const ::Wasm::Common::RequestInfo &request_info,
+               const std::string &peer_metadata_id_key,
+               const ::wasm::common::NodeInfo &peer_node_info);
+
+  // Moves the requests that are ready to be sent to requests. Edges of peers
+  // that were not seen in the previous epoch are always ready. If full_epoch
+  // is set, the current epoch ends and all of its edges are ready.
+  void takeRequests(
+      bool full_epoch,
+      std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>> *requests);
+
+  // Makes the reporter the exporter of the set, if there is none. Returns
+  // whether the reporter is the exporter.
+  bool claimExporter(const void *reporter);
+
+  // Gives up the exporter role of the reporter, if it has it.
+  void releaseExporter(const void *reporter);
+
+ private:
+  // builds a full request out of the traffic assertions (edges) of request,
+  // adds that request to the queue, and resets request.
+  void flush(std::unique_ptr<ReportTrafficAssertionsRequest> &request,
+             std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>>
+                 &queue);
+
+  // gets the current time
+  TimestampFn now_;
+
+  // represents the workload instance for the current proxy
+  WorkloadInstance node_instance_;
+
+  std::atomic<uint64_t> epoch_{0};
+
+  std::mutex mutex_;
+
+  // the active pending request to which new edges are being added
+  std::unique_ptr<ReportTrafficAssertionsRequest> current_request_;
+
+  // the active pending request to which edges of peers that were seen in the
+  // previous epoch are being added. It is sent at the end of the epoch.
+  std::unique_ptr<ReportTrafficAssertionsRequest> epoch_request_;
+
+  // peers for which edges have been created in the current epoch.
+  std::unordered_set<std::string> epoch_peers_;
+
+  // peers for which edges have been reported in the previous epoch.
+  std::unordered_set<std::string> previous_epoch_peers_;
+
+  // requests waiting to be sent to backend
+  std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>> queued_requests_;
+
+  // requests of epoch_request_ waiting for the end of the epoch
+  std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>>
+      queued_epoch_requests_;
+
+  // the reporter that sends the requests.
+  const void *exporter_ = nullptr;
+
+  // TODO(douglas-reid): make adjustable.
+  const int max_assertions_per_request_ = 1000;
+};
+
 // EdgeReporter provides a mechanism for generating information on traffic
 // "edges" for a mesh. It should be used **only** to document incoming edges for
 // a proxy. This means that the proxy in which this reporter is running should
 // be the destination workload instance for all reported traffic.
-// This should only be used in a single-threaded context. No support for
-// threading is currently provided.
+// Edges are collected in an EdgeSet, which may be shared by the reporters of
+// all workers. One of the reporters of a set sends its edges. A reporter
+// should only be used in a single-threaded context.
 class EdgeReporter {
-  typedef std::function<google::protobuf::Timestamp()> TimestampFn;
-
  public:
   EdgeReporter(const ::wasm::common::NodeInfo &local_node_info,
                std::unique_ptr<MeshEdgesServiceClient> edges_client);
@@ -54,7 +140,10 @@ class EdgeReporter {
                std::unique_ptr<MeshEdgesServiceClient> edges_client,
                TimestampFn now);
 
-  ~EdgeReporter();  // this will call `reportEdges`
+  EdgeReporter(std::unique_ptr<MeshEdgesServiceClient> edges_client,
+               std::shared_ptr<EdgeSet> edge_set);
+
+  ~EdgeReporter();  // this will release the exporter role
 
   // addEdge creates a traffic assertion (aka an edge) based on the
   // the supplied request / peer info. The new edge is added to the
@@ -64,34 +153,24 @@ class EdgeReporter {
                const ::wasm::common::NodeInfo &peer_node_info);
 
   // reportEdges sends the buffered requests to the configured edges
-  // service via the supplied client.
-  void reportEdges();
+  // service via the supplied client, if this reporter is the exporter of its
+  // edge set. Edges of peers that were not seen in the previous epoch are sent
+  // on every call. If full_epoch is set, the current epoch ends: the edges of
+  // the remaining peers seen in it are sent as well, so that every edge of the
+  // epoch is reported once, and a new epoch starts.
+  void reportEdges(bool full_epoch = true);
 
  private:
-  // builds a full request out of the current traffic assertions (edges),
-  // adds that request to the queue, and resets the current request and state.
-  void flush();
-
   // client used to send requests to the edges service
   std::unique_ptr<MeshEdgesServiceClient> edges_client_;
 
-  // gets the current time
-  TimestampFn now_;
-
-  // the active pending request to which edges are being added
-  std::unique_ptr<ReportTrafficAssertionsRequest> current_request_;
-
-  // represents the workload instance for the current proxy
-  WorkloadInstance node_instance_;
+  // the set that edges are published into
+  std::shared_ptr<EdgeSet> edge_set_;
 
-  // current peers for which edges have been created in current_request_;
-  std::unordered_set<std::string> current_peers_;
-
-  // requests waiting to be sent to backend
-  std::vector<std::unique_ptr<ReportTrafficAssertionsRequest>> queued_requests_;
-
-  // TODO(douglas-reid): make adjustable.
-  const int max_assertions_per_request_ = 1000;
+  // peers that this reporter has published in local_epoch_, which are
+  // skipped without taking the lock of the edge set.
+  std::unordered_set<std::string> local_peers_;
+  uint64_t local_epoch_ = 0;
 };
 
 }  // namespace Edges
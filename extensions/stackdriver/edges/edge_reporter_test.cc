@@ -15,6 +15,7 @@
 
 #include "extensions/stackdriver/edges/edge_reporter.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "extensions/stackdriver/common/constants.h"
@@ -269,11 +270,15 @@ TEST(EdgeReporterTest, TestPeriodicFlushAndCacheReset) {
 TEST(EdgeReporterTest, TestCacheMisses) {
   int calls = 0;
   int num_assertions = 0;
+  int max_assertions = 0;
 
   auto test_client = std::make_unique<TestMeshEdgesServiceClient>(
-      [&calls, &num_assertions](const ReportTrafficAssertionsRequest& request) {
+      [&calls, &num_assertions,
+       &max_assertions](const ReportTrafficAssertionsRequest& request) {
         calls++;
         num_assertions += request.traffic_assertions_size();
+        max_assertions =
+            std::max(max_assertions, request.traffic_assertions_size());
       });
 
   auto edges = std::make_unique<EdgeReporter>(
@@ -287,6 +292,7 @@ TEST(EdgeReporterTest, TestCacheMisses) {
 
   EXPECT_EQ(4, calls);
   EXPECT_EQ(3500, num_assertions);
+  EXPECT_EQ(1000, max_assertions);
 }
 
 TEST(EdgeReporterTest, TestMissingPeerMetadata) {
@@ -305,6 +311,122 @@ TEST(EdgeReporterTest, TestMissingPeerMetadata) {
                      "ERROR: addEdge() produced unexpected result.");
 }
 
+// Between the ends of epochs only new edges are reported, and at the end of
+// an epoch the other edges of the epoch are reported.
+TEST(EdgeReporterTest, TestIncrementalReports) {
+  int calls = 0;
+  int num_assertions = 0;
+
+  auto test_client = std::make_unique<TestMeshEdgesServiceClient>(
+      [&calls, &num_assertions](const ReportTrafficAssertionsRequest& request) {
+        calls++;
+        num_assertions += request.traffic_assertions_size();
+      });
+
+  auto edges = std::make_unique<EdgeReporter>(
+      nodeInfo(), std::move(test_client), TimeUtil::GetCurrentTime);
+
+  edges->addEdge(requestInfo(), "a", peerNodeInfo());
+  edges->addEdge(requestInfo(), "b", peerNodeInfo());
+  edges->reportEdges(false);
+  EXPECT_EQ(1, calls);
+  EXPECT_EQ(2, num_assertions);
+
+  // no new edges.
+  edges->addEdge(requestInfo(), "a", peerNodeInfo());
+  edges->reportEdges(false);
+  EXPECT_EQ(1, calls);
+  edges->reportEdges(true);
+  EXPECT_EQ(1, calls);
+
+  // "a" and "b" are known from the previous epoch, so only "c" is new.
+  edges->addEdge(requestInfo(), "a", peerNodeInfo());
+  edges->addEdge(requestInfo(), "b", peerNodeInfo());
+  edges->addEdge(requestInfo(), "c", peerNodeInfo());
+  edges->reportEdges(false);
+  EXPECT_EQ(2, calls);
+  EXPECT_EQ(3, num_assertions);
+
+  // the end of the epoch reports "a" and "b".
+  edges->reportEdges(true);
+  EXPECT_EQ(3, calls);
+  EXPECT_EQ(5, num_assertions);
+
+  // only "a" is seen in this epoch.
+  edges->addEdge(requestInfo(), "a", peerNodeInfo());
+  edges->reportEdges(true);
+  EXPECT_EQ(4, calls);
+  EXPECT_EQ(6, num_assertions);
+
+  // "c" was not seen in the last epoch, so it is new again.
+  edges->addEdge(requestInfo(), "a", peerNodeInfo());
+  edges->addEdge(requestInfo(), "c", peerNodeInfo());
+  edges->reportEdges(false);
+  EXPECT_EQ(5, calls);
+  EXPECT_EQ(7, num_assertions);
+  edges->reportEdges(true);
+  EXPECT_EQ(6, calls);
+  EXPECT_EQ(8, num_assertions);
+}
+
+// Reporters that share an edge set report every edge once, through one of
+// the reporters.
+TEST(EdgeReporterTest, TestSharedEdgeSet) {
+  int calls[2] = {0, 0};
+  int num_assertions = 0;
+
+  auto edge_set =
+      std::make_shared<EdgeSet>(nodeInfo(), TimeUtil::GetCurrentTime);
+  std::vector<std::unique_ptr<EdgeReporter>> reporters;
+  for (int i = 0; i < 2; i++) {
+    auto test_client = std::make_unique<TestMeshEdgesServiceClient>(
+        [&calls, &num_assertions,
+         i](const ReportTrafficAssertionsRequest& request) {
+          calls[i]++;
+          num_assertions += request.traffic_assertions_size();
+        });
+    reporters.emplace_back(
+        std::make_unique<EdgeReporter>(std::move(test_client), edge_set));
+  }
+
+  for (auto& reporter : reporters) {
+    reporter->addEdge(requestInfo(), "a", peerNodeInfo());
+    reporter->addEdge(requestInfo(), "b", peerNodeInfo());
+  }
+  reporters[0]->reportEdges();
+  reporters[1]->reportEdges();
+  EXPECT_EQ(1, calls[0]);
+  EXPECT_EQ(0, calls[1]);
+  EXPECT_EQ(2, num_assertions);
+
+  // the other reporter takes over once the exporter is gone.
+  reporters[0].reset();
+  reporters[1]->addEdge(requestInfo(), "a", peerNodeInfo());
+  reporters[1]->reportEdges();
+  EXPECT_EQ(1, calls[1]);
+  EXPECT_EQ(3, num_assertions);
+}
+
+// Workers share the edge set of a reporting config, other configs get their
+// own set.
+TEST(EdgeReporterTest, TestSharedEdgeSetPerConfig) {
+  auto edge_set = EdgeSet::shared("meshtelemetry.googleapis.com", nodeInfo());
+  EXPECT_EQ(edge_set,
+            EdgeSet::shared("meshtelemetry.googleapis.com", nodeInfo()));
+  EXPECT_NE(edge_set, EdgeSet::shared("localhost:1", nodeInfo()));
+
+  auto other_project = nodeInfo();
+  (*other_project.mutable_platform_metadata())[Common::kGCPProjectKey] =
+      "other_project";
+  EXPECT_NE(edge_set,
+            EdgeSet::shared("meshtelemetry.googleapis.com", other_project));
+
+  auto other_mesh = nodeInfo();
+  other_mesh.set_mesh_id("other_mesh");
+  EXPECT_NE(edge_set,
+            EdgeSet::shared("meshtelemetry.googleapis.com", other_mesh));
+}
+
 }  // namespace Edges
 }  // namespace Stackdriver
 }  // namespace Extensions
@@ -49,21 +49,9 @@ using google::cloud::meshtelemetry::v1alpha1::ReportTrafficAssertionsRequest;
 using google::protobuf::util::TimeUtil;
 
 MeshEdgesServiceClientImpl::MeshEdgesServiceClientImpl(
-    RootContext* root_context, std::string edges_endpoint)
-    : context_(root_context) {
-  success_callback_ = [](google::protobuf::Empty&&) {
-    // TODO(douglas-reid): improve logging message.
-    logDebug(
-        "successfully sent MeshEdgesService ReportTrafficAssertionsRequest");
-  };
-
-  failure_callback_ = [](GrpcStatus status, StringView message) {
-    // TODO(douglas-reid): add retry (and other) logic
-    logWarn("MeshEdgesService ReportTrafficAssertionsRequest failure: " +
-            std::to_string(static_cast<int>(status)) + " " +
-            std::string(message));
-  };
-
+    RootContext* root_context, std::string edges_endpoint,
+    ::Extensions::Stackdriver::Common::ExportQueue* export_queue)
+    : context_(root_context), export_queue_(export_queue) {
   GrpcService grpc_service;
   grpc_service.mutable_google_grpc()->set_stat_prefix("mesh_edges");
   if (edges_endpoint.empty()) {
@@ -87,9 +75,37 @@ MeshEdgesServiceClientImpl::MeshEdgesServiceClientImpl(
 
 void MeshEdgesServiceClientImpl::reportTrafficAssertions(
     const ReportTrafficAssertionsRequest& request) const {
-  context_->grpcSimpleCall(
-      grpc_service_, kMeshEdgesService, kReportTrafficAssertions, request,
-      kDefaultTimeoutMillisecond, success_callback_, failure_callback_);
+  // The copy is held by the send function until it succeeds or is dropped,
+  // so that it can be sent again.
+  auto req = std::make_shared<const ReportTrafficAssertionsRequest>(request);
+  export_queue_->enqueue(
+      req->ByteSizeLong(),
+      [this,
+       req](::Extensions::Stackdriver::Common::ExportQueue::DoneFn done) {
+        std::function<void(google::protobuf::Empty&&)> success_callback =
+            [done](google::protobuf::Empty&&) {
+              // TODO(douglas-reid): improve logging message.
+              logDebug(
+                  "successfully sent MeshEdgesService "
+                  "ReportTrafficAssertionsRequest");
+              done(true);
+            };
+        std::function<void(GrpcStatus, StringView)> failure_callback =
+            [done](GrpcStatus status, StringView message) {
+              logWarn("MeshEdgesService ReportTrafficAssertionsRequest "
+                      "failure: " +
+                      std::to_string(static_cast<int>(status)) + " " +
+                      std::string(message));
+              done(false);
+            };
+        if (context_->grpcSimpleCall(grpc_service_, kMeshEdgesService,
+                                     kReportTrafficAssertions, *req,
+                                     kDefaultTimeoutMillisecond,
+                                     success_callback,
+                                     failure_callback) != WasmResult::Ok) {
+          done(false);
+        }
+      });
 };
 
 }  // namespace Edges
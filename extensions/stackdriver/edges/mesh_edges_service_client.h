@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include "extensions/stackdriver/common/export_queue.h"
 #include "extensions/stackdriver/edges/edges.pb.h"
 
 #ifndef NULL_PLUGIN
@@ -56,8 +57,12 @@ class MeshEdgesServiceClientImpl : public MeshEdgesServiceClient {
   // root_context is the wasm runtime context
   // edges_endpoint is an optional param used to specify alternative service
   // address.
-  MeshEdgesServiceClientImpl(RootContext* root_context,
-                             std::string edges_endpoint);
+  // export_queue sends and retries requests, and must outlive the client. It
+  // should not be shared with other backends, whose failures would hold back
+  // edge requests.
+  MeshEdgesServiceClientImpl(
+      RootContext* root_context, std::string edges_endpoint,
+      ::Extensions::Stackdriver::Common::ExportQueue* export_queue);
 
   void reportTrafficAssertions(
       const ReportTrafficAssertionsRequest& request) const override;
@@ -69,9 +74,8 @@ class MeshEdgesServiceClientImpl : public MeshEdgesServiceClient {
   // edges service endpoint.
   std::string grpc_service_;
 
-  // callbacks for the client
-  std::function<void(google::protobuf::Empty&&)> success_callback_;
-  std::function<void(GrpcStatus, StringView)> failure_callback_;
+  // queue that sends requests and retries failed ones.
+  ::Extensions::Stackdriver::Common::ExportQueue* export_queue_;
 };
 
 }  // namespace Edges
@@ -41,27 +41,14 @@ namespace Extensions {
 namespace Stackdriver {
 namespace Log {
 
-ExporterImpl::ExporterImpl(RootContext* root_context,
-                           const std::string& logging_service_endpoint) {
+LoggingServiceClientImpl::LoggingServiceClientImpl(
+    RootContext* root_context, const std::string& logging_service_endpoint) {
   context_ = root_context;
   Metric export_call(MetricType::Counter, "stackdriver_filter",
                      {MetricTag{"type", MetricTag::TagType::String},
                       MetricTag{"success", MetricTag::TagType::Bool}});
-  auto success_counter = export_call.resolve("logging", true);
-  auto failure_counter = export_call.resolve("logging", false);
-  success_callback_ = [success_counter](google::protobuf::Empty&&) {
-    // TODO(bianpengyuan): replace this with envoy's generic gRPC counter.
-    incrementMetric(success_counter, 1);
-    logDebug("successfully sent Stackdriver logging request");
-  };
-
-  failure_callback_ = [failure_counter](GrpcStatus status, StringView message) {
-    // TODO(bianpengyuan): add retry.
-    // TODO(bianpengyuan): replace this with envoy's generic gRPC counter.
-    incrementMetric(failure_counter, 1);
-    logWarn("Stackdriver logging api call error: " +
-            std::to_string(static_cast<int>(status)) + std::string(message));
-  };
+  success_counter_ = export_call.resolve("logging", true);
+  failure_counter_ = export_call.resolve("logging", false);
 
   // Construct grpc_service for the Stackdriver gRPC call.
   GrpcService grpc_service;
@@ -86,16 +73,118 @@ ExporterImpl::ExporterImpl(RootContext* root_context,
   grpc_service.SerializeToString(&grpc_service_string_);
 }
 
+void LoggingServiceClientImpl::writeLogEntries(
+    const google::logging::v2::WriteLogEntriesRequest& request,
+    ::Extensions::Stackdriver::Common::ExportQueue::DoneFn done) const {
+  std::function<void(google::protobuf::Empty&&)> success_callback =
+      [this, done](google::protobuf::Empty&&) {
+        // TODO(bianpengyuan): replace this with envoy's generic gRPC
+        // counter.
+        incrementMetric(success_counter_, 1);
+        logDebug("successfully sent Stackdriver logging request");
+        done(true);
+      };
+  std::function<void(GrpcStatus, StringView)> failure_callback =
+      [this, done](GrpcStatus status, StringView message) {
+        // TODO(bianpengyuan): replace this with envoy's generic gRPC
+        // counter.
+        incrementMetric(failure_counter_, 1);
+        logWarn("Stackdriver logging api call error: " +
+                std::to_string(static_cast<int>(status)) +
+                std::string(message));
+        done(false);
+      };
+  if (context_->grpcSimpleCall(grpc_service_string_, kGoogleLoggingService,
+                               kGoogleWriteLogEntriesMethod, request,
+                               kDefaultTimeoutMillisecond, success_callback,
+                               failure_callback) != WasmResult::Ok) {
+    incrementMetric(failure_counter_, 1);
+    done(false);
+  }
+}
+
+ExporterImpl::ExporterImpl(
+    std::unique_ptr<LoggingServiceClient> client,
+    ::Extensions::Stackdriver::Common::ExportQueue* export_queue,
+    std::unique_ptr<::Extensions::Stackdriver::Common::SpillBuffer>
+        spill_buffer)
+    : client_(std::move(client)),
+      export_queue_(export_queue),
+      spill_buffer_(std::move(spill_buffer)) {}
+
 void ExporterImpl::exportLogs(
     const std::vector<
-        std::unique_ptr<const google::logging::v2::WriteLogEntriesRequest>>&
+        std::shared_ptr<const google::logging::v2::WriteLogEntriesRequest>>&
         requests) const {
   for (const auto& req : requests) {
-    context_->grpcSimpleCall(grpc_service_string_, kGoogleLoggingService,
-                             kGoogleWriteLogEntriesMethod, *req,
-                             kDefaultTimeoutMillisecond, success_callback_,
-                             failure_callback_);
+    // Requests are spilled while the backend fails or the queue is full, and
+    // behind requests that are spilled already to keep their order.
+    if (spill_buffer_ &&
+        (!backend_healthy_ || !spill_buffer_->empty() ||
+         !export_queue_->hasRoom(req->ByteSizeLong())) &&
+        spill_buffer_->push(req->SerializeAsString())) {
+      continue;
+    }
+    enqueue(req);
   }
+  drainSpillBuffer();
+}
+
+void ExporterImpl::drainSpillBuffer() const {
+  // Spilled requests are only read into memory while no other request is
+  // waiting for a call, so that heap usage stays flat. While the backend
+  // fails, a spilled request is only read once no request of this exporter
+  // is outstanding, which is checked on every export, i.e. on tick.
+  std::string serialized;
+  while (spill_buffer_ &&
+         (backend_healthy_ ? export_queue_->queued() == 0
+                           : outstanding_ == 0) &&
+         spill_buffer_->front(&serialized)) {
+    if (!export_queue_->hasRoom(serialized.size())) {
+      return;
+    }
+    spill_buffer_->pop();
+    auto req = std::make_shared<google::logging::v2::WriteLogEntriesRequest>();
+    if (!req->ParseFromString(serialized)) {
+      logWarn("dropping unreadable Stackdriver logging request from spill");
+      continue;
+    }
+    enqueue(std::move(req));
+  }
+}
+
+void ExporterImpl::enqueue(
+    std::shared_ptr<const google::logging::v2::WriteLogEntriesRequest> req)
+    const {
+  // The request is held by the send function until it succeeds or is
+  // dropped, so that it can be sent again.
+  const uint64_t bytes = req->ByteSizeLong();
+  outstanding_++;
+  export_queue_->enqueue(
+      bytes,
+      [this,
+       req](::Extensions::Stackdriver::Common::ExportQueue::DoneFn done) {
+        client_->writeLogEntries(*req, [this, done](bool success) {
+          if (!success) {
+            backend_healthy_ = false;
+            done(false);
+            return;
+          }
+          outstanding_--;
+          backend_healthy_ = true;
+          done(true);
+          drainSpillBuffer();
+        });
+      },
+      [this, req] {
+        outstanding_--;
+        // Requests that the queue gives up on, after max attempts or for
+        // room, are spilled to be sent again once the backend answers. They
+        // go behind requests that are spilled already.
+        if (spill_buffer_) {
+          spill_buffer_->push(req->SerializeAsString());
+        }
+      });
 }
 
 }  // namespace Log
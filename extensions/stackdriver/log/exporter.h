@@ -15,8 +15,12 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "extensions/stackdriver/common/export_queue.h"
+#include "extensions/stackdriver/common/spill_buffer.h"
 #include "google/logging/v2/logging.pb.h"
 
 #ifndef NULL_PLUGIN
@@ -42,27 +46,38 @@ class Exporter {
  public:
   virtual ~Exporter() {}
 
+  // Exports the given log requests, which may be held on to for retries.
   virtual void exportLogs(
       const std::vector<
-          std::unique_ptr<const google::logging::v2::WriteLogEntriesRequest>>&)
+          std::shared_ptr<const google::logging::v2::WriteLogEntriesRequest>>&)
       const = 0;
 };
 
-// Exporter writes Stackdriver access log to the backend. It uses WebAssembly
-// gRPC API.
-class ExporterImpl : public Exporter {
+// LoggingServiceClient sends WriteLogEntries calls to the logging service.
+class LoggingServiceClient {
+ public:
+  virtual ~LoggingServiceClient() {}
+
+  // Sends a request, and calls done exactly once with whether it succeeded.
+  virtual void writeLogEntries(
+      const google::logging::v2::WriteLogEntriesRequest& request,
+      ::Extensions::Stackdriver::Common::ExportQueue::DoneFn done) const = 0;
+};
+
+// LoggingServiceClientImpl writes Stackdriver access log to the backend. It
+// uses WebAssembly gRPC API.
+class LoggingServiceClientImpl : public LoggingServiceClient {
  public:
   // root_context is the wasm runtime context that this instance runs with.
   // logging_service_endpoint is an optional param which should be used for test
   // only.
-  ExporterImpl(RootContext* root_context,
-               const std::string& logging_service_endpoint);
+  LoggingServiceClientImpl(RootContext* root_context,
+                           const std::string& logging_service_endpoint);
 
-  // exportLogs exports the given log request to Stackdriver.
-  void exportLogs(
-      const std::vector<
-          std::unique_ptr<const google::logging::v2::WriteLogEntriesRequest>>&
-          req) const override;
+  void writeLogEntries(
+      const google::logging::v2::WriteLogEntriesRequest& request,
+      ::Extensions::Stackdriver::Common::ExportQueue::DoneFn done)
+      const override;
 
  private:
   // Wasm context that outbound calls are attached to.
@@ -71,9 +86,57 @@ class ExporterImpl : public Exporter {
   // Serialized string of Stackdriver logging service
   std::string grpc_service_string_;
 
-  // Callbacks for gRPC calls.
-  std::function<void(google::protobuf::Empty&&)> success_callback_;
-  std::function<void(GrpcStatus, StringView)> failure_callback_;
+  // Counters of successful and failed gRPC calls.
+  uint32_t success_counter_;
+  uint32_t failure_counter_;
+};
+
+// ExporterImpl sends access log requests through an export queue, and holds
+// them in an optional spill buffer on local disk while the backend fails or
+// the queue is full.
+class ExporterImpl : public Exporter {
+ public:
+  // Requests are sent with client, and sent and retried through export_queue,
+  // which must outlive the exporter. The queue must not hold requests of other
+  // backends, as spilled requests are sent once it is empty. spill_buffer is
+  // optional.
+  ExporterImpl(std::unique_ptr<LoggingServiceClient> client,
+               ::Extensions::Stackdriver::Common::ExportQueue* export_queue,
+               std::unique_ptr<::Extensions::Stackdriver::Common::SpillBuffer>
+                   spill_buffer = nullptr);
+
+  // exportLogs enqueues the given log requests for export to Stackdriver.
+  void exportLogs(
+      const std::vector<
+          std::shared_ptr<const google::logging::v2::WriteLogEntriesRequest>>&
+          req) const override;
+
+ private:
+  // Enqueues a request for export.
+  void enqueue(
+      std::shared_ptr<const google::logging::v2::WriteLogEntriesRequest> req)
+      const;
+
+  // Moves spilled requests to the export queue while the backend is healthy.
+  // While it fails, moves one spilled request at a time as a probe, so that
+  // the backend is called until it answers again.
+  void drainSpillBuffer() const;
+
+  std::unique_ptr<LoggingServiceClient> client_;
+
+  // Queue that sends requests and retries failed ones.
+  ::Extensions::Stackdriver::Common::ExportQueue* export_queue_;
+
+  // Optional buffer of requests on local disk.
+  std::unique_ptr<::Extensions::Stackdriver::Common::SpillBuffer>
+      spill_buffer_;
+
+  // Whether the last call to the backend succeeded. Updated by call
+  // completions.
+  mutable bool backend_healthy_ = true;
+
+  // Number of requests of this exporter that are queued or in flight.
+  mutable size_t outstanding_ = 0;
 };
 
 }  // namespace Log
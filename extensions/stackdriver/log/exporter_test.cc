@@ -0,0 +1,158 @@
+/* Copyright 2020 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/log/exporter.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Log {
+
+#ifdef NULL_PLUGIN
+using Envoy::Extensions::Common::Wasm::Null::Plugin::Extensions::Stackdriver::
+    Log::ExporterImpl;
+using Envoy::Extensions::Common::Wasm::Null::Plugin::Extensions::Stackdriver::
+    Log::LoggingServiceClient;
+#endif
+
+using ::Extensions::Stackdriver::Common::ExportQueue;
+using ::Extensions::Stackdriver::Common::ExportQueueOptions;
+using ::Extensions::Stackdriver::Common::SpillBuffer;
+using google::logging::v2::WriteLogEntriesRequest;
+
+namespace {
+
+// Calls to the fake backend, which are completed by the test.
+struct Calls {
+  std::vector<std::string> log_names;
+  std::vector<ExportQueue::DoneFn> pending;
+
+  // Completes the oldest outstanding call.
+  void complete(bool success) {
+    auto done = std::move(pending.front());
+    pending.erase(pending.begin());
+    done(success);
+  }
+};
+
+class FakeLoggingServiceClient : public LoggingServiceClient {
+ public:
+  explicit FakeLoggingServiceClient(Calls* calls) : calls_(calls) {}
+
+  void writeLogEntries(const WriteLogEntriesRequest& request,
+                       ExportQueue::DoneFn done) const override {
+    calls_->log_names.push_back(request.log_name());
+    calls_->pending.push_back(std::move(done));
+  }
+
+ private:
+  Calls* calls_;
+};
+
+std::shared_ptr<const WriteLogEntriesRequest> request(const std::string& name) {
+  auto req = std::make_shared<WriteLogEntriesRequest>();
+  req->set_log_name(name);
+  return req;
+}
+
+class ExporterTest : public ::testing::Test {
+ protected:
+  ExporterTest() {
+    const char* tmpdir = std::getenv("TEST_TMPDIR");
+    path_ = std::string(tmpdir ? tmpdir : "/tmp") + "/exporter_test." +
+            std::to_string(::getpid()) + "." +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    ::unlink(path_.c_str());
+
+    ExportQueueOptions options;
+    options.max_attempts = 2;
+    options.initial_backoff_milliseconds = 10;
+    options.max_backoff_milliseconds = 10;
+    queue_ = std::make_unique<ExportQueue>(options, [this] { return now_; });
+    exporter_ = std::make_unique<ExporterImpl>(
+        std::make_unique<FakeLoggingServiceClient>(&calls_), queue_.get(),
+        SpillBuffer::open(path_, 64 * 1024));
+  }
+
+  ~ExporterTest() { ::unlink(path_.c_str()); }
+
+  // Exports the requests, as the logger does on tick.
+  void tick(const std::vector<std::string>& names = {}) {
+    std::vector<std::shared_ptr<const WriteLogEntriesRequest>> requests;
+    for (const auto& name : names) {
+      requests.push_back(request(name));
+    }
+    exporter_->exportLogs(requests);
+  }
+
+  std::string path_;
+  int64_t now_ = 0;
+  Calls calls_;
+  std::unique_ptr<ExportQueue> queue_;
+  std::unique_ptr<ExporterImpl> exporter_;
+};
+
+// Requests are spilled while the backend fails, including those the queue
+// gives up on. A probe is sent on tick once nothing is outstanding, and its
+// success sends the spilled requests.
+TEST_F(ExporterTest, RecoversAfterFailure) {
+  tick({"a"});
+  ASSERT_EQ(calls_.log_names, std::vector<std::string>({"a"}));
+  calls_.complete(false);
+
+  // The backend failed, so new requests are spilled.
+  tick({"b", "c"});
+  EXPECT_EQ(calls_.log_names.size(), 1u);
+
+  // The retry fails too, and the request is spilled behind the others.
+  now_ = 10;
+  queue_->send();
+  ASSERT_EQ(calls_.log_names, std::vector<std::string>({"a", "a"}));
+  calls_.complete(false);
+  EXPECT_EQ(queue_->dropped(), 1u);
+  EXPECT_EQ(queue_->queued() + queue_->inFlight(), 0u);
+
+  // A single spilled request probes the backend on tick.
+  tick({"d"});
+  ASSERT_EQ(calls_.log_names, std::vector<std::string>({"a", "a", "b"}));
+  EXPECT_EQ(calls_.pending.size(), 1u);
+  tick();
+  EXPECT_EQ(calls_.pending.size(), 1u);
+
+  // The backend answers, and the spilled requests are sent in order.
+  calls_.complete(true);
+  EXPECT_EQ(calls_.log_names,
+            std::vector<std::string>({"a", "a", "b", "c", "a", "d"}));
+  while (!calls_.pending.empty()) {
+    calls_.complete(true);
+  }
+  EXPECT_EQ(queue_->succeeded(), 4u);
+
+  // Spill is empty, so new requests are sent right away.
+  tick({"e"});
+  EXPECT_EQ(calls_.log_names.back(), "e");
+}
+
+}  // namespace
+}  // namespace Log
+}  // namespace Stackdriver
+}  // namespace Extensions
@@ -37,12 +37,12 @@ using google::protobuf::util::TimeUtil;
 // Name of the HTTP server access log.
 constexpr char kServerAccessLogName[] = "server-accesslog-stackdriver";
 
-Logger::Logger(const ::wasm::common::NodeInfo& local_node_info,
-               std::unique_ptr<Exporter> exporter, int log_request_size_limit) {
-  // Initalize the current WriteLogEntriesRequest.
-  log_entries_request_ =
-      std::make_unique<google::logging::v2::WriteLogEntriesRequest>();
+// Response flag of requests without any flag set.
+constexpr char kNoResponseFlag[] = "-";
 
+Logger::Logger(const ::wasm::common::NodeInfo& local_node_info,
+               std::unique_ptr<Exporter> exporter, int log_request_size_limit)
+    : peer_entries_(::Wasm::Common::DefaultNodeCacheMaxSize) {
   // Set log names.
   const auto& platform_metadata = local_node_info.platform_metadata();
   const auto project_iter = platform_metadata.find(Common::kGCPProjectKey);
@@ -50,8 +50,8 @@ Logger::Logger(const ::wasm::common::NodeInfo& local_node_info,
   if (project_iter != platform_metadata.end()) {
     project_id = project_iter->second;
   }
-  log_entries_request_->set_log_name("projects/" + project_id + "/logs/" +
-                                     kServerAccessLogName);
+  request_prototype_.set_log_name("projects/" + project_id + "/logs/" +
+                                  kServerAccessLogName);
 
   std::string resource_type = Common::kContainerMonitoredResource;
   const auto cluster_iter = platform_metadata.find(Common::kGCPClusterNameKey);
@@ -64,32 +64,129 @@ Logger::Logger(const ::wasm::common::NodeInfo& local_node_info,
   google::api::MonitoredResource monitored_resource;
   Common::getMonitoredResource(resource_type, local_node_info,
                                &monitored_resource);
-  log_entries_request_->mutable_resource()->CopyFrom(monitored_resource);
+  request_prototype_.mutable_resource()->CopyFrom(monitored_resource);
 
   // Set common labels shared by all entries.
-  auto label_map = log_entries_request_->mutable_labels();
+  auto label_map = request_prototype_.mutable_labels();
   (*label_map)["destination_name"] = local_node_info.name();
   (*label_map)["destination_workload"] = local_node_info.workload_name();
   (*label_map)["destination_namespace"] = local_node_info.namespace_();
   (*label_map)["mesh_uid"] = local_node_info.mesh_id();
+
+  // Initalize the current WriteLogEntriesRequest.
+  newRequest();
   log_request_size_limit_ = log_request_size_limit;
   exporter_ = std::move(exporter);
 }
 
+void Logger::newRequest() {
+  arena_ = std::make_shared<google::protobuf::Arena>();
+  log_entries_request_ = google::protobuf::Arena::CreateMessage<
+      google::logging::v2::WriteLogEntriesRequest>(arena_.get());
+  log_entries_request_->CopyFrom(request_prototype_);
+}
+
+const google::logging::v2::LogEntry& Logger::peerEntry(
+    const ::wasm::common::NodeInfo& peer_node_info,
+    ::Wasm::Common::StringView peer_id) {
+  google::logging::v2::LogEntry* entry = nullptr;
+  if (!peer_id.empty() && peer_entries_.capacity() > 0) {
+    peer_key_.assign(peer_id.data(), peer_id.size());
+    entry = peer_entries_.get(peer_key_);
+    if (entry != nullptr) {
+      return *entry;
+    }
+    entry = peer_entries_.insert(peer_key_, google::logging::v2::LogEntry());
+  } else {
+    entry = &uncached_peer_entry_;
+    entry->Clear();
+  }
+
+  entry->set_severity(::google::logging::type::INFO);
+  auto label_map = entry->mutable_labels();
+  (*label_map)["source_name"] = peer_node_info.name();
+  (*label_map)["source_workload"] = peer_node_info.workload_name();
+  (*label_map)["source_namespace"] = peer_node_info.namespace_();
+  return *entry;
+}
+
+void Logger::setSampling(double success_sampling_rate,
+                         int64_t slow_request_threshold_nanos) {
+  success_sampling_rate_ = success_sampling_rate;
+  slow_request_threshold_nanos_ = slow_request_threshold_nanos;
+  sampling_credit_ = 0;
+}
+
+void Logger::setAggregation(bool aggregate) {
+  if (aggregate_ != aggregate) {
+    // Entries of the current request are either all folded or none.
+    flush();
+    aggregate_ = aggregate;
+  }
+}
+
+bool Logger::sample(const ::Wasm::Common::RequestInfo& request_info) {
+  if (success_sampling_rate_ >= 1.0) {
+    return true;
+  }
+  // Requests that got no response, e.g. after a reset, have no response code.
+  if (request_info.response_code == 0 || request_info.response_code >= 400 ||
+      (!request_info.response_flag.empty() &&
+       request_info.response_flag != kNoResponseFlag)) {
+    return true;
+  }
+  if (slow_request_threshold_nanos_ > 0 &&
+      request_info.end_timestamp - request_info.start_timestamp >=
+          slow_request_threshold_nanos_) {
+    return true;
+  }
+  sampling_credit_ += success_sampling_rate_;
+  if (sampling_credit_ < 1.0) {
+    return false;
+  }
+  sampling_credit_ -= 1.0;
+  return true;
+}
+
 void Logger::addLogEntry(const ::Wasm::Common::RequestInfo& request_info,
-                         const ::wasm::common::NodeInfo& peer_node_info) {
-  // create a new log entry
+                         const ::wasm::common::NodeInfo& peer_node_info,
+                         ::Wasm::Common::StringView peer_id) {
   auto* log_entries = log_entries_request_->mutable_entries();
+  AggregatedEntry* aggregated = nullptr;
+  if (aggregate_) {
+    aggregation_key_.assign(peer_node_info.name());
+    aggregation_key_.push_back('\0');
+    aggregation_key_.append(peer_node_info.namespace_());
+    aggregation_key_.push_back('\0');
+    aggregation_key_.append(request_info.request_operation);
+    aggregation_key_.push_back('\0');
+    aggregation_key_.append(request_info.request_url_path);
+    aggregation_key_.push_back('\0');
+    aggregation_key_.append(std::to_string(request_info.response_code));
+    aggregation_key_.push_back('\0');
+    aggregation_key_.append(request_info.response_flag);
+    // Every request is counted, and only entries are sampled.
+    aggregated = &aggregated_entries_[aggregation_key_];
+    aggregated->request_count++;
+    if (aggregated->index >= 0) {
+      return;
+    }
+  }
+
+  if (!sample(request_info)) {
+    return;
+  }
+  if (aggregated != nullptr) {
+    aggregated->index = log_entries->size();
+  }
+
+  // create a new log entry, starting from the labels of the peer.
   auto* new_entry = log_entries->Add();
+  new_entry->MergeFrom(peerEntry(peer_node_info, peer_id));
 
   *new_entry->mutable_timestamp() =
       TimeUtil::NanosecondsToTimestamp(request_info.start_timestamp);
-  new_entry->set_severity(::google::logging::type::INFO);
   auto label_map = new_entry->mutable_labels();
-  (*label_map)["source_name"] = peer_node_info.name();
-  (*label_map)["source_workload"] = peer_node_info.workload_name();
-  (*label_map)["source_namespace"] = peer_node_info.namespace_();
-
   (*label_map)["request_operation"] = request_info.request_operation;
   (*label_map)["destination_service_host"] =
       request_info.destination_service_host;
@@ -100,6 +197,9 @@ void Logger::addLogEntry(const ::Wasm::Common::RequestInfo& request_info,
   (*label_map)["service_authentication_policy"] =
       std::string(::Wasm::Common::AuthenticationPolicyString(
           request_info.service_auth_policy));
+  if (aggregate_) {
+    (*label_map)["response_code"] = std::to_string(request_info.response_code);
+  }
   // Accumulate estimated size of the request. If the current request exceeds
   // the size limit, flush the request out.
   size_ += new_entry->ByteSizeLong();
@@ -111,19 +211,26 @@ void Logger::addLogEntry(const ::Wasm::Common::RequestInfo& request_info,
 bool Logger::flush() {
   if (size_ == 0) {
     // This flush is triggered by timer and does not have any log entries.
+    // Requests of keys that were not sampled are not carried over.
+    aggregated_entries_.clear();
     return false;
   }
 
-  // Reconstruct a new WriteLogRequest.
-  std::unique_ptr<google::logging::v2::WriteLogEntriesRequest> cur =
-      std::make_unique<google::logging::v2::WriteLogEntriesRequest>();
-  cur->set_log_name(log_entries_request_->log_name());
-  cur->mutable_resource()->CopyFrom(log_entries_request_->resource());
-  *cur->mutable_labels() = log_entries_request_->labels();
+  // Write the request counts of folded entries.
+  auto* log_entries = log_entries_request_->mutable_entries();
+  for (const auto& aggregated : aggregated_entries_) {
+    if (aggregated.second.index >= 0) {
+      (*log_entries->Mutable(aggregated.second.index)
+            ->mutable_labels())["request_count"] =
+          std::to_string(aggregated.second.request_count);
+    }
+  }
+  aggregated_entries_.clear();
 
-  // Swap the new request with the old one and export it.
-  log_entries_request_.swap(cur);
-  request_queue_.emplace_back(std::move(cur));
+  // Queue the current request, which keeps its arena alive, and start a new
+  // one.
+  request_queue_.emplace_back(arena_, log_entries_request_);
+  newRequest();
 
   // Reset size counter.
   size_ = 0;
@@ -131,10 +238,9 @@ bool Logger::flush() {
 }
 
 void Logger::exportLogEntry() {
-  if (!flush() && request_queue_.empty()) {
-    // No log entry needs to export.
-    return;
-  }
+  // The exporter is called even without new requests, so that it can send
+  // requests it holds back.
+  flush();
   exporter_->exportLogs(request_queue_);
   request_queue_.clear();
 }
@@ -15,12 +15,16 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "extensions/common/clock_cache.h"
 #include "extensions/common/context.h"
 #include "extensions/stackdriver/log/exporter.h"
 #include "google/logging/v2/logging.pb.h"
+#include "google/protobuf/arena.h"
 
 namespace Extensions {
 namespace Stackdriver {
@@ -43,27 +47,106 @@ class Logger {
          int log_request_size_limit = 4000000 /* 4 Mb */);
 
   // Add a new log entry based on the given request information and peer node
-  // information.
+  // information. The labels derived from the peer node are built once per peer
+  // ID, an empty peer ID is not cached.
   void addLogEntry(const ::Wasm::Common::RequestInfo &request_info,
-                   const ::wasm::common::NodeInfo &peer_node_info);
+                   const ::wasm::common::NodeInfo &peer_node_info,
+                   ::Wasm::Common::StringView peer_id = {});
 
   // Export and clean the buffered WriteLogEntriesRequests.
   void exportLogEntry();
 
+  // Sets which requests are logged. Requests that failed, i.e. without a
+  // response code, with a response code of 400 or above, or with response
+  // flags, and requests that took at least
+  // slow_request_threshold_nanos are always logged, if the threshold is
+  // positive. Other requests are logged at success_sampling_rate, which is
+  // between 0 and 1. Every request is logged by default.
+  void setSampling(double success_sampling_rate,
+                   int64_t slow_request_threshold_nanos);
+
+  // Sets whether requests with the same peer, operation, URL path, response
+  // code and response flags are folded into one log entry per
+  // WriteLogEntriesRequest. Folded entries keep
+  // the labels of the first logged request and count requests in the
+  // "request_count" label. Requests are counted before sampling, so that
+  // sampling only picks the entries: the count includes requests that were
+  // not sampled before the entry was.
+  void setAggregation(bool aggregate);
+
  private:
   // Flush rotates the current WriteLogEntriesRequest. This will be triggered
   // either by a timer or by request size limit. Returns false if there is no
   // log entry to be exported.
   bool flush();
 
-  // Buffer for WriteLogEntriesRequests that are to be exported.
+  // Starts an empty WriteLogEntriesRequest with the fields shared by all
+  // requests, on a new arena.
+  void newRequest();
+
+  // Returns whether the request should be logged.
+  bool sample(const ::Wasm::Common::RequestInfo &request_info);
+
+  // Gets the log entry that holds the labels derived from the peer node.
+  const google::logging::v2::LogEntry &peerEntry(
+      const ::wasm::common::NodeInfo &peer_node_info,
+      ::Wasm::Common::StringView peer_id);
+
+  // Fields shared by all WriteLogEntriesRequests, i.e. log name, resource and
+  // common labels.
+  google::logging::v2::WriteLogEntriesRequest request_prototype_;
+
+  // Buffer for WriteLogEntriesRequests that are to be exported. Every request
+  // shares the ownership of the arena it is allocated on, so that its entries
+  // are released at once when the exporter is done with it.
   std::vector<
-      std::unique_ptr<const google::logging::v2::WriteLogEntriesRequest>>
+      std::shared_ptr<const google::logging::v2::WriteLogEntriesRequest>>
       request_queue_;
 
-  // Request that the new log entry should be written into.
-  std::unique_ptr<google::logging::v2::WriteLogEntriesRequest>
-      log_entries_request_;
+  // Arena of the current WriteLogEntriesRequest.
+  std::shared_ptr<google::protobuf::Arena> arena_;
+
+  // Request that the new log entry should be written into, which is owned by
+  // arena_.
+  google::logging::v2::WriteLogEntriesRequest *log_entries_request_;
+
+  // Log entries with the labels derived from the peer node by peer ID, which
+  // are merged into new entries.
+  ::Wasm::Common::ClockCache<google::logging::v2::LogEntry> peer_entries_;
+
+  // Scratch buffer for peer cache keys.
+  std::string peer_key_;
+
+  // Peer entry of requests without a peer ID.
+  google::logging::v2::LogEntry uncached_peer_entry_;
+
+  // Fraction of successful requests that are logged.
+  double success_sampling_rate_ = 1.0;
+
+  // Successful requests that have not been logged accumulate the sampling
+  // rate, and one is logged whenever this credit reaches one. This logs
+  // exactly the configured fraction, evenly spread.
+  double sampling_credit_ = 0;
+
+  // Latency from which requests are always logged. Disabled if not positive.
+  int64_t slow_request_threshold_nanos_ = 0;
+
+  // Whether log entries are folded by peer, operation and response code.
+  bool aggregate_ = false;
+
+  // Folded entry of an aggregation key.
+  struct AggregatedEntry {
+    // Index of the entry in the current WriteLogEntriesRequest, or -1 if no
+    // request with the key was sampled yet.
+    int index = -1;
+    int64_t request_count = 0;
+  };
+
+  // Folded entries of the current WriteLogEntriesRequest by aggregation key.
+  std::unordered_map<std::string, AggregatedEntry> aggregated_entries_;
+
+  // Scratch buffer for aggregation keys.
+  std::string aggregation_key_;
 
   // Estimated size of the current WriteLogEntriesRequest.
   int size_ = 0;
@@ -40,7 +40,7 @@ class MockExporter : public Exporter {
  public:
   MOCK_CONST_METHOD1(
       exportLogs,
-      void(const std::vector<std::unique_ptr<
+      void(const std::vector<std::shared_ptr<
                const google::logging::v2::WriteLogEntriesRequest>>&));
 };
 
@@ -87,9 +87,9 @@ wasm::common::NodeInfo peerNodeInfo() {
 }
 
 google::logging::v2::WriteLogEntriesRequest expectedRequest(
-    int log_entry_count) {
+    int log_entry_count,
+    const wasm::common::NodeInfo& peer_node_info = peerNodeInfo()) {
   auto request_info = requestInfo();
-  auto peer_node_info = peerNodeInfo();
   auto node_info = nodeInfo();
   google::logging::v2::WriteLogEntriesRequest req;
   req.set_log_name(kServerAccessLogName);
@@ -134,7 +134,7 @@ TEST(LoggerTest, TestWriteLogEntry) {
   logger->addLogEntry(requestInfo(), peerNodeInfo());
   EXPECT_CALL(*exporter_ptr, exportLogs(::testing::_))
       .WillOnce(::testing::Invoke(
-          [](const std::vector<std::unique_ptr<
+          [](const std::vector<std::shared_ptr<
                  const google::logging::v2::WriteLogEntriesRequest>>&
                  requests) {
             auto expected_request = expectedRequest(1);
@@ -154,7 +154,7 @@ TEST(LoggerTest, TestWriteLogEntryRotation) {
   }
   EXPECT_CALL(*exporter_ptr, exportLogs(::testing::_))
       .WillOnce(::testing::Invoke(
-          [](const std::vector<std::unique_ptr<
+          [](const std::vector<std::shared_ptr<
                  const google::logging::v2::WriteLogEntriesRequest>>&
                  requests) {
             EXPECT_EQ(requests.size(), 3);
@@ -166,6 +166,168 @@ TEST(LoggerTest, TestWriteLogEntryRotation) {
   logger->exportLogEntry();
 }
 
+// Peer labels are cached by peer ID, and every export starts a new request.
+TEST(LoggerTest, TestWriteLogEntryPeers) {
+  auto exporter = std::make_unique<::testing::NiceMock<MockExporter>>();
+  auto exporter_ptr = exporter.get();
+  auto logger = std::make_unique<Logger>(nodeInfo(), std::move(exporter));
+  auto other_peer_node_info = peerNodeInfo();
+  other_peer_node_info.set_name("other_peer_pod");
+  other_peer_node_info.set_workload_name("other_peer_workload");
+
+  for (int round = 0; round < 2; round++) {
+    logger->addLogEntry(requestInfo(), peerNodeInfo(), "peer");
+    logger->addLogEntry(requestInfo(), other_peer_node_info, "other_peer");
+    logger->addLogEntry(requestInfo(), peerNodeInfo(), "peer");
+    logger->addLogEntry(requestInfo(), other_peer_node_info, "");
+    EXPECT_CALL(*exporter_ptr, exportLogs(::testing::_))
+        .WillOnce(::testing::Invoke(
+            [&other_peer_node_info](
+                const std::vector<std::shared_ptr<
+                    const google::logging::v2::WriteLogEntriesRequest>>&
+                    requests) {
+              ASSERT_EQ(requests.size(), 1);
+              auto expected_request = expectedRequest(4);
+              auto expected_other_request =
+                  expectedRequest(1, other_peer_node_info);
+              *expected_request.mutable_entries(1) =
+                  expected_other_request.entries(0);
+              *expected_request.mutable_entries(3) =
+                  expected_other_request.entries(0);
+              EXPECT_TRUE(
+                  MessageDifferencer::Equals(expected_request, *requests[0]));
+            }));
+    logger->exportLogEntry();
+  }
+}
+
+// Errors, requests without a response or with response flags, and slow
+// requests are always logged, successes at the sampling rate.
+TEST(LoggerTest, TestSampling) {
+  auto exporter = std::make_unique<::testing::NiceMock<MockExporter>>();
+  auto exporter_ptr = exporter.get();
+  auto logger = std::make_unique<Logger>(nodeInfo(), std::move(exporter));
+  logger->setSampling(0.25, 1000);
+
+  auto success = requestInfo();
+  success.response_code = 200;
+  success.end_timestamp = 999;
+  auto error = success;
+  error.response_code = 503;
+  auto slow = success;
+  slow.end_timestamp = 1000;
+  auto no_response = success;
+  no_response.response_code = 0;
+  auto flagged = success;
+  flagged.response_flag = "UF";
+  for (int i = 0; i < 8; i++) {
+    logger->addLogEntry(success, peerNodeInfo());
+    logger->addLogEntry(error, peerNodeInfo());
+    logger->addLogEntry(slow, peerNodeInfo());
+    logger->addLogEntry(no_response, peerNodeInfo());
+    logger->addLogEntry(flagged, peerNodeInfo());
+  }
+  EXPECT_CALL(*exporter_ptr, exportLogs(::testing::_))
+      .WillOnce(::testing::Invoke(
+          [](const std::vector<std::shared_ptr<
+                 const google::logging::v2::WriteLogEntriesRequest>>&
+                 requests) {
+            ASSERT_EQ(requests.size(), 1);
+            EXPECT_EQ(requests[0]->entries_size(), 2 + 8 * 4);
+          }));
+  logger->exportLogEntry();
+}
+
+// Requests with the same peer, operation, URL path, response code and response
+// flags are folded into one entry per logging request.
+TEST(LoggerTest, TestAggregation) {
+  auto exporter = std::make_unique<::testing::NiceMock<MockExporter>>();
+  auto exporter_ptr = exporter.get();
+  auto logger = std::make_unique<Logger>(nodeInfo(), std::move(exporter));
+  logger->setAggregation(true);
+
+  auto ok = requestInfo();
+  ok.response_code = 200;
+  auto not_found = requestInfo();
+  not_found.response_code = 404;
+  auto other_path = ok;
+  other_path.request_url_path = "/other";
+  auto flagged = ok;
+  flagged.response_flag = "UF";
+  auto other_peer_node_info = peerNodeInfo();
+  other_peer_node_info.set_name("other_peer_pod");
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 3; i++) {
+      logger->addLogEntry(ok, peerNodeInfo());
+      logger->addLogEntry(not_found, peerNodeInfo());
+    }
+    logger->addLogEntry(other_path, peerNodeInfo());
+    logger->addLogEntry(other_path, peerNodeInfo());
+    logger->addLogEntry(flagged, peerNodeInfo());
+    logger->addLogEntry(ok, other_peer_node_info);
+    EXPECT_CALL(*exporter_ptr, exportLogs(::testing::_))
+        .WillOnce(::testing::Invoke(
+            [&other_peer_node_info](
+                const std::vector<std::shared_ptr<
+                    const google::logging::v2::WriteLogEntriesRequest>>&
+                    requests) {
+              ASSERT_EQ(requests.size(), 1);
+              auto expected_request = expectedRequest(5);
+              *expected_request.mutable_entries(4) =
+                  expectedRequest(1, other_peer_node_info).entries(0);
+              (*expected_request.mutable_entries(3)
+                    ->mutable_labels())["response_flag"] = "UF";
+              const std::vector<std::pair<std::string, std::string>> labels = {
+                  {"200", "3"}, {"404", "3"}, {"200", "2"}, {"200", "1"},
+                  {"200", "1"}};
+              for (int i = 0; i < 5; i++) {
+                auto label_map =
+                    expected_request.mutable_entries(i)->mutable_labels();
+                (*label_map)["response_code"] = labels[i].first;
+                (*label_map)["request_count"] = labels[i].second;
+              }
+              EXPECT_TRUE(
+                  MessageDifferencer::Equals(expected_request, *requests[0]));
+            }));
+    logger->exportLogEntry();
+  }
+}
+
+// With sampling, folded entries count all requests of their key, including
+// requests before the entry was sampled.
+TEST(LoggerTest, TestAggregationWithSampling) {
+  auto exporter = std::make_unique<::testing::NiceMock<MockExporter>>();
+  auto exporter_ptr = exporter.get();
+  auto logger = std::make_unique<Logger>(nodeInfo(), std::move(exporter));
+  logger->setSampling(0.25, 0);
+  logger->setAggregation(true);
+
+  auto ok = requestInfo();
+  ok.response_code = 200;
+  auto not_found = requestInfo();
+  not_found.response_code = 404;
+  for (int i = 0; i < 10; i++) {
+    logger->addLogEntry(ok, peerNodeInfo());
+    logger->addLogEntry(not_found, peerNodeInfo());
+  }
+  EXPECT_CALL(*exporter_ptr, exportLogs(::testing::_))
+      .WillOnce(::testing::Invoke(
+          [](const std::vector<std::shared_ptr<
+                 const google::logging::v2::WriteLogEntriesRequest>>&
+                 requests) {
+            ASSERT_EQ(requests.size(), 1);
+            // The error is logged first, the success once it is sampled.
+            ASSERT_EQ(requests[0]->entries_size(), 2);
+            const auto& not_found_labels = requests[0]->entries(0).labels();
+            EXPECT_EQ(not_found_labels.at("response_code"), "404");
+            EXPECT_EQ(not_found_labels.at("request_count"), "10");
+            const auto& ok_labels = requests[0]->entries(1).labels();
+            EXPECT_EQ(ok_labels.at("response_code"), "200");
+            EXPECT_EQ(ok_labels.at("request_count"), "10");
+          }));
+  logger->exportLogEntry();
+}
+
 }  // namespace Log
 }  // namespace Stackdriver
 }  // namespace Extensions
@@ -0,0 +1,98 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/metric/histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Metric {
+
+namespace {
+
+// Offset that makes the exponents of finite doubles non-negative.
+constexpr int64_t kExponentOffset = 1100;
+
+}  // namespace
+
+// Log-linear indexes of positive values are positive and grow with the value,
+// zero has index 0 and negative values mirror positive ones. View buckets are
+// found as Opencensus does, so the index of a view bucket is the number of
+// boundaries at or below the value.
+void LogLinearHistogram::add(double value) {
+  if (!std::isfinite(value)) {
+    value = 0;
+  }
+  const int64_t view_bucket =
+      std::upper_bound(view_boundaries_.begin(), view_boundaries_.end(),
+                       value) -
+      view_boundaries_.begin();
+  int64_t index = 0;
+  if (value != 0) {
+    int exponent;
+    // Mantissa is in [0.5, 1).
+    const double mantissa = std::frexp(std::fabs(value), &exponent);
+    const int64_t sub_bucket = static_cast<int64_t>(
+        std::ldexp(mantissa - 0.5, precision_bits_ + 1));
+    index =
+        (((exponent + kExponentOffset) << precision_bits_) | sub_bucket) + 1;
+    if (value < 0) {
+      index = -index;
+    }
+  }
+
+  auto &bucket = buckets_[Key(view_bucket, index)];
+  if (bucket.count == 0 || value < bucket.min) {
+    bucket.min = value;
+  }
+  if (bucket.count == 0 || value > bucket.max) {
+    bucket.max = value;
+  }
+  bucket.count++;
+  bucket.sum += value;
+}
+
+double LogLinearHistogram::Cursor::next() {
+  while (yielded_ == it_->second.count) {
+    ++it_;
+    yielded_ = 0;
+  }
+  const auto &bucket = it_->second;
+  const int64_t i = yielded_++;
+  if (i == 0) {
+    return bucket.min;
+  }
+  if (i == 1) {
+    return bucket.max;
+  }
+
+  // The other samples lie between min and max, and so does their mean.
+  const int64_t others = bucket.count - 2;
+  const double rest = bucket.sum - bucket.min - bucket.max;
+  if (!integral_) {
+    return std::min(std::max(rest / others, bucket.min), bucket.max);
+  }
+  // Integers are the floor of the mean, and one more for the first samples
+  // that make up the remainder.
+  const int64_t excess = std::llround(rest - bucket.min * others);
+  const int64_t floor = std::llround(bucket.min) + excess / others;
+  return floor + (i - 2 < excess % others ? 1 : 0);
+}
+
+}  // namespace Metric
+}  // namespace Stackdriver
+}  // namespace Extensions
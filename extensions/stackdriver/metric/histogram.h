@@ -0,0 +1,90 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Metric {
+
+// LogLinearHistogram merges samples locally before they are recorded, in the
+// manner of an HDR histogram. Every power of two range is split into
+// 2^precision_bits buckets of equal width, so a sample is merged with the
+// samples that agree with it in the sign, the exponent and precision_bits bits
+// after the leading bit. Samples are only merged within the same bucket of the
+// view boundaries, which are the bucket boundaries of the view they are
+// recorded to, and a bucket keeps the count, sum, min and max of its samples.
+// Non-finite samples are counted as zero.
+// LogLinearHistogram is not thread safe.
+class LogLinearHistogram {
+ public:
+  explicit LogLinearHistogram(int precision_bits,
+                              std::vector<double> view_boundaries = {})
+      : precision_bits_(precision_bits),
+        view_boundaries_(std::move(view_boundaries)) {}
+
+  struct Bucket {
+    int64_t count = 0;
+    double sum = 0;
+    double min = 0;
+    double max = 0;
+  };
+
+  // Buckets are keyed by the index of their view bucket and their log-linear
+  // index.
+  using Key = std::pair<int64_t, int64_t>;
+
+  void add(double value);
+
+  // Buckets in the order of their values.
+  const std::map<Key, Bucket> &buckets() const { return buckets_; }
+
+  void clear() { buckets_.clear(); }
+
+  // Cursor yields a value for every merged sample, in the order of buckets.
+  // A bucket yields its min, its max if it holds more samples, and then the
+  // rest of its sum spread evenly over its other samples, as integers if
+  // integral is set. Recording these values keeps the count, sum, min, max
+  // and view bucket of the samples of every bucket.
+  class Cursor {
+   public:
+    Cursor(const LogLinearHistogram &histogram, bool integral)
+        : it_(histogram.buckets_.begin()), integral_(integral) {}
+
+    // Returns the value of the next sample. Must not be called more often
+    // than there are samples.
+    double next();
+
+   private:
+    std::map<Key, Bucket>::const_iterator it_;
+    const bool integral_;
+    // Number of values yielded of the current bucket.
+    int64_t yielded_ = 0;
+  };
+
+ private:
+  const int precision_bits_;
+  const std::vector<double> view_boundaries_;
+  std::map<Key, Bucket> buckets_;
+};
+
+}  // namespace Metric
+}  // namespace Stackdriver
+}  // namespace Extensions
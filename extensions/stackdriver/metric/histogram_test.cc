@@ -0,0 +1,139 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/metric/histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Metric {
+
+TEST(LogLinearHistogramTest, SmallIntegersExact) {
+  LogLinearHistogram histogram(8);
+  for (int64_t i = 0; i < 256; i++) {
+    histogram.add(i);
+  }
+  ASSERT_EQ(histogram.buckets().size(), 256u);
+  int64_t expected = 0;
+  for (const auto &bucket : histogram.buckets()) {
+    EXPECT_EQ(bucket.second.count, 1);
+    EXPECT_EQ(bucket.second.sum, expected);
+    EXPECT_EQ(bucket.second.min, expected);
+    EXPECT_EQ(bucket.second.max, expected);
+    expected++;
+  }
+}
+
+// Samples of a bucket are within a relative distance of 2^-precision_bits.
+TEST(LogLinearHistogramTest, RelativeError) {
+  LogLinearHistogram histogram(6);
+  for (double value : {0.001, 1.7, 2.3, 1234.5678, 9.87e12, -42.1}) {
+    for (int i = 0; i < 100; i++) {
+      histogram.add(value * (1 + i / 1000.0));
+    }
+  }
+  EXPECT_LT(histogram.buckets().size(), 600u);
+  for (const auto &bucket : histogram.buckets()) {
+    const double distance = bucket.second.max - bucket.second.min;
+    EXPECT_LE(distance, std::fabs(bucket.second.max) / 64);
+  }
+}
+
+TEST(LogLinearHistogramTest, MergesAndOrders) {
+  LogLinearHistogram histogram(2);
+  for (double value : {1000.0, 1001.0, -3.0, 0.0, 5.0, 1002.0, 0.5}) {
+    histogram.add(value);
+  }
+  std::vector<double> values;
+  int64_t count = 0;
+  for (const auto &bucket : histogram.buckets()) {
+    values.push_back(bucket.second.min);
+    count += bucket.second.count;
+  }
+  EXPECT_EQ(count, 7);
+  // 1000, 1001 and 1002 are merged.
+  ASSERT_EQ(values.size(), 5u);
+  EXPECT_TRUE(std::is_sorted(values.begin(), values.end()));
+  EXPECT_EQ(values[0], -3);
+  EXPECT_EQ(values[1], 0);
+  const auto &merged = histogram.buckets().rbegin()->second;
+  EXPECT_EQ(merged.count, 3);
+  EXPECT_EQ(merged.sum, 3003);
+  EXPECT_EQ(merged.min, 1000);
+  EXPECT_EQ(merged.max, 1002);
+}
+
+// Samples on both sides of a view boundary are not merged, even if they agree
+// in the precision bits.
+TEST(LogLinearHistogramTest, ViewBoundaries) {
+  LogLinearHistogram histogram(8, {1000, 5000});
+  for (double value : {4995.0, 4999.0, 5000.0, 5003.0}) {
+    histogram.add(value);
+  }
+  ASSERT_EQ(histogram.buckets().size(), 2u);
+  const auto &below = histogram.buckets().begin()->second;
+  EXPECT_EQ(histogram.buckets().begin()->first.first, 1);
+  EXPECT_EQ(below.count, 2);
+  EXPECT_EQ(below.max, 4999);
+  const auto &above = histogram.buckets().rbegin()->second;
+  EXPECT_EQ(histogram.buckets().rbegin()->first.first, 2);
+  EXPECT_EQ(above.count, 2);
+  EXPECT_EQ(above.min, 5000);
+}
+
+// Cursor values keep the count, sum, min and max of every bucket, and stay
+// within the bucket.
+TEST(LogLinearHistogramTest, Cursor) {
+  for (bool integral : {true, false}) {
+    LogLinearHistogram histogram(3, {5000});
+    std::vector<double> samples = {1, 4992, 4993, 4993, 4998, 4999,
+                                   5000, 5001, 5007, 5006, 40000};
+    if (!integral) {
+      samples.push_back(4992.25);
+    }
+    for (double value : samples) {
+      histogram.add(value);
+    }
+
+    LogLinearHistogram::Cursor cursor(histogram, integral);
+    LogLinearHistogram recorded(3, {5000});
+    for (size_t i = 0; i < samples.size(); i++) {
+      const double value = cursor.next();
+      if (integral) {
+        EXPECT_EQ(value, std::round(value));
+      }
+      recorded.add(value);
+    }
+    ASSERT_EQ(recorded.buckets().size(), histogram.buckets().size());
+    auto it = recorded.buckets().begin();
+    for (const auto &bucket : histogram.buckets()) {
+      EXPECT_EQ(it->first, bucket.first);
+      EXPECT_EQ(it->second.count, bucket.second.count);
+      EXPECT_DOUBLE_EQ(it->second.sum, bucket.second.sum);
+      EXPECT_EQ(it->second.min, bucket.second.min);
+      EXPECT_EQ(it->second.max, bucket.second.max);
+      ++it;
+    }
+  }
+}
+
+}  // namespace Metric
+}  // namespace Stackdriver
+}  // namespace Extensions
@@ -15,6 +15,12 @@
 
 #include "extensions/stackdriver/metric/record.h"
 
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "extensions/stackdriver/common/constants.h"
 #include "extensions/stackdriver/metric/registry.h"
 
@@ -22,40 +28,199 @@ namespace Extensions {
 namespace Stackdriver {
 namespace Metric {
 
-void record(bool is_outbound, const ::wasm::common::NodeInfo &local_node_info,
-            const ::wasm::common::NodeInfo &peer_node_info,
-            const ::Wasm::Common::RequestInfo &request_info) {
-  double latency_ms =
-      double(request_info.end_timestamp - request_info.start_timestamp) /
-      Stackdriver::Common::kNanosecondsPerMillisecond;
+using stackdriver::config::v1alpha1::PluginConfig;
+
+namespace {
+
+// Number of tags that are specific to a request.
+constexpr size_t kRequestTagCount = 8;
+
+double latencyMilliseconds(const ::Wasm::Common::RequestInfo &request_info) {
+  return double(request_info.end_timestamp - request_info.start_timestamp) /
+         Stackdriver::Common::kNanosecondsPerMillisecond;
+}
+
+// Numeric request tag values, formatted in place.
+struct RequestNumbers {
+  explicit RequestNumbers(const ::Wasm::Common::RequestInfo &request_info)
+      : destination_port(request_info.destination_port),
+        response_code(request_info.response_code) {}
+
+  const absl::AlphaNum destination_port;
+  const absl::AlphaNum response_code;
+};
+
+// Calls fn with the key and value of every request tag. Values of numeric tags
+// point into numbers, and are only valid as long as numbers is.
+template <typename Fn>
+void forEachRequestTag(const ::Wasm::Common::RequestInfo &request_info,
+                       const RequestNumbers &numbers, Fn fn) {
   const auto &operation =
       request_info.request_protocol == ::Wasm::Common::kProtocolGRPC
           ? request_info.request_url_path
           : request_info.request_operation;
+
+  fn(requestOperationKey(), operation);
+  fn(requestProtocolKey(), request_info.request_protocol);
+  fn(serviceAuthenticationPolicyKey(),
+     ::Wasm::Common::AuthenticationPolicyString(
+         request_info.service_auth_policy));
+  fn(destinationServiceNameKey(), request_info.destination_service_name);
+  fn(destinationPortKey(), numbers.destination_port.Piece());
+  fn(responseCodeKey(), numbers.response_code.Piece());
+  fn(sourcePrincipalKey(), request_info.source_principal);
+  fn(destinationPrincipalKey(), request_info.destination_principal);
+}
+
+using TagViews =
+    std::vector<std::pair<opencensus::tags::TagKey, absl::string_view>>;
+
+void recordCount(bool is_outbound, int64_t count, TagViews tags) {
+  opencensus::stats::Record({{is_outbound ? clientRequestCountMeasure()
+                                          : serverRequestCountMeasure(),
+                              count}},
+                            std::move(tags));
+}
+
+// Number of samples that are recorded with one Opencensus record call at most.
+// A record call takes the lock of Opencensus and looks up the tag set once for
+// all measurements it carries.
+constexpr size_t kRecordBatchSize = 32;
+static_assert(kRecordBatchSize == 32,
+              "forEachBatch splits remainders below 32");
+
+// Records samples [0, sizeof...(I)) in one call. Measurements of a measure are
+// recorded in the order of the samples.
+template <size_t... I>
+void recordSampleBatch(bool is_outbound, const Aggregator::Sample *samples,
+                       const TagViews &tags, std::index_sequence<I...>) {
+  using opencensus::stats::Measurement;
+  if (is_outbound) {
+    const auto request_bytes = clientRequestBytesMeasure();
+    const auto response_bytes = clientResponseBytesMeasure();
+    const auto latency_ms = clientRoundtripLatenciesMeasure();
+    opencensus::stats::Record(
+        {Measurement(request_bytes, samples[I].request_bytes)...,
+         Measurement(response_bytes, samples[I].response_bytes)...,
+         Measurement(latency_ms, samples[I].latency_ms)...},
+        tags);
+    return;
+  }
+
+  const auto request_bytes = serverRequestBytesMeasure();
+  const auto response_bytes = serverResponseBytesMeasure();
+  const auto latency_ms = serverResponseLatenciesMeasure();
+  opencensus::stats::Record(
+      {Measurement(request_bytes, samples[I].request_bytes)...,
+       Measurement(response_bytes, samples[I].response_bytes)...,
+       Measurement(latency_ms, samples[I].latency_ms)...},
+      tags);
+}
+
+// Splits n items into batches of kRecordBatchSize items and one batch per set
+// bit of the remainder, and calls fn with the size of each batch, as an
+// std::integral_constant, and the offset of its first item.
+template <typename Fn>
+void forEachBatch(size_t n, Fn fn) {
+  size_t offset = 0;
+  for (; n - offset >= kRecordBatchSize; offset += kRecordBatchSize) {
+    fn(std::integral_constant<size_t, kRecordBatchSize>(), offset);
+  }
+  const size_t left = n - offset;
+  if (left & 16) {
+    fn(std::integral_constant<size_t, 16>(), offset);
+    offset += 16;
+  }
+  if (left & 8) {
+    fn(std::integral_constant<size_t, 8>(), offset);
+    offset += 8;
+  }
+  if (left & 4) {
+    fn(std::integral_constant<size_t, 4>(), offset);
+    offset += 4;
+  }
+  if (left & 2) {
+    fn(std::integral_constant<size_t, 2>(), offset);
+    offset += 2;
+  }
+  if (left & 1) {
+    fn(std::integral_constant<size_t, 1>(), offset);
+  }
+}
+
+// Records samples in arrival order.
+void recordSamples(bool is_outbound,
+                   const std::vector<Aggregator::Sample> &samples,
+                   const TagViews &tags) {
+  forEachBatch(samples.size(), [&](auto size, size_t offset) {
+    recordSampleBatch(is_outbound, samples.data() + offset, tags,
+                      std::make_index_sequence<decltype(size)::value>());
+  });
+}
+
+// Records count merged samples in batches, as recordSamples does, with the
+// values of the cursors of their histograms.
+void recordMergedSamples(bool is_outbound, int64_t count,
+                         LogLinearHistogram::Cursor request_bytes,
+                         LogLinearHistogram::Cursor response_bytes,
+                         LogLinearHistogram::Cursor latency_ms,
+                         const TagViews &tags) {
+  Aggregator::Sample batch[kRecordBatchSize];
+  forEachBatch(count, [&](auto size, size_t) {
+    for (size_t i = 0; i < decltype(size)::value; i++) {
+      batch[i].request_bytes = std::llround(request_bytes.next());
+      batch[i].response_bytes = std::llround(response_bytes.next());
+      batch[i].latency_ms = latency_ms.next();
+    }
+    recordSampleBatch(is_outbound, batch, tags,
+                      std::make_index_sequence<decltype(size)::value>());
+  });
+}
+
+}  // namespace
+
+NodeTags makeNodeTags(bool is_outbound,
+                      const ::wasm::common::NodeInfo &local_node_info,
+                      const ::wasm::common::NodeInfo &peer_node_info) {
+  const auto &source = is_outbound ? local_node_info : peer_node_info;
+  const auto &destination = is_outbound ? peer_node_info : local_node_info;
+  NodeTags node_tags;
+  node_tags.tags = {
+      {meshUIDKey(), local_node_info.mesh_id()},
+      {destinationServiceNamespaceKey(), destination.namespace_()},
+      {sourceWorkloadNameKey(), source.workload_name()},
+      {sourceWorkloadNamespaceKey(), source.namespace_()},
+      {sourceOwnerKey(), source.owner()},
+      {destinationWorkloadNameKey(), destination.workload_name()},
+      {destinationWorkloadNamespaceKey(), destination.namespace_()},
+      {destinationOwnerKey(), destination.owner()},
+  };
+  return node_tags;
+}
+
+void record(bool is_outbound, const NodeTags &node_tags,
+            const ::Wasm::Common::RequestInfo &request_info) {
+  const double latency_ms = latencyMilliseconds(request_info);
+  // Tag values are read during Record.
+  const RequestNumbers numbers(request_info);
+  TagViews tags;
+  tags.reserve(node_tags.tags.size() + kRequestTagCount);
+  for (const auto &tag : node_tags.tags) {
+    tags.emplace_back(tag.first, tag.second);
+  }
+  forEachRequestTag(request_info, numbers,
+                    [&tags](const opencensus::tags::TagKey &key,
+                            absl::string_view value) {
+                      tags.emplace_back(key, value);
+                    });
+
   if (is_outbound) {
     opencensus::stats::Record(
         {{clientRequestCountMeasure(), 1},
          {clientRequestBytesMeasure(), request_info.request_size},
          {clientResponseBytesMeasure(), request_info.response_size},
          {clientRoundtripLatenciesMeasure(), latency_ms}},
-        {{meshUIDKey(), local_node_info.mesh_id()},
-         {requestOperationKey(), operation},
-         {requestProtocolKey(), request_info.request_protocol},
-         {serviceAuthenticationPolicyKey(),
-          ::Wasm::Common::AuthenticationPolicyString(
-              request_info.service_auth_policy)},
-         {destinationServiceNameKey(), request_info.destination_service_name},
-         {destinationServiceNamespaceKey(), peer_node_info.namespace_()},
-         {destinationPortKey(), std::to_string(request_info.destination_port)},
-         {responseCodeKey(), std::to_string(request_info.response_code)},
-         {sourcePrincipalKey(), request_info.source_principal},
-         {sourceWorkloadNameKey(), local_node_info.workload_name()},
-         {sourceWorkloadNamespaceKey(), local_node_info.namespace_()},
-         {sourceOwnerKey(), local_node_info.owner()},
-         {destinationPrincipalKey(), request_info.destination_principal},
-         {destinationWorkloadNameKey(), peer_node_info.workload_name()},
-         {destinationWorkloadNamespaceKey(), peer_node_info.namespace_()},
-         {destinationOwnerKey(), peer_node_info.owner()}});
+        std::move(tags));
     return;
   }
 
@@ -64,24 +229,133 @@ void record(bool is_outbound, const ::wasm::common::NodeInfo &local_node_info,
        {serverRequestBytesMeasure(), request_info.request_size},
        {serverResponseBytesMeasure(), request_info.response_size},
        {serverResponseLatenciesMeasure(), latency_ms}},
-      {{meshUIDKey(), local_node_info.mesh_id()},
-       {requestOperationKey(), operation},
-       {requestProtocolKey(), request_info.request_protocol},
-       {serviceAuthenticationPolicyKey(),
-        ::Wasm::Common::AuthenticationPolicyString(
-            request_info.service_auth_policy)},
-       {destinationServiceNameKey(), request_info.destination_service_name},
-       {destinationServiceNamespaceKey(), local_node_info.namespace_()},
-       {destinationPortKey(), std::to_string(request_info.destination_port)},
-       {responseCodeKey(), std::to_string(request_info.response_code)},
-       {sourcePrincipalKey(), request_info.source_principal},
-       {sourceWorkloadNameKey(), peer_node_info.workload_name()},
-       {sourceWorkloadNamespaceKey(), peer_node_info.namespace_()},
-       {sourceOwnerKey(), peer_node_info.owner()},
-       {destinationPrincipalKey(), request_info.destination_principal},
-       {destinationWorkloadNameKey(), local_node_info.workload_name()},
-       {destinationWorkloadNamespaceKey(), local_node_info.namespace_()},
-       {destinationOwnerKey(), local_node_info.owner()}});
+      std::move(tags));
+}
+
+Aggregator::Aggregator(size_t max_samples) : max_samples_(max_samples) {
+  setViewBoundaries(PluginConfig());
+}
+
+void Aggregator::add(bool is_outbound, const NodeTags &node_tags,
+                     const ::Wasm::Common::RequestInfo &request_info) {
+  if (precision_bits_ == 0 && samples_ == max_samples_) {
+    drain();
+  }
+
+  // The key is the direction followed by all tag values. Tag keys are the same
+  // for every request of a direction.
+  key_.clear();
+  key_.push_back(is_outbound ? 'o' : 'i');
+  for (const auto &tag : node_tags.tags) {
+    key_.append(tag.second);
+    key_.push_back('\0');
+  }
+  const RequestNumbers numbers(request_info);
+  forEachRequestTag(request_info, numbers,
+                    [this](const opencensus::tags::TagKey &,
+                           absl::string_view value) {
+                      key_.append(value.data(), value.size());
+                      key_.push_back('\0');
+                    });
+
+  auto it = series_.find(key_);
+  if (it == series_.end()) {
+    Series series(is_outbound, precision_bits_,
+                  is_outbound ? client_boundaries_ : server_boundaries_);
+    series.tags.reserve(node_tags.tags.size() + kRequestTagCount);
+    series.tags.insert(series.tags.end(), node_tags.tags.begin(),
+                       node_tags.tags.end());
+    forEachRequestTag(request_info, numbers,
+                      [&series](const opencensus::tags::TagKey &key,
+                                absl::string_view value) {
+                        series.tags.emplace_back(key, std::string(value));
+                      });
+    it = series_.emplace(key_, std::move(series)).first;
+  }
+
+  auto &series = it->second;
+  series.count++;
+  requests_++;
+  if (precision_bits_ == 0) {
+    series.samples.push_back(Sample{request_info.request_size,
+                                    request_info.response_size,
+                                    latencyMilliseconds(request_info)});
+    samples_++;
+  } else {
+    series.request_bytes.add(request_info.request_size);
+    series.response_bytes.add(request_info.response_size);
+    series.latency_ms.add(latencyMilliseconds(request_info));
+  }
+}
+
+void Aggregator::setHistogramPrecision(int precision_bits,
+                                       const PluginConfig &config) {
+  drain();
+  // Series hold histograms of the previous precision and boundaries.
+  series_.clear();
+  precision_bits_ = precision_bits;
+  setViewBoundaries(config);
+}
+
+void Aggregator::setViewBoundaries(const PluginConfig &config) {
+  server_boundaries_.request_bytes =
+      getViewBucketBoundaries(config, Common::kServerRequestBytesView)
+          .lower_boundaries();
+  server_boundaries_.response_bytes =
+      getViewBucketBoundaries(config, Common::kServerResponseBytesView)
+          .lower_boundaries();
+  server_boundaries_.latency_ms =
+      getViewBucketBoundaries(config, Common::kServerResponseLatenciesView)
+          .lower_boundaries();
+  client_boundaries_.request_bytes =
+      getViewBucketBoundaries(config, Common::kClientRequestBytesView)
+          .lower_boundaries();
+  client_boundaries_.response_bytes =
+      getViewBucketBoundaries(config, Common::kClientResponseBytesView)
+          .lower_boundaries();
+  client_boundaries_.latency_ms =
+      getViewBucketBoundaries(config, Common::kClientRoundtripLatenciesView)
+          .lower_boundaries();
+}
+
+void Aggregator::drain() {
+  for (auto it = series_.begin(); it != series_.end();) {
+    auto &series = it->second;
+    // Series without requests since the previous drain are dropped, so that
+    // the buffer only holds the tag sets that are in use.
+    if (series.count == 0) {
+      it = series_.erase(it);
+      continue;
+    }
+
+    TagViews tags;
+    tags.reserve(series.tags.size());
+    for (const auto &tag : series.tags) {
+      tags.emplace_back(tag.first, tag.second);
+    }
+    recordCount(series.is_outbound, series.count, tags);
+    // Distributions keep every sample, so samples are recorded in the order
+    // they were added.
+    recordSamples(series.is_outbound, series.samples, tags);
+    // Merged samples are recorded with the count, sum, min and max of every
+    // bucket, so the view buckets they fall into are kept.
+    if (precision_bits_ > 0) {
+      recordMergedSamples(
+          series.is_outbound, series.count,
+          LogLinearHistogram::Cursor(series.request_bytes, true),
+          LogLinearHistogram::Cursor(series.response_bytes, true),
+          LogLinearHistogram::Cursor(series.latency_ms, false), tags);
+    }
+
+    series.count = 0;
+    series.samples.clear();
+    series.request_bytes.clear();
+    series.response_bytes.clear();
+    series.latency_ms.clear();
+    ++it;
+  }
+  requests_ = 0;
+  samples_ = 0;
 }
 
 }  // namespace Metric
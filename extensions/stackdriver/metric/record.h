@@ -15,19 +15,137 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "extensions/common/context.h"
+#include "extensions/stackdriver/metric/histogram.h"
+#include "opencensus/stats/tag_key.h"
 #include "extensions/stackdriver/config/v1alpha1/stackdriver_plugin_config.pb.h"
 
 namespace Extensions {
 namespace Stackdriver {
 namespace Metric {
 
-// Record metrics based on local node info and request info.
+// NodeTags holds the metric tag values that only depend on the local and peer
+// node. They are the same for every request with a peer, so they are built
+// once per peer and cached, and requests only add their own tags.
+struct NodeTags {
+  std::vector<std::pair<opencensus::tags::TagKey, std::string>> tags;
+};
+
+// Builds node tags for the local node and a peer node.
+NodeTags makeNodeTags(bool is_outbound,
+                      const ::wasm::common::NodeInfo &local_node_info,
+                      const ::wasm::common::NodeInfo &peer_node_info);
+
+// Record metrics based on node tags and request info.
 // Reporter kind deceides the type of metrics to record.
-void record(bool is_outbound, const ::wasm::common::NodeInfo &local_node_info,
-            const ::wasm::common::NodeInfo &peer_node_info,
+void record(bool is_outbound, const NodeTags &node_tags,
             const ::Wasm::Common::RequestInfo &request_info);
 
+// Aggregator buffers the metrics of the requests handled by a worker and
+// records them into Opencensus on drain, so that recording is taken off the
+// request path and request counts are recorded once per tag set and drain.
+// By default, distribution samples are kept and recorded in batches in arrival
+// order, hence the exported views are the same as with per-request recording.
+// With a histogram precision, samples are merged into local log-linear
+// histograms instead, which bounds the memory of a series by the number of
+// distinct buckets rather than by the number of requests. Samples are only
+// merged within the buckets of their view, and recorded with the count, sum,
+// min and max of every bucket, so that only the sum of squared deviations of
+// the exported views changes, within the precision. Opencensus has no weighted
+// recording, so merged samples are still recorded one value per sample.
+// Aggregator is not thread safe, every worker owns its own.
+class Aggregator {
+ public:
+  // Bounds the number of samples that are kept exactly between drains.
+  static constexpr size_t kDefaultMaxSamples = 10000;
+
+  // Once max_samples samples are kept, buffered metrics are recorded by the
+  // request that adds the next one, which bounds memory and exports the same
+  // values as a drain on tick.
+  explicit Aggregator(size_t max_samples = kDefaultMaxSamples);
+
+  // Sets the number of significant bits that are kept of distribution samples,
+  // see LogLinearHistogram, and merges samples within the buckets of the
+  // distribution views of config. Samples are kept exactly with 0. Buffered
+  // metrics are recorded first.
+  void setHistogramPrecision(
+      int precision_bits,
+      const stackdriver::config::v1alpha1::PluginConfig &config =
+          stackdriver::config::v1alpha1::PluginConfig());
+
+  // Adds the metrics of a request.
+  void add(bool is_outbound, const NodeTags &node_tags,
+           const ::Wasm::Common::RequestInfo &request_info);
+
+  // Records buffered metrics into Opencensus and clears the buffer.
+  void drain();
+
+  // Number of buffered requests.
+  size_t size() const { return requests_; }
+
+  // Distribution values of a request.
+  struct Sample {
+    int64_t request_bytes;
+    int64_t response_bytes;
+    double latency_ms;
+  };
+
+ private:
+  void setViewBoundaries(
+      const stackdriver::config::v1alpha1::PluginConfig &config);
+
+  // Bucket boundaries of the distribution views of a direction.
+  struct ViewBoundaries {
+    std::vector<double> request_bytes;
+    std::vector<double> response_bytes;
+    std::vector<double> latency_ms;
+  };
+
+  // Metrics of the requests with the same tag set.
+  struct Series {
+    Series(bool is_outbound, int precision_bits,
+           const ViewBoundaries &boundaries)
+        : is_outbound(is_outbound),
+          request_bytes(precision_bits, boundaries.request_bytes),
+          response_bytes(precision_bits, boundaries.response_bytes),
+          latency_ms(precision_bits, boundaries.latency_ms) {}
+
+    bool is_outbound;
+    std::vector<std::pair<opencensus::tags::TagKey, std::string>> tags;
+    int64_t count = 0;
+    // Samples in arrival order, if samples are kept exactly.
+    std::vector<Sample> samples;
+    // Merged samples otherwise.
+    LogLinearHistogram request_bytes;
+    LogLinearHistogram response_bytes;
+    LogLinearHistogram latency_ms;
+  };
+
+  // Series by direction and tag values.
+  std::unordered_map<std::string, Series> series_;
+
+  // Scratch buffer for series keys.
+  std::string key_;
+
+  size_t requests_ = 0;
+
+  // Number of samples kept exactly since the previous drain.
+  size_t samples_ = 0;
+
+  const size_t max_samples_;
+
+  int precision_bits_ = 0;
+
+  ViewBoundaries server_boundaries_;
+  ViewBoundaries client_boundaries_;
+};
+
 }  // namespace Metric
 }  // namespace Stackdriver
 }  // namespace Extensions
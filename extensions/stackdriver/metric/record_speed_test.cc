@@ -0,0 +1,117 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+#include "extensions/stackdriver/metric/record.h"
+#include "extensions/stackdriver/metric/registry.h"
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Metric {
+namespace {
+
+wasm::common::NodeInfo nodeInfo(const std::string& workload) {
+  wasm::common::NodeInfo node_info;
+  node_info.set_name(workload + "-84975bc778-pxz2w");
+  node_info.set_namespace_("default");
+  node_info.set_workload_name(workload);
+  node_info.set_owner(
+      "kubernetes://apis/apps/v1/namespaces/default/deployments/" + workload);
+  node_info.set_mesh_id("test-mesh");
+  return node_info;
+}
+
+::Wasm::Common::RequestInfo requestInfo() {
+  ::Wasm::Common::RequestInfo request_info;
+  request_info.start_timestamp = 1000000;
+  request_info.end_timestamp = 3000000;
+  request_info.request_protocol = "http";
+  request_info.request_operation = "GET";
+  request_info.destination_service_name = "ratings";
+  request_info.destination_port = 9080;
+  request_info.response_code = 200;
+  request_info.request_size = 512;
+  request_info.response_size = 1024;
+  request_info.source_principal =
+      "spiffe://cluster.local/ns/default/sa/bookinfo-productpage";
+  request_info.destination_principal =
+      "spiffe://cluster.local/ns/default/sa/bookinfo-ratings";
+  request_info.service_auth_policy =
+      ::Wasm::Common::ServiceAuthenticationPolicy::MutualTLS;
+  return request_info;
+}
+
+void registerViewsOnce() {
+  static bool registered = [] {
+    registerViews();
+    return true;
+  }();
+  (void)registered;
+}
+
+// Builds the tags that depend on the local and peer node. Paid once per peer.
+static void BM_MakeNodeTags(benchmark::State& state) {
+  const auto local_node_info = nodeInfo("productpage-v1");
+  const auto peer_node_info = nodeInfo("ratings-v1");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        makeNodeTags(state.range(0), local_node_info, peer_node_info));
+  }
+}
+BENCHMARK(BM_MakeNodeTags)->Arg(0)->Arg(1);
+
+// Records a request with node tags from the peer cache, which is the steady
+// state of the plugin.
+static void BM_RecordCachedNodeTags(benchmark::State& state) {
+  registerViewsOnce();
+  const bool is_outbound = state.range(0);
+  const auto node_tags = makeNodeTags(is_outbound, nodeInfo("productpage-v1"),
+                                      nodeInfo("ratings-v1"));
+  const auto request_info = requestInfo();
+  for (auto _ : state) {
+    record(is_outbound, node_tags, request_info);
+  }
+}
+BENCHMARK(BM_RecordCachedNodeTags)->Arg(0)->Arg(1);
+
+// Builds all tags for every request, as the plugin did without the cache.
+static void BM_RecordUncachedNodeTags(benchmark::State& state) {
+  registerViewsOnce();
+  const bool is_outbound = state.range(0);
+  const auto local_node_info = nodeInfo("productpage-v1");
+  const auto peer_node_info = nodeInfo("ratings-v1");
+  const auto request_info = requestInfo();
+  for (auto _ : state) {
+    record(is_outbound,
+           makeNodeTags(is_outbound, local_node_info, peer_node_info),
+           request_info);
+  }
+}
+BENCHMARK(BM_RecordUncachedNodeTags)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace Metric
+}  // namespace Stackdriver
+}  // namespace Extensions
+
+// Boilerplate main(), which discovers benchmarks in the same file and runs
+// them.
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+}
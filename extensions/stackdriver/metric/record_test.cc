@@ -0,0 +1,419 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "extensions/stackdriver/metric/record.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "extensions/stackdriver/common/constants.h"
+#include "extensions/stackdriver/metric/registry.h"
+#include "gtest/gtest.h"
+#include "opencensus/stats/testing/test_utils.h"
+
+namespace Extensions {
+namespace Stackdriver {
+namespace Metric {
+
+using opencensus::stats::View;
+using opencensus::stats::ViewData;
+using stackdriver::config::v1alpha1::PluginConfig;
+
+struct Request {
+  bool is_outbound;
+  NodeTags node_tags;
+  ::Wasm::Common::RequestInfo request_info;
+};
+
+wasm::common::NodeInfo nodeInfo(const std::string &workload) {
+  wasm::common::NodeInfo node_info;
+  node_info.set_namespace_("default");
+  node_info.set_workload_name(workload);
+  node_info.set_mesh_id("test-mesh");
+  return node_info;
+}
+
+// Requests of both directions over a few peers and response codes, with
+// varying sizes and latencies from base_latency_nanos up.
+std::vector<Request> testRequests(int64_t base_latency_nanos = 0,
+                                  int64_t latency_step_nanos = 1234567) {
+  const auto local_node_info = nodeInfo("productpage-v1");
+  std::vector<Request> requests;
+  for (int i = 0; i < 200; i++) {
+    Request request;
+    request.is_outbound = i % 2;
+    request.node_tags = makeNodeTags(
+        request.is_outbound, local_node_info,
+        nodeInfo(i % 3 ? "ratings-v1" : "reviews-v" + std::to_string(i % 5)));
+    auto &request_info = request.request_info;
+    request_info.start_timestamp = 1000000;
+    request_info.end_timestamp =
+        1000000 + base_latency_nanos + latency_step_nanos * (i % 17);
+    request_info.request_protocol = i % 4 ? "http" : "grpc";
+    request_info.request_operation = "GET";
+    request_info.request_url_path = "/ratings.Ratings/Get";
+    request_info.destination_service_name = "ratings";
+    request_info.destination_port = 9080;
+    request_info.response_code = i % 7 ? 200 : 503;
+    request_info.request_size = 100 * i;
+    request_info.response_size = 37 * i + 5;
+    request_info.service_auth_policy =
+        ::Wasm::Common::ServiceAuthenticationPolicy::MutualTLS;
+    requests.push_back(std::move(request));
+  }
+  return requests;
+}
+
+// Returns the data of the views of config after recording with record_fn.
+// Views only hold data recorded after they are created.
+template <typename RecordFn>
+std::vector<ViewData> recordViews(RecordFn record_fn,
+                                  const PluginConfig &config = PluginConfig()) {
+  std::vector<std::unique_ptr<View>> views;
+  for (const auto &view_descriptor : viewDescriptors(config)) {
+    views.push_back(std::make_unique<View>(view_descriptor));
+  }
+  record_fn();
+  opencensus::stats::testing::TestUtils::Flush();
+  std::vector<ViewData> data;
+  for (const auto &view : views) {
+    data.push_back(view->GetData());
+  }
+  return data;
+}
+
+void expectSameData(const ViewData &expected, const ViewData &actual) {
+  ASSERT_EQ(expected.type(), actual.type());
+  switch (expected.type()) {
+    case ViewData::Type::kInt64:
+      EXPECT_EQ(expected.int_data(), actual.int_data());
+      break;
+    case ViewData::Type::kDouble:
+      EXPECT_EQ(expected.double_data(), actual.double_data());
+      break;
+    case ViewData::Type::kDistribution:
+      ASSERT_EQ(expected.distribution_data().size(),
+                actual.distribution_data().size());
+      for (const auto &row : expected.distribution_data()) {
+        auto it = actual.distribution_data().find(row.first);
+        ASSERT_NE(it, actual.distribution_data().end());
+        EXPECT_EQ(row.second.count(), it->second.count());
+        EXPECT_EQ(row.second.mean(), it->second.mean());
+        EXPECT_EQ(row.second.sum_of_squared_deviation(),
+                  it->second.sum_of_squared_deviation());
+        EXPECT_EQ(row.second.min(), it->second.min());
+        EXPECT_EQ(row.second.max(), it->second.max());
+        EXPECT_EQ(row.second.bucket_counts(), it->second.bucket_counts());
+      }
+      break;
+  }
+}
+
+bool isEmpty(const ViewData &view_data) {
+  switch (view_data.type()) {
+    case ViewData::Type::kInt64:
+      return view_data.int_data().empty();
+    case ViewData::Type::kDouble:
+      return view_data.double_data().empty();
+    case ViewData::Type::kDistribution:
+      return view_data.distribution_data().empty();
+  }
+  return true;
+}
+
+class RecordTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() { registerViews(); }
+};
+
+// Aggregated recording exports the same values as per-request recording.
+TEST_F(RecordTest, AggregatorExportsSameData) {
+  const auto requests = testRequests();
+  const auto expected = recordViews([&requests] {
+    for (const auto &request : requests) {
+      record(request.is_outbound, request.node_tags, request.request_info);
+    }
+  });
+  const auto actual = recordViews([&requests] {
+    Aggregator aggregator;
+    for (const auto &request : requests) {
+      aggregator.add(request.is_outbound, request.node_tags,
+                     request.request_info);
+    }
+    EXPECT_EQ(aggregator.size(), requests.size());
+    aggregator.drain();
+  });
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    expectSameData(expected[i], actual[i]);
+  }
+
+  // Request counts, server and client, add up to the number of requests.
+  int64_t count = 0;
+  for (const auto &view_data : {actual[0], actual[4]}) {
+    ASSERT_EQ(view_data.type(), ViewData::Type::kInt64);
+    for (const auto &row : view_data.int_data()) {
+      count += row.second;
+    }
+  }
+  EXPECT_EQ(count, static_cast<int64_t>(requests.size()));
+}
+
+// Expects the same data, except for sums of squared deviations of
+// distributions, as merged samples are moved by up to 2^-8 of their value
+// within their bucket, and means, which are computed in another order.
+void expectMergedData(const ViewData &expected, const ViewData &actual) {
+  ASSERT_EQ(expected.type(), actual.type());
+  if (expected.type() != ViewData::Type::kDistribution) {
+    expectSameData(expected, actual);
+    return;
+  }
+  const auto &expected_rows = expected.distribution_data();
+  const auto &actual_rows = actual.distribution_data();
+  ASSERT_EQ(expected_rows.size(), actual_rows.size());
+  for (const auto &row : expected_rows) {
+    auto it = actual_rows.find(row.first);
+    ASSERT_NE(it, actual_rows.end());
+    const auto &distribution = row.second;
+    EXPECT_EQ(distribution.count(), it->second.count());
+    EXPECT_EQ(distribution.bucket_counts(), it->second.bucket_counts());
+    EXPECT_EQ(distribution.min(), it->second.min());
+    EXPECT_EQ(distribution.max(), it->second.max());
+    EXPECT_NEAR(distribution.mean(), it->second.mean(),
+                std::fabs(distribution.mean()) * 1e-12);
+    // Moving a sample x by d changes its squared deviation by at most
+    // 2|d||x - mean| + d^2.
+    const double max_move =
+        std::max(std::fabs(distribution.min()), std::fabs(distribution.max())) /
+        256;
+    const double range = distribution.max() - distribution.min();
+    EXPECT_NEAR(distribution.sum_of_squared_deviation(),
+                it->second.sum_of_squared_deviation(),
+                distribution.count() *
+                    (2 * max_move * range + max_move * max_move));
+  }
+}
+
+// Merged samples keep request counts, and the counts, sums, bounds and bucket
+// counts of distributions.
+TEST_F(RecordTest, AggregatorHistogramPrecision) {
+  const auto requests = testRequests();
+  const auto expected = recordViews([&requests] {
+    for (const auto &request : requests) {
+      record(request.is_outbound, request.node_tags, request.request_info);
+    }
+  });
+  const auto actual = recordViews([&requests] {
+    Aggregator aggregator;
+    aggregator.setHistogramPrecision(8);
+    for (const auto &request : requests) {
+      aggregator.add(request.is_outbound, request.node_tags,
+                     request.request_info);
+    }
+    aggregator.drain();
+  });
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    expectMergedData(expected[i], actual[i]);
+  }
+}
+
+// Buckets that hold more samples than a record call carries are recorded with
+// their full counts.
+TEST_F(RecordTest, AggregatorHistogramLargeBuckets) {
+  std::vector<Request> requests;
+  for (const auto &request : testRequests()) {
+    for (int i = 0; i < 45; i++) {
+      requests.push_back(request);
+    }
+  }
+  const auto expected = recordViews([&requests] {
+    for (const auto &request : requests) {
+      record(request.is_outbound, request.node_tags, request.request_info);
+    }
+  });
+  const auto actual = recordViews([&requests] {
+    Aggregator aggregator;
+    aggregator.setHistogramPrecision(8);
+    for (const auto &request : requests) {
+      aggregator.add(request.is_outbound, request.node_tags,
+                     request.request_info);
+    }
+    aggregator.drain();
+  });
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    expectMergedData(expected[i], actual[i]);
+  }
+}
+
+// Once the limit of kept samples is reached, buffered metrics are recorded
+// early, which exports the same values.
+TEST_F(RecordTest, AggregatorLimitDrainsEarly) {
+  const auto requests = testRequests();
+  const auto expected = recordViews([&requests] {
+    for (const auto &request : requests) {
+      record(request.is_outbound, request.node_tags, request.request_info);
+    }
+  });
+  const auto actual = recordViews([&requests] {
+    Aggregator aggregator(50);
+    for (const auto &request : requests) {
+      aggregator.add(request.is_outbound, request.node_tags,
+                     request.request_info);
+    }
+    EXPECT_EQ(aggregator.size(), 50u);
+    aggregator.drain();
+  });
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    expectSameData(expected[i], actual[i]);
+  }
+}
+
+// Latency boundaries at 1s and 5s, and request size boundaries at 5000 and
+// 10000 bytes, none of which are powers of two.
+PluginConfig explicitBucketsConfig() {
+  PluginConfig config;
+  for (const auto *view : {Common::kServerResponseLatenciesView,
+                           Common::kClientRoundtripLatenciesView}) {
+    auto *bounds = (*config.mutable_distribution_buckets())[view]
+                       .mutable_explicit_buckets()
+                       ->mutable_bounds();
+    bounds->Add(1000);
+    bounds->Add(5000);
+  }
+  for (const auto *view :
+       {Common::kServerRequestBytesView, Common::kClientRequestBytesView}) {
+    auto *bounds = (*config.mutable_distribution_buckets())[view]
+                       .mutable_explicit_buckets()
+                       ->mutable_bounds();
+    bounds->Add(5000);
+    bounds->Add(10000);
+  }
+  return config;
+}
+
+// Returns the bucket counts of all rows of a distribution view, added up.
+std::vector<int64_t> bucketCounts(const ViewData &view_data) {
+  std::vector<int64_t> counts;
+  for (const auto &row : view_data.distribution_data()) {
+    const auto &row_counts = row.second.bucket_counts();
+    counts.resize(row_counts.size());
+    for (size_t i = 0; i < row_counts.size(); i++) {
+      counts[i] += row_counts[i];
+    }
+  }
+  return counts;
+}
+
+// Exact samples keep the bucket counts of explicit boundaries, with latencies
+// from 4.99s to 5.006s around the 5s boundary.
+TEST_F(RecordTest, AggregatorExplicitBuckets) {
+  const auto config = explicitBucketsConfig();
+  const auto requests = testRequests(4990000000, 1000000);
+  const auto expected = recordViews(
+      [&requests] {
+        for (const auto &request : requests) {
+          record(request.is_outbound, request.node_tags,
+                 request.request_info);
+        }
+      },
+      config);
+  const auto actual = recordViews(
+      [&requests] {
+        Aggregator aggregator(50);
+        for (const auto &request : requests) {
+          aggregator.add(request.is_outbound, request.node_tags,
+                         request.request_info);
+        }
+        aggregator.drain();
+      },
+      config);
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    expectSameData(expected[i], actual[i]);
+  }
+  // 7 of the 17 latencies are at or above 5s, and request sizes go up to
+  // 19800 bytes.
+  EXPECT_EQ(bucketCounts(actual[3]), std::vector<int64_t>({0, 60, 40}));
+  EXPECT_EQ(bucketCounts(actual[5]), std::vector<int64_t>({25, 25, 50}));
+}
+
+// Merged samples keep the bucket counts of explicit boundaries, with
+// latencies from 4.99s to 5.006s, which fall into the same 8 bit log-linear
+// bucket on both sides of the 5s boundary.
+TEST_F(RecordTest, AggregatorHistogramExplicitBuckets) {
+  const auto config = explicitBucketsConfig();
+  const auto requests = testRequests(4990000000, 1000000);
+  const auto expected = recordViews(
+      [&requests] {
+        for (const auto &request : requests) {
+          record(request.is_outbound, request.node_tags,
+                 request.request_info);
+        }
+      },
+      config);
+  const auto actual = recordViews(
+      [&requests, &config] {
+        Aggregator aggregator;
+        aggregator.setHistogramPrecision(8, config);
+        for (const auto &request : requests) {
+          aggregator.add(request.is_outbound, request.node_tags,
+                         request.request_info);
+        }
+        aggregator.drain();
+      },
+      config);
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    expectMergedData(expected[i], actual[i]);
+  }
+  EXPECT_EQ(bucketCounts(actual[3]), std::vector<int64_t>({0, 60, 40}));
+  EXPECT_EQ(bucketCounts(actual[5]), std::vector<int64_t>({25, 25, 50}));
+}
+
+// Nothing is recorded until drain, and a drain records every request once.
+TEST_F(RecordTest, AggregatorDrain) {
+  const auto requests = testRequests();
+  Aggregator aggregator;
+  const auto buffered = recordViews([&] {
+    for (const auto &request : requests) {
+      aggregator.add(request.is_outbound, request.node_tags,
+                     request.request_info);
+    }
+  });
+  for (const auto &view_data : buffered) {
+    EXPECT_TRUE(isEmpty(view_data));
+  }
+
+  aggregator.drain();
+  EXPECT_EQ(aggregator.size(), 0u);
+  const auto drained = recordViews([&aggregator] { aggregator.drain(); });
+  for (const auto &view_data : drained) {
+    EXPECT_TRUE(isEmpty(view_data));
+  }
+}
+
+}  // namespace Metric
+}  // namespace Stackdriver
+}  // namespace Extensions
@@ -15,6 +15,9 @@
 
 #include "extensions/stackdriver/metric/registry.h"
 
+#include <algorithm>
+#include <functional>
+
 #include "extensions/stackdriver/common/constants.h"
 #include "extensions/stackdriver/common/utils.h"
 #include "google/api/monitored_resource.pb.h"
@@ -27,6 +30,8 @@ namespace Metric {
 using namespace Extensions::Stackdriver::Common;
 using namespace opencensus::exporters::stats;
 using namespace opencensus::stats;
+using stackdriver::config::v1alpha1::DistributionBuckets;
+using stackdriver::config::v1alpha1::PluginConfig;
 using wasm::common::NodeInfo;
 
 // Gets opencensus stackdriver exporter options.
@@ -80,30 +85,76 @@ StackdriverOptions getStackdriverOptions(
   return options;
 }
 
+bool getBucketBoundaries(const DistributionBuckets &buckets,
+                         BucketBoundaries *boundaries) {
+  switch (buckets.buckets_case()) {
+    case DistributionBuckets::kExponential: {
+      const auto &exponential = buckets.exponential();
+      if (exponential.num_finite_buckets() <= 0 || exponential.scale() <= 0 ||
+          exponential.growth_factor() <= 1) {
+        return false;
+      }
+      *boundaries = BucketBoundaries::Exponential(
+          exponential.num_finite_buckets(), exponential.scale(),
+          exponential.growth_factor());
+      return true;
+    }
+    case DistributionBuckets::kLinear: {
+      const auto &linear = buckets.linear();
+      if (linear.num_finite_buckets() <= 0 || linear.width() <= 0) {
+        return false;
+      }
+      *boundaries = BucketBoundaries::Linear(linear.num_finite_buckets(),
+                                             linear.offset(), linear.width());
+      return true;
+    }
+    case DistributionBuckets::kExplicitBuckets: {
+      const auto &bounds = buckets.explicit_buckets().bounds();
+      if (bounds.empty() ||
+          std::adjacent_find(bounds.begin(), bounds.end(),
+                             std::greater_equal<double>()) != bounds.end()) {
+        return false;
+      }
+      *boundaries = BucketBoundaries::Explicit(
+          std::vector<double>(bounds.begin(), bounds.end()));
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+BucketBoundaries getViewBucketBoundaries(const PluginConfig &config,
+                                         const std::string &view_name) {
+  auto boundaries = BucketBoundaries::Exponential(20, 1, 2);
+  auto iter = config.distribution_buckets().find(view_name);
+  if (iter != config.distribution_buckets().end()) {
+    getBucketBoundaries(iter->second, &boundaries);
+  }
+  return boundaries;
+}
+
 /*
  *  view function macros
  */
-#define REGISTER_COUNT_VIEW(_v)                              \
-  void register##_v##View() {                                \
-    const ViewDescriptor view_descriptor =                   \
-        ViewDescriptor()                                     \
-            .set_name(k##_v##View)                           \
-            .set_measure(k##_v##Measure)                     \
-            .set_aggregation(Aggregation::Count()) ADD_TAGS; \
-    View view(view_descriptor);                              \
-    view_descriptor.RegisterForExport();                     \
+// Request counts are recorded as a sum, so that pre-aggregated counts can be
+// recorded at once. Per-request recording of 1 exports the same values as a
+// count aggregation.
+#define COUNT_VIEW(_v)                                           \
+  ViewDescriptor get##_v##ViewDescriptor(const PluginConfig &) { \
+    return ViewDescriptor()                                      \
+        .set_name(k##_v##View)                                   \
+        .set_measure(k##_v##Measure)                             \
+        .set_aggregation(Aggregation::Sum()) ADD_TAGS;           \
   }
 
-#define REGISTER_DISTRIBUTION_VIEW(_v)                              \
-  void register##_v##View() {                                       \
-    const ViewDescriptor view_descriptor =                          \
-        ViewDescriptor()                                            \
-            .set_name(k##_v##View)                                  \
-            .set_measure(k##_v##Measure)                            \
-            .set_aggregation(Aggregation::Distribution(             \
-                BucketBoundaries::Exponential(20, 1, 2))) ADD_TAGS; \
-    View view(view_descriptor);                                     \
-    view_descriptor.RegisterForExport();                            \
+#define DISTRIBUTION_VIEW(_v)                                          \
+  ViewDescriptor get##_v##ViewDescriptor(const PluginConfig &config) { \
+    return ViewDescriptor()                                            \
+        .set_name(k##_v##View)                                         \
+        .set_measure(k##_v##Measure)                                   \
+        .set_aggregation(Aggregation::Distribution(                    \
+            getViewBucketBoundaries(config, k##_v##View))) ADD_TAGS;   \
   }
 
 #define ADD_TAGS                                     \
@@ -124,15 +175,28 @@ StackdriverOptions getStackdriverOptions(
       .add_column(destinationWorkloadNamespaceKey()) \
       .add_column(destinationOwnerKey())
 
-// Functions to register opencensus views to export.
-REGISTER_COUNT_VIEW(ServerRequestCount)
-REGISTER_DISTRIBUTION_VIEW(ServerRequestBytes)
-REGISTER_DISTRIBUTION_VIEW(ServerResponseBytes)
-REGISTER_DISTRIBUTION_VIEW(ServerResponseLatencies)
-REGISTER_COUNT_VIEW(ClientRequestCount)
-REGISTER_DISTRIBUTION_VIEW(ClientRequestBytes)
-REGISTER_DISTRIBUTION_VIEW(ClientResponseBytes)
-REGISTER_DISTRIBUTION_VIEW(ClientRoundtripLatencies)
+// View descriptor functions.
+COUNT_VIEW(ServerRequestCount)
+DISTRIBUTION_VIEW(ServerRequestBytes)
+DISTRIBUTION_VIEW(ServerResponseBytes)
+DISTRIBUTION_VIEW(ServerResponseLatencies)
+COUNT_VIEW(ClientRequestCount)
+DISTRIBUTION_VIEW(ClientRequestBytes)
+DISTRIBUTION_VIEW(ClientResponseBytes)
+DISTRIBUTION_VIEW(ClientRoundtripLatencies)
+
+std::vector<ViewDescriptor> viewDescriptors(const PluginConfig &config) {
+  return {
+      getServerRequestCountViewDescriptor(config),
+      getServerRequestBytesViewDescriptor(config),
+      getServerResponseBytesViewDescriptor(config),
+      getServerResponseLatenciesViewDescriptor(config),
+      getClientRequestCountViewDescriptor(config),
+      getClientRequestBytesViewDescriptor(config),
+      getClientResponseBytesViewDescriptor(config),
+      getClientRoundtripLatenciesViewDescriptor(config),
+  };
+}
 
 /*
  * measure function macros
@@ -154,7 +218,7 @@ MEASURE_FUNC(clientRequestBytes, ClientRequestBytes, By, Int64)
 MEASURE_FUNC(clientResponseBytes, ClientResponseBytes, By, Int64)
 MEASURE_FUNC(clientRoundtripLatencies, ClientRoundtripLatencies, ms, Double)
 
-void registerViews() {
+void registerViews(const PluginConfig &config) {
   // Register measure first, which views depend on.
   serverRequestCountMeasure();
   serverRequestBytesMeasure();
@@ -166,14 +230,9 @@ void registerViews() {
   clientRoundtripLatenciesMeasure();
 
   // Register views to export;
-  registerServerRequestCountView();
-  registerServerRequestBytesView();
-  registerServerResponseBytesView();
-  registerServerResponseLatenciesView();
-  registerClientRequestCountView();
-  registerClientRequestBytesView();
-  registerClientResponseBytesView();
-  registerClientRoundtripLatenciesView();
+  for (const auto &view_descriptor : viewDescriptors(config)) {
+    view_descriptor.RegisterForExport();
+  }
 }
 
 /*
@@ -16,6 +16,7 @@
 #pragma once
 
 #include "extensions/common/context.h"
+#include "extensions/stackdriver/config/v1alpha1/stackdriver_plugin_config.pb.h"
 
 // OpenCensus is full of unused parameters in metric_service.
 #pragma GCC diagnostic push
@@ -24,8 +25,10 @@
 #pragma GCC diagnostic pop
 
 #include "opencensus/stats/measure.h"
+#include "opencensus/stats/bucket_boundaries.h"
 #include "opencensus/stats/stats.h"
 #include "opencensus/stats/tag_key.h"
+#include "opencensus/stats/view_descriptor.h"
 
 namespace Extensions {
 namespace Stackdriver {
@@ -37,7 +40,25 @@ opencensus::exporters::stats::StackdriverOptions getStackdriverOptions(
     const std::string& test_monitoring_endpoint = "");
 
 // registers Opencensus views
-void registerViews();
+void registerViews(const stackdriver::config::v1alpha1::PluginConfig &config =
+                       stackdriver::config::v1alpha1::PluginConfig());
+
+// Returns descriptors of the Opencensus views registered for export.
+std::vector<opencensus::stats::ViewDescriptor> viewDescriptors(
+    const stackdriver::config::v1alpha1::PluginConfig &config =
+        stackdriver::config::v1alpha1::PluginConfig());
+
+// Converts configured bucket boundaries of a distribution view. Returns false
+// if they are invalid.
+bool getBucketBoundaries(
+    const stackdriver::config::v1alpha1::DistributionBuckets &buckets,
+    opencensus::stats::BucketBoundaries *boundaries);
+
+// Gets bucket boundaries of a distribution view, which are the configured
+// ones if they are valid.
+opencensus::stats::BucketBoundaries getViewBucketBoundaries(
+    const stackdriver::config::v1alpha1::PluginConfig &config,
+    const std::string &view_name);
 
 // Opencensus tag key functions.
 opencensus::tags::TagKey requestOperationKey();
@@ -115,6 +115,65 @@ TEST(RegistryTest, getStackdriverOptionsMonitoredResource) {
                                  expected_client_monitored_resource));
 }
 
+TEST(RegistryTest, getBucketBoundaries) {
+  using stackdriver::config::v1alpha1::DistributionBuckets;
+  opencensus::stats::BucketBoundaries boundaries =
+      opencensus::stats::BucketBoundaries::Explicit({});
+
+  DistributionBuckets buckets;
+  EXPECT_FALSE(getBucketBoundaries(buckets, &boundaries));
+
+  auto* exponential = buckets.mutable_exponential();
+  exponential->set_num_finite_buckets(3);
+  exponential->set_scale(0.5);
+  exponential->set_growth_factor(4);
+  ASSERT_TRUE(getBucketBoundaries(buckets, &boundaries));
+  EXPECT_EQ(boundaries.lower_boundaries(),
+            std::vector<double>({0.5, 2, 8, 32}));
+  exponential->set_growth_factor(1);
+  EXPECT_FALSE(getBucketBoundaries(buckets, &boundaries));
+
+  auto* linear = buckets.mutable_linear();
+  linear->set_num_finite_buckets(2);
+  linear->set_offset(10);
+  linear->set_width(5);
+  ASSERT_TRUE(getBucketBoundaries(buckets, &boundaries));
+  EXPECT_EQ(boundaries.lower_boundaries(), std::vector<double>({10, 15, 20}));
+  linear->set_width(0);
+  EXPECT_FALSE(getBucketBoundaries(buckets, &boundaries));
+
+  auto* bounds = buckets.mutable_explicit_buckets()->mutable_bounds();
+  EXPECT_FALSE(getBucketBoundaries(buckets, &boundaries));
+  bounds->Add(1);
+  bounds->Add(10);
+  bounds->Add(100);
+  ASSERT_TRUE(getBucketBoundaries(buckets, &boundaries));
+  EXPECT_EQ(boundaries.lower_boundaries(), std::vector<double>({1, 10, 100}));
+  bounds->Add(100);
+  EXPECT_FALSE(getBucketBoundaries(buckets, &boundaries));
+}
+
+TEST(RegistryTest, viewDescriptorsBucketBoundaries) {
+  stackdriver::config::v1alpha1::PluginConfig config;
+  auto& buckets = (*config.mutable_distribution_buckets())
+      [Common::kServerResponseLatenciesView];
+  for (double bound : {5, 10, 25, 50, 100, 250, 500, 1000}) {
+    buckets.mutable_explicit_buckets()->add_bounds(bound);
+  }
+
+  for (const auto& view_descriptor : viewDescriptors(config)) {
+    const auto& aggregation = view_descriptor.aggregation();
+    if (view_descriptor.name() == Common::kServerResponseLatenciesView) {
+      EXPECT_EQ(aggregation.bucket_boundaries().lower_boundaries(),
+                std::vector<double>({5, 10, 25, 50, 100, 250, 500, 1000}));
+    } else if (aggregation.type() ==
+               opencensus::stats::Aggregation::Type::kDistribution) {
+      EXPECT_EQ(aggregation.bucket_boundaries(),
+                opencensus::stats::BucketBoundaries::Exponential(20, 1, 2));
+    }
+  }
+}
+
 }  // namespace Metric
 }  // namespace Stackdriver
 }  // namespace Extensions
@@ -21,6 +21,7 @@
 #include <string>
 #include <unordered_map>
 
+#include "extensions/stackdriver/common/spill_buffer.h"
 #include "extensions/stackdriver/edges/mesh_edges_service_client.h"
 #include "extensions/stackdriver/log/exporter.h"
 #include "extensions/stackdriver/metric/registry.h"
@@ -46,8 +47,10 @@ using namespace ::Extensions::Stackdriver::Common;
 using namespace ::Extensions::Stackdriver::Metric;
 using Envoy::Extensions::Common::Wasm::Null::Plugin::getStringValue;
 using ::Extensions::Stackdriver::Edges::EdgeReporter;
+using ::Extensions::Stackdriver::Edges::EdgeSet;
 using Extensions::Stackdriver::Edges::MeshEdgesServiceClientImpl;
 using Extensions::Stackdriver::Log::ExporterImpl;
+using Extensions::Stackdriver::Log::LoggingServiceClientImpl;
 using ::Extensions::Stackdriver::Log::Logger;
 using stackdriver::config::v1alpha1::PluginConfig;
 using ::Wasm::Common::kDownstreamMetadataIdKey;
@@ -55,12 +58,43 @@ using ::Wasm::Common::kDownstreamMetadataKey;
 using ::Wasm::Common::kUpstreamMetadataIdKey;
 using ::Wasm::Common::kUpstreamMetadataKey;
 using ::wasm::common::NodeInfo;
+using ::Wasm::Common::NodeInfoPtr;
 using ::Wasm::Common::RequestInfo;
 
 constexpr char kStackdriverExporter[] = "stackdriver_exporter";
 constexpr char kExporterRegistered[] = "registered";
-constexpr int kDefaultLogExportMilliseconds = 10000;                      // 10s
-constexpr long int kDefaultEdgeReportDurationNanoseconds = 600000000000;  // 10m
+constexpr int kDefaultLogExportMilliseconds = 10000;                     // 10s
+constexpr long int kDefaultEdgeReportDurationNanoseconds = 60000000000;  // 1m
+constexpr long int kDefaultEdgeSnapshotDurationNanoseconds =
+    600000000000;  // 10m
+constexpr int32_t kMaxHistogramPrecisionBits = 32;
+// Export requests are retried on tick, so backoff starts at the tick period.
+constexpr int64_t kExportInitialBackoffMilliseconds = 10000;  // 10s
+constexpr int64_t kExportMaxBackoffMilliseconds = 300000;     // 5m
+constexpr int64_t kDefaultLogSpillBytes = 64 * 1024 * 1024;  // 64MiB
+// Every worker claims one spill file, so this bounds the number of workers
+// with a spill file.
+constexpr int kMaxLogSpillFiles = 64;
+
+// Request info fields read by metric recording.
+constexpr ::Wasm::Common::RequestInfoFields kMetricRequestInfoFields =
+    ::Wasm::Common::kEndTimestampField | ::Wasm::Common::kResponseCodeField |
+    ::Wasm::Common::kRequestProtocolField |
+    ::Wasm::Common::kRequestOperationField |
+    ::Wasm::Common::kRequestUrlPathField |
+    ::Wasm::Common::kDestinationServiceNameField |
+    ::Wasm::Common::kDestinationPortField | ::Wasm::Common::kPrincipalsField |
+    ::Wasm::Common::kServiceAuthPolicyField;
+
+// Additional request info fields read by access logging.
+constexpr ::Wasm::Common::RequestInfoFields kLogRequestInfoFields =
+    ::Wasm::Common::kDestinationServiceHostField |
+    ::Wasm::Common::kResponseFlagField;
+
+// Request info fields read by edge reporting.
+constexpr ::Wasm::Common::RequestInfoFields kEdgeRequestInfoFields =
+    ::Wasm::Common::kRequestProtocolField |
+    ::Wasm::Common::kDestinationServiceNameField;
 
 namespace {
 
@@ -118,24 +152,85 @@ bool StackdriverRootContext::onConfigure(
     return false;
   }
 
+  for (const auto& buckets : config_.distribution_buckets()) {
+    opencensus::stats::BucketBoundaries boundaries =
+        opencensus::stats::BucketBoundaries::Explicit({});
+    if (!getBucketBoundaries(buckets.second, &boundaries)) {
+      logWarn("invalid distribution buckets of view " + buckets.first);
+      return false;
+    }
+  }
+  const int32_t precision_bits = config_.local_histogram_precision_bits();
+  if (precision_bits < 0 || precision_bits > kMaxHistogramPrecisionBits) {
+    logWarn("local histogram precision bits must be between 0 and " +
+            std::to_string(kMaxHistogramPrecisionBits));
+    return false;
+  }
+  metric_aggregator_.setHistogramPrecision(precision_bits, config_);
+  if (config_.access_log_sampling().has_success_sampling_rate()) {
+    const double rate =
+        config_.access_log_sampling().success_sampling_rate().value();
+    if (!(rate >= 0 && rate <= 1)) {
+      logWarn("access log success sampling rate must be between 0 and 1");
+      return false;
+    }
+  }
+  if (config_.log_spill_bytes() < 0) {
+    logWarn("log spill bytes must not be negative");
+    return false;
+  }
+
   direction_ = ::Wasm::Common::getTrafficDirection();
   use_host_header_fallback_ = !config_.disable_host_header_fallback();
 
+  request_info_fields_ = kMetricRequestInfoFields;
+  if (enableServerAccessLog()) {
+    request_info_fields_ |= kLogRequestInfoFields;
+  }
+  if (enableEdgeReporting()) {
+    request_info_fields_ |= kEdgeRequestInfoFields;
+  }
+
+  createExportQueue(&log_export_queue_);
+  createExportQueue(&edge_export_queue_);
+
   if (!logger_) {
     // logger should only be initiated once, for now there is no reason to
     // recreate logger because of config update.
-    auto exporter = std::make_unique<ExporterImpl>(this, getLoggingEndpoint());
+    auto exporter = std::make_unique<ExporterImpl>(
+        std::make_unique<LoggingServiceClientImpl>(this, getLoggingEndpoint()),
+        log_export_queue_.queue.get(), openLogSpillBuffer());
     // logger takes ownership of exporter.
     logger_ = std::make_unique<Logger>(local_node_info_, std::move(exporter));
   }
+  if (config_.has_access_log_sampling()) {
+    const auto& sampling = config_.access_log_sampling();
+    logger_->setSampling(
+        sampling.has_success_sampling_rate()
+            ? sampling.success_sampling_rate().value()
+            : 1.0,
+        ::google::protobuf::util::TimeUtil::DurationToNanoseconds(
+            sampling.slow_request_threshold()));
+  } else {
+    logger_->setSampling(1.0, 0);
+  }
+  logger_->setAggregation(config_.aggregate_server_access_logs());
 
   if (!edge_reporter_) {
     // edge reporter should only be initiated once, for now there is no reason
     // to recreate edge reporter because of config update.
+    const auto edges_endpoint = getMeshTelemetryEndpoint();
     auto edges_client = std::make_unique<MeshEdgesServiceClientImpl>(
-        this, getMeshTelemetryEndpoint());
+        this, edges_endpoint, edge_export_queue_.queue.get());
+#ifdef NULL_PLUGIN
+    // workers of the proxy share their edges, and one of them reports them.
+    edge_reporter_ = std::make_unique<EdgeReporter>(
+        std::move(edges_client),
+        EdgeSet::shared(edges_endpoint, local_node_info_));
+#else
     edge_reporter_ = std::make_unique<EdgeReporter>(local_node_info_,
                                                     std::move(edges_client));
+#endif
   }
 
   if (config_.has_mesh_edges_reporting_duration()) {
@@ -145,8 +240,21 @@ bool StackdriverRootContext::onConfigure(
   } else {
     edge_report_duration_nanos_ = kDefaultEdgeReportDurationNanoseconds;
   }
+  if (config_.has_mesh_edges_snapshot_duration()) {
+    edge_snapshot_duration_nanos_ =
+        ::google::protobuf::util::TimeUtil::DurationToNanoseconds(
+            config_.mesh_edges_snapshot_duration());
+  } else {
+    edge_snapshot_duration_nanos_ = kDefaultEdgeSnapshotDurationNanoseconds;
+  }
 
   node_info_cache_.setMaxCacheSize(config_.max_peer_cache_size());
+  const int32_t max_peer_cache_size = config_.max_peer_cache_size();
+  node_tags_cache_.setCapacity(
+      max_peer_cache_size < 0
+          ? 0
+          : max_peer_cache_size == 0 ? ::Wasm::Common::DefaultNodeCacheMaxSize
+                                     : max_peer_cache_size);
 
   // Register OC Stackdriver exporter and views to be exported.
   // Note exporter and views are global singleton so they should only be
@@ -161,43 +269,125 @@ bool StackdriverRootContext::onConfigure(
       getStackdriverOptions(local_node_info_, getMonitoringEndpoint()));
 
   // Register opencensus measures and views.
-  registerViews();
+  registerViews(config_);
   return true;
 }
 
 void StackdriverRootContext::onStart(std::unique_ptr<WasmData>) {
-  if (enableServerAccessLog() || enableEdgeReporting()) {
-    proxy_setTickPeriodMilliseconds(kDefaultLogExportMilliseconds);
+  // Tick also flushes peer cache metrics, so it is always enabled.
+  proxy_setTickPeriodMilliseconds(kDefaultLogExportMilliseconds);
+}
+
+std::unique_ptr<SpillBuffer>
+StackdriverRootContext::openLogSpillBuffer() {
+#ifdef NULL_PLUGIN
+  if (config_.log_spill_path().empty()) {
+    return nullptr;
+  }
+  const uint64_t capacity = config_.log_spill_bytes() > 0
+                                ? config_.log_spill_bytes()
+                                : kDefaultLogSpillBytes;
+  // Files are locked while open, so every worker takes the first free one.
+  for (int n = 0; n < kMaxLogSpillFiles; n++) {
+    auto spill_buffer = SpillBuffer::open(
+        config_.log_spill_path() + "." + std::to_string(n), capacity);
+    if (spill_buffer) {
+      return spill_buffer;
+    }
   }
+  logWarn("cannot open a log spill file at " + config_.log_spill_path());
+#endif
+  return nullptr;
 }
 
 void StackdriverRootContext::onTick() {
+  node_info_cache_.flushMetrics("stackdriver_peer_cache");
+  metric_aggregator_.drain();
+  // Retry failed exports that are due.
+  log_export_queue_.queue->send();
+  edge_export_queue_.queue->send();
+  flushExportQueueMetrics();
   if (enableServerAccessLog()) {
     logger_->exportLogEntry();
   }
   if (enableEdgeReporting()) {
     auto cur = static_cast<long int>(getCurrentTimeNanoseconds());
     if ((cur - last_edge_report_call_nanos_) > edge_report_duration_nanos_) {
-      edge_reporter_->reportEdges();
+      const bool snapshot =
+          (cur - last_edge_snapshot_nanos_) >= edge_snapshot_duration_nanos_;
+      edge_reporter_->reportEdges(snapshot);
       last_edge_report_call_nanos_ = cur;
+      if (snapshot) {
+        last_edge_snapshot_nanos_ = cur;
+      }
     }
   }
 }
 
-void StackdriverRootContext::record(const RequestInfo& request_info) {
-  const auto peer_node_info_ptr = getPeerNode();
+void StackdriverRootContext::createExportQueue(
+    BackendExportQueue* export_queue) {
+  if (export_queue->queue) {
+    return;
+  }
+  ExportQueueOptions options;
+  options.initial_backoff_milliseconds = kExportInitialBackoffMilliseconds;
+  options.max_backoff_milliseconds = kExportMaxBackoffMilliseconds;
+  export_queue->queue = std::make_unique<ExportQueue>(options, [] {
+    return static_cast<int64_t>(getCurrentTimeNanoseconds() / 1000000);
+  });
+}
+
+void StackdriverRootContext::flushExportQueueMetrics() {
+  if (!export_queue_metrics_defined_) {
+    Metric export_count(MetricType::Counter, "stackdriver_export_queue",
+                        {MetricTag{"backend", MetricTag::TagType::String},
+                         MetricTag{"result", MetricTag::TagType::String}});
+    for (auto* export_queue : {&log_export_queue_, &edge_export_queue_}) {
+      const std::string backend =
+          export_queue == &log_export_queue_ ? "logging" : "mesh_edges";
+      export_queue->succeeded_metric =
+          export_count.resolve(backend, "succeeded");
+      export_queue->retried_metric = export_count.resolve(backend, "retried");
+      export_queue->dropped_metric = export_count.resolve(backend, "dropped");
+    }
+    export_queue_metrics_defined_ = true;
+  }
+  flushExportQueueMetrics(&log_export_queue_);
+  flushExportQueueMetrics(&edge_export_queue_);
+}
+
+void StackdriverRootContext::flushExportQueueMetrics(
+    BackendExportQueue* export_queue) {
+  const auto& queue = *export_queue->queue;
+  if (queue.succeeded() > export_queue->flushed_succeeded) {
+    incrementMetric(export_queue->succeeded_metric,
+                    queue.succeeded() - export_queue->flushed_succeeded);
+    export_queue->flushed_succeeded = queue.succeeded();
+  }
+  if (queue.retried() > export_queue->flushed_retried) {
+    incrementMetric(export_queue->retried_metric,
+                    queue.retried() - export_queue->flushed_retried);
+    export_queue->flushed_retried = queue.retried();
+  }
+  if (queue.dropped() > export_queue->flushed_dropped) {
+    incrementMetric(export_queue->dropped_metric,
+                    queue.dropped() - export_queue->flushed_dropped);
+    export_queue->flushed_dropped = queue.dropped();
+  }
+}
+
+void StackdriverRootContext::record(const RequestInfo& request_info,
+                                    StringView peer_id) {
+  const auto peer_node_info_ptr = getPeerNode(peer_id);
   const NodeInfo& peer_node_info =
       peer_node_info_ptr ? *peer_node_info_ptr : ::Wasm::Common::EmptyNodeInfo;
-  ::Extensions::Stackdriver::Metric::record(isOutbound(), local_node_info_,
-                                            peer_node_info, request_info);
+  recordMetrics(request_info, peer_id, peer_node_info_ptr);
   if (enableServerAccessLog()) {
-    logger_->addLogEntry(request_info, peer_node_info);
+    logger_->addLogEntry(request_info, peer_node_info, peer_id);
   }
   if (enableEdgeReporting()) {
-    std::string peer_id;
-    if (!getStringValue(
-            {"filter_state", ::Wasm::Common::kDownstreamMetadataIdKey},
-            &peer_id)) {
+    // Edges are only reported inbound, so peer ID is the downstream ID.
+    if (peer_id.empty()) {
       LOG_DEBUG(absl::StrCat(
           "cannot get metadata for: ", ::Wasm::Common::kDownstreamMetadataIdKey,
           "; skipping edge."));
@@ -207,17 +397,48 @@ void StackdriverRootContext::record(const RequestInfo& request_info) {
   }
 }
 
+void StackdriverRootContext::recordMetrics(const RequestInfo& request_info,
+                                           StringView peer_id,
+                                           const NodeInfoPtr& peer_node_info) {
+  using ::Extensions::Stackdriver::Metric::NodeTags;
+  // Peers without an ID are not cached, nor are peers whose node info is not
+  // resolved yet, so that their tags are filled once it is.
+  const NodeTags* node_tags = nullptr;
+  std::string peer_key;
+  if (!peer_id.empty() && peer_node_info != nullptr &&
+      node_tags_cache_.capacity() > 0) {
+    peer_key = std::string(peer_id);
+    node_tags = node_tags_cache_.get(peer_key);
+  }
+  NodeTags uncached;
+  if (node_tags == nullptr) {
+    uncached = ::Extensions::Stackdriver::Metric::makeNodeTags(
+        isOutbound(), local_node_info_,
+        peer_node_info ? *peer_node_info : ::Wasm::Common::EmptyNodeInfo);
+    node_tags = peer_key.empty()
+                    ? &uncached
+                    : node_tags_cache_.insert(peer_key, std::move(uncached));
+  }
+  metric_aggregator_.add(isOutbound(), *node_tags, request_info);
+}
+
 inline bool StackdriverRootContext::isOutbound() {
   return direction_ == ::Wasm::Common::TrafficDirection::Outbound;
 }
 
-::Wasm::Common::NodeInfoPtr StackdriverRootContext::getPeerNode() {
-  bool isOutbound = this->isOutbound();
+std::string StackdriverRootContext::getPeerId() {
   const auto& id_key =
-      isOutbound ? kUpstreamMetadataIdKey : kDownstreamMetadataIdKey;
+      isOutbound() ? kUpstreamMetadataIdKey : kDownstreamMetadataIdKey;
+  std::string peer_id;
+  getStringValue({"filter_state", id_key}, &peer_id);
+  return peer_id;
+}
+
+::Wasm::Common::NodeInfoPtr StackdriverRootContext::getPeerNode(
+    StringView peer_id) {
   const auto& metadata_key =
-      isOutbound ? kUpstreamMetadataKey : kDownstreamMetadataKey;
-  return node_info_cache_.getPeerById(id_key, metadata_key);
+      isOutbound() ? kUpstreamMetadataKey : kDownstreamMetadataKey;
+  return node_info_cache_.getPeer(peer_id, metadata_key);
 }
 
 inline bool StackdriverRootContext::enableServerAccessLog() {
@@ -258,11 +479,24 @@ StackdriverRootContext* StackdriverContext::getRootContext() {
 void StackdriverContext::onLog() {
   auto* root = getRootContext();
   bool isOutbound = root->isOutbound();
+  // Reuse request info of a telemetry plugin that ran earlier in the stream,
+  // and only add the fields it did not populate.
+  std::string peer_id;
+  const bool share = root->shareRequestInfo();
+  const bool shared =
+      share && ::Wasm::Common::getSharedRequestInfo(&request_info_, &peer_id);
   ::Wasm::Common::populateHTTPRequestInfo(
-      isOutbound, root->useHostHeaderFallback(), &request_info_);
+      isOutbound, root->useHostHeaderFallback(), &request_info_,
+      root->requestInfoFields());
+  if (!shared) {
+    peer_id = root->getPeerId();
+    if (share) {
+      ::Wasm::Common::setSharedRequestInfo(request_info_, peer_id);
+    }
+  }
 
   // Record telemetry based on request info.
-  root->record(request_info_);
+  root->record(request_info_, peer_id);
 }
 
 }  // namespace Stackdriver
@@ -15,9 +15,12 @@
 
 #pragma once
 
+#include "extensions/common/clock_cache.h"
 #include "extensions/common/context.h"
 #include "extensions/common/node_info_cache.h"
 #include "extensions/stackdriver/common/constants.h"
+#include "extensions/stackdriver/common/export_queue.h"
+#include "extensions/stackdriver/common/spill_buffer.h"
 #include "extensions/stackdriver/config/v1alpha1/stackdriver_plugin_config.pb.h"
 #include "extensions/stackdriver/edges/edge_reporter.h"
 #include "extensions/stackdriver/log/logger.h"
@@ -55,7 +58,8 @@ NULL_PLUGIN_ROOT_REGISTRY;
 class StackdriverRootContext : public RootContext {
  public:
   StackdriverRootContext(uint32_t id, StringView root_id)
-      : RootContext(id, root_id) {}
+      : RootContext(id, root_id),
+        node_tags_cache_(::Wasm::Common::DefaultNodeCacheMaxSize) {}
   ~StackdriverRootContext() = default;
 
   bool onConfigure(std::unique_ptr<WasmData> configuration) override;
@@ -67,8 +71,19 @@ class StackdriverRootContext : public RootContext {
 
   bool useHostHeaderFallback() const { return use_host_header_fallback_; };
 
-  // Records telemetry based on the given request info.
-  void record(const ::Wasm::Common::RequestInfo& request_info);
+  bool shareRequestInfo() const { return config_.share_request_info(); };
+
+  // Request info fields consumed by the enabled metrics, logs and edges.
+  ::Wasm::Common::RequestInfoFields requestInfoFields() const {
+    return request_info_fields_;
+  };
+
+  // Records telemetry based on the given request info and peer ID.
+  void record(const ::Wasm::Common::RequestInfo& request_info,
+              StringView peer_id);
+
+  // Gets the ID of the peer from host filter state.
+  std::string getPeerId();
 
  private:
   // Indicates whether to export server access log or not.
@@ -77,11 +92,26 @@ class StackdriverRootContext : public RootContext {
   // Gets peer node info. It checks the node info cache first, and then try to
   // fetch it from host if cache miss. If cache is disabled, it will fetch from
   // host directly.
-  ::Wasm::Common::NodeInfoPtr getPeerNode();
+  ::Wasm::Common::NodeInfoPtr getPeerNode(StringView peer_id);
+
+  // Buffers metrics with the node tags of the peer, which are cached by peer
+  // ID once the peer node info is resolved. Buffered metrics are recorded on
+  // tick.
+  void recordMetrics(const ::Wasm::Common::RequestInfo& request_info,
+                     StringView peer_id,
+                     const ::Wasm::Common::NodeInfoPtr& peer_node_info);
 
   // Indicates whether or not to report edges to Stackdriver.
   bool enableEdgeReporting();
 
+  // Increments the export queue counters by the changes since the last call.
+  void flushExportQueueMetrics();
+
+  // Opens the spill file of access log requests for this worker, if
+  // configured. Returns nullptr otherwise.
+  std::unique_ptr<::Extensions::Stackdriver::Common::SpillBuffer>
+  openLogSpillBuffer();
+
   // Config for Stackdriver plugin.
   stackdriver::config::v1alpha1::PluginConfig config_;
 
@@ -91,10 +121,41 @@ class StackdriverRootContext : public RootContext {
   // Cache of peer node info.
   ::Wasm::Common::NodeInfoCache node_info_cache_;
 
+  // Cache of metric tags derived from the local and peer node, by peer ID.
+  ::Wasm::Common::ClockCache<::Extensions::Stackdriver::Metric::NodeTags>
+      node_tags_cache_;
+
+  // Per-worker buffer of metrics, which is recorded into Opencensus on tick.
+  ::Extensions::Stackdriver::Metric::Aggregator metric_aggregator_;
+
   // Indicates the traffic direction relative to this proxy.
   ::Wasm::Common::TrafficDirection direction_{
       ::Wasm::Common::TrafficDirection::Unspecified};
 
+  // Queue that sends and retries the requests of one backend, with its
+  // counters and the values they were last flushed at.
+  struct BackendExportQueue {
+    std::unique_ptr<::Extensions::Stackdriver::Common::ExportQueue> queue;
+    uint32_t succeeded_metric;
+    uint32_t retried_metric;
+    uint32_t dropped_metric;
+    uint64_t flushed_succeeded = 0;
+    uint64_t flushed_retried = 0;
+    uint64_t flushed_dropped = 0;
+  };
+
+  // Creates the queue of a backend, if it does not exist yet.
+  void createExportQueue(BackendExportQueue* export_queue);
+
+  // Increments the counters of a queue by the changes since the last call.
+  void flushExportQueueMetrics(BackendExportQueue* export_queue);
+
+  // Every backend has its own queue, so that a slow or failing backend does
+  // not take the in-flight requests and bytes of the other.
+  BackendExportQueue log_export_queue_;
+  BackendExportQueue edge_export_queue_;
+  bool export_queue_metrics_defined_ = false;
+
   // Logger records and exports log entries to Stackdriver backend.
   std::unique_ptr<::Extensions::Stackdriver::Log::Logger> logger_;
 
@@ -105,7 +166,13 @@ class StackdriverRootContext : public RootContext {
 
   long int edge_report_duration_nanos_;
 
+  long int last_edge_snapshot_nanos_ = 0;
+
+  long int edge_snapshot_duration_nanos_;
+
   bool use_host_header_fallback_;
+
+  ::Wasm::Common::RequestInfoFields request_info_fields_ = 0;
 };
 
 // StackdriverContext is per stream context. It has the same lifetime as
@@ -0,0 +1,240 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#include "benchmark/benchmark.h"
+#include "common/buffer/buffer_impl.h"
+#include "extensions/common/test_host.h"
+#include "extensions/stackdriver/common/constants.h"
+#include "extensions/stackdriver/stackdriver.h"
+
+// WASM_PROLOG
+#ifdef NULL_PLUGIN
+namespace Envoy {
+namespace Extensions {
+namespace Common {
+namespace Wasm {
+namespace Null {
+namespace Plugin {
+#endif  // NULL_PLUGIN
+
+// END WASM_PROLOG
+
+namespace Stackdriver {
+
+using ::Wasm::Common::Testing::HostContext;
+using ::Wasm::Common::Testing::MockHost;
+using ::Wasm::Common::Testing::TestPlugin;
+using ::Wasm::Common::Testing::TestRootContext;
+using ::Wasm::Common::Testing::TestStreamContext;
+
+// FakeTelemetryServer stands in for the logging and mesh telemetry services.
+// It counts the calls and request bytes per method, and answers calls with an
+// empty response when complete() is called, like a backend with no latency.
+class FakeTelemetryServer {
+ public:
+  uint32_t call(absl::string_view method, absl::string_view request) {
+    auto& stats = methods_[std::string(method)];
+    stats.calls++;
+    stats.bytes += request.size();
+    // Tokens of gRPC calls are odd.
+    const uint32_t token = next_token_;
+    next_token_ += 2;
+    pending_.push_back(token);
+    return token;
+  }
+
+  // Answers all pending calls through the given host context.
+  void complete(HostContext* context) {
+    std::vector<uint32_t> pending;
+    pending.swap(pending_);
+    for (uint32_t token : pending) {
+      context->onGrpcReceive(token,
+                             std::make_unique<::Envoy::Buffer::OwnedImpl>());
+    }
+  }
+
+  uint64_t bytes() const {
+    uint64_t bytes = 0;
+    for (const auto& method : methods_) {
+      bytes += method.second.bytes;
+    }
+    return bytes;
+  }
+
+ private:
+  struct MethodStats {
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+  };
+
+  std::map<std::string, MethodStats> methods_;
+  std::vector<uint32_t> pending_;
+  uint32_t next_token_ = 1;
+};
+
+class TelemetryRootContext : public TestRootContext {
+ public:
+  TelemetryRootContext(MockHost* host, FakeTelemetryServer* server)
+      : TestRootContext(host), server_(server) {}
+  WasmResult grpcCall(const envoy::api::v2::core::GrpcService&,
+                      absl::string_view, absl::string_view method_name,
+                      absl::string_view request,
+                      const absl::optional<std::chrono::milliseconds>&,
+                      uint32_t* token_ptr) override {
+    *token_ptr = server_->call(method_name, request);
+    return WasmResult::Ok;
+  }
+
+ private:
+  FakeTelemetryServer* server_;
+};
+
+// StackdriverPluginFixture loads the stackdriver plugin in the null VM with
+// access logging and edge reporting enabled, reports a request per call to
+// report(), and exports on tick() to a FakeTelemetryServer.
+class StackdriverPluginFixture {
+ public:
+  StackdriverPluginFixture() {
+    host_.setInboundRequest();
+    plugin_.load("stackdriver", "envoy.wasm.null.stackdriver",
+                 ::Extensions::Stackdriver::Common::kInboundRootContextId,
+                 envoy::api::v2::core::TrafficDirection::INBOUND,
+                 R"({"enable_mesh_edges_reporting": true,
+                     "mesh_edges_reporting_duration": "10s"})",
+                 new TelemetryRootContext(&host_, &server_));
+  }
+
+  MockHost& host() { return host_; }
+  FakeTelemetryServer& server() { return server_; }
+
+  // Reports a single HTTP request with the current mock host properties.
+  void report() {
+    TestStreamContext context(&plugin_, &host_);
+    context.onCreate(plugin_.rootContext()->id());
+    context.onLog();
+  }
+
+  // Runs the timer of the plugin, which records metrics and exports logs and
+  // edges, and lets the fake server answer the calls.
+  void tick() {
+    plugin_.rootContext()->onTick();
+    server_.complete(plugin_.rootContext());
+  }
+
+ private:
+  MockHost host_;
+  FakeTelemetryServer server_;
+  TestPlugin plugin_;
+};
+
+// Runs report_fn once per iteration, ticks every requests_per_tick requests,
+// and reports the bytes exported per request and the distribution of tick
+// latencies in addition to the time per request.
+template <typename ReportFn>
+void runReport(benchmark::State& state, StackdriverPluginFixture& fixture,
+               int64_t requests_per_tick, ReportFn report_fn) {
+  std::vector<double> tick_micros;
+  int64_t requests = 0;
+  const uint64_t bytes_before = fixture.server().bytes();
+  for (auto _ : state) {
+    report_fn();
+    if (++requests % requests_per_tick == 0) {
+      const auto start = std::chrono::steady_clock::now();
+      fixture.tick();
+      tick_micros.push_back(std::chrono::duration<double, std::micro>(
+                                std::chrono::steady_clock::now() - start)
+                                .count());
+    }
+  }
+  // Exports the rest outside of the measurement.
+  state.PauseTiming();
+  fixture.tick();
+  state.ResumeTiming();
+
+  state.counters["exported_bytes_per_request"] = benchmark::Counter(
+      static_cast<double>(fixture.server().bytes() - bytes_before),
+      benchmark::Counter::kAvgIterations);
+  if (tick_micros.empty()) {
+    return;
+  }
+  std::sort(tick_micros.begin(), tick_micros.end());
+  auto percentile = [&tick_micros](double p) {
+    return tick_micros[static_cast<size_t>(p * (tick_micros.size() - 1))];
+  };
+  state.counters["tick_p50_us"] = percentile(0.5);
+  state.counters["tick_p99_us"] = percentile(0.99);
+  state.counters["tick_max_us"] = tick_micros.back();
+}
+
+// Same peer and response code on every request, ticking every range(0)
+// requests.
+static void BM_Record(benchmark::State& state) {
+  StackdriverPluginFixture fixture;
+  fixture.report();
+  fixture.tick();
+  runReport(state, fixture, state.range(0), [&fixture] { fixture.report(); });
+}
+BENCHMARK(BM_Record)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Every request comes from a new peer, which adds a log peer entry, metric
+// series and an edge per request.
+static void BM_RecordNewPeers(benchmark::State& state) {
+  StackdriverPluginFixture fixture;
+  uint64_t peer = 0;
+  runReport(state, fixture, 1000, [&fixture, &peer] {
+    fixture.host().setPeer(absl::StrCat("ratings-v1-", peer++, ".default"));
+    fixture.report();
+  });
+}
+BENCHMARK(BM_RecordNewPeers);
+
+// Requests rotate over range(0) response codes, which exercises metric
+// aggregation at size.
+static void BM_RecordManySeries(benchmark::State& state) {
+  StackdriverPluginFixture fixture;
+  const int64_t series = state.range(0);
+  int64_t i = 0;
+  runReport(state, fixture, 1000, [&fixture, &i, series] {
+    fixture.host().setResponseCode(200 + (i++ % series));
+    fixture.report();
+  });
+}
+BENCHMARK(BM_RecordManySeries)->Arg(10)->Arg(300);
+
+}  // namespace Stackdriver
+
+// WASM_EPILOG
+#ifdef NULL_PLUGIN
+}  // namespace Plugin
+}  // namespace Null
+}  // namespace Wasm
+}  // namespace Common
+}  // namespace Extensions
+}  // namespace Envoy
+#endif
+
+// Boilerplate main(), which discovers benchmarks in the same file and runs
+// them.
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+}
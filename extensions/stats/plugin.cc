@@ -15,6 +15,8 @@
 
 #include "extensions/stats/plugin.h"
 
+#include "google/protobuf/util/time_util.h"
+
 // WASM_PROLOG
 #ifndef NULL_PLUGIN
 #include "proxy_wasm_intrinsics.h"
@@ -36,6 +38,8 @@ namespace Plugin {
 
 namespace Stats {
 
+constexpr uint32_t kDefaultTCPReportingDurationMilliseconds = 15000;  // 15s
+
 bool PluginRootContext::onConfigure(std::unique_ptr<WasmData> configuration) {
   // Parse configuration JSON string.
   JsonParseOptions json_options;
@@ -67,6 +71,17 @@ bool PluginRootContext::onConfigure(std::unique_ptr<WasmData> configuration) {
   }
   debug_ = config_.debug();
   use_host_header_fallback_ = !config_.disable_host_header_fallback();
+  // Fields read by IstioDimensions and the metric value functions. Request
+  // operation, url path and destination port are not used by metrics.
+  request_info_fields_ = ::Wasm::Common::kEndTimestampField |
+                         ::Wasm::Common::kResponseCodeField |
+                         ::Wasm::Common::kRequestProtocolField |
+                         ::Wasm::Common::kDestinationServiceHostField |
+                         ::Wasm::Common::kDestinationServiceNameField |
+                         ::Wasm::Common::kPrincipalsField |
+                         ::Wasm::Common::kServiceAuthPolicyField |
+                         ::Wasm::Common::kResponseFlagField |
+                         ::Wasm::Common::kRbacPermissiveField;
   node_info_cache_.setMaxCacheSize(config_.max_peer_cache_size());
 
   auto field_separator = CONFIG_DEFAULT(field_separator);
@@ -103,51 +118,163 @@ bool PluginRootContext::onConfigure(std::unique_ptr<WasmData> configuration) {
             return request_info.response_size;
           },
           field_separator, value_separator)};
+
+  tcp_stats_ = std::vector<StatGen>{
+      StatGen(
+          absl::StrCat(stat_prefix, "tcp_sent_bytes_total"),
+          MetricType::Counter,
+          [](const ::Wasm::Common::RequestInfo& request_info) -> uint64_t {
+            return request_info.tcp_sent_bytes;
+          },
+          field_separator, value_separator),
+      StatGen(
+          absl::StrCat(stat_prefix, "tcp_received_bytes_total"),
+          MetricType::Counter,
+          [](const ::Wasm::Common::RequestInfo& request_info) -> uint64_t {
+            return request_info.tcp_received_bytes;
+          },
+          field_separator, value_separator),
+      StatGen(
+          absl::StrCat(stat_prefix, "tcp_connections_opened_total"),
+          MetricType::Counter,
+          [](const ::Wasm::Common::RequestInfo& request_info) -> uint64_t {
+            return request_info.tcp_connections_opened;
+          },
+          field_separator, value_separator),
+      StatGen(
+          absl::StrCat(stat_prefix, "tcp_connections_closed_total"),
+          MetricType::Counter,
+          [](const ::Wasm::Common::RequestInfo& request_info) -> uint64_t {
+            return request_info.tcp_connections_closed;
+          },
+          field_separator, value_separator)};
+
+  if (config_.has_tcp_reporting_duration()) {
+    tcp_reporting_duration_milliseconds_ =
+        ::google::protobuf::util::TimeUtil::DurationToMilliseconds(
+            config_.tcp_reporting_duration());
+  } else {
+    tcp_reporting_duration_milliseconds_ =
+        kDefaultTCPReportingDurationMilliseconds;
+  }
   return true;
 }
 
-void PluginRootContext::report(
-    const ::Wasm::Common::RequestInfo& request_info) {
+void PluginRootContext::onStart(std::unique_ptr<WasmData>) {
+  proxy_setTickPeriodMilliseconds(tcp_reporting_duration_milliseconds_);
+}
+
+void PluginRootContext::onTick() {
+  for (auto& connection : tcp_connections_) {
+    reportTcpConnection(connection.second.get());
+  }
+  node_info_cache_.flushMetrics("statsfilter_peer_cache");
+}
+
+void PluginRootContext::report(const ::Wasm::Common::RequestInfo& request_info,
+                               StringView peer_id) {
   const auto peer_node_ptr =
-      node_info_cache_.getPeerById(peer_metadata_id_key_, peer_metadata_key_);
+      node_info_cache_.getPeer(peer_id, peer_metadata_key_);
   const wasm::common::NodeInfo& peer_node =
       peer_node_ptr ? *peer_node_ptr : ::Wasm::Common::EmptyNodeInfo;
 
   // map and overwrite previous mapping.
   istio_dimensions_.map(peer_node, request_info);
 
+  for (const auto& stat : resolveStats(stats_)) {
+    stat.record(request_info);
+  }
+}
+
+const std::vector<SimpleStat>& PluginRootContext::resolveStats(
+    std::vector<StatGen>& stat_gens) {
   auto stats_it = metrics_.find(istio_dimensions_);
   if (stats_it != metrics_.end()) {
-    for (auto& stat : stats_it->second) {
-      stat.record(request_info);
-      LOG_DEBUG(absl::StrCat(
-          "metricKey cache hit ", istio_dimensions_.debug_key(),
-          ", stat=", stat.metric_id_, stats_it->first.to_string()));
-    }
+    LOG_DEBUG(absl::StrCat("metricKey cache hit ",
+                           istio_dimensions_.debug_key(), " ",
+                           stats_it->first.to_string()));
     cache_hits_accumulator_++;
     if (cache_hits_accumulator_ == 100) {
       incrementMetric(cache_hits_, cache_hits_accumulator_);
       cache_hits_accumulator_ = 0;
     }
-    return;
+    return stats_it->second;
   }
 
   // fetch dimensions in the required form for resolve.
   auto values = istio_dimensions_.values();
 
   std::vector<SimpleStat> stats;
-  for (auto& statgen : stats_) {
+  for (auto& statgen : stat_gens) {
     auto stat = statgen.resolve(values);
     LOG_DEBUG(absl::StrCat("metricKey cache miss ", statgen.name(), " ",
                            istio_dimensions_.debug_key(),
                            ", stat=", stat.metric_id_));
-    stat.record(request_info);
     stats.push_back(stat);
   }
 
   incrementMetric(cache_misses_, 1);
   // TODO: When we have c++17, convert to try_emplace.
-  metrics_.emplace(istio_dimensions_, stats);
+  return metrics_.emplace(istio_dimensions_, std::move(stats)).first->second;
+}
+
+void PluginRootContext::addTcpConnection(
+    uint32_t context_id, std::shared_ptr<TcpConnectionInfo> connection) {
+  tcp_connections_[context_id] = std::move(connection);
+}
+
+void PluginRootContext::resolveTcpConnection(TcpConnectionInfo* connection,
+                                             bool peer_required) {
+  if (connection->resolved) {
+    return;
+  }
+  const auto peer_node_ptr =
+      node_info_cache_.getPeerById(peer_metadata_id_key_, peer_metadata_key_);
+  if (!peer_node_ptr && peer_required) {
+    // Metadata exchange has not completed yet.
+    return;
+  }
+  const wasm::common::NodeInfo& peer_node =
+      peer_node_ptr ? *peer_node_ptr : ::Wasm::Common::EmptyNodeInfo;
+
+  auto& request_info = connection->request_info;
+  ::Wasm::Common::populateTCPRequestInfo(outbound_, &request_info,
+                                         request_info_fields_);
+  istio_dimensions_.map(peer_node, request_info);
+  connection->stats = resolveStats(tcp_stats_);
+  connection->resolved = true;
+}
+
+void PluginRootContext::reportTcpConnection(TcpConnectionInfo* connection) {
+  auto& request_info = connection->request_info;
+  if (!connection->resolved ||
+      (request_info.tcp_sent_bytes == 0 &&
+       request_info.tcp_received_bytes == 0 &&
+       request_info.tcp_connections_opened == 0 &&
+       request_info.tcp_connections_closed == 0)) {
+    return;
+  }
+  for (const auto& stat : connection->stats) {
+    stat.record(request_info);
+  }
+  // Counters are reported as deltas since the previous report.
+  request_info.tcp_sent_bytes = 0;
+  request_info.tcp_received_bytes = 0;
+  request_info.tcp_connections_opened = 0;
+  request_info.tcp_connections_closed = 0;
+}
+
+void PluginRootContext::closeTcpConnection(uint32_t context_id) {
+  auto connection_it = tcp_connections_.find(context_id);
+  if (connection_it == tcp_connections_.end()) {
+    return;
+  }
+  auto* connection = connection_it->second.get();
+  // Peer metadata may never arrive, e.g. if the peer is not in the mesh.
+  resolveTcpConnection(connection, false);
+  connection->request_info.tcp_connections_closed = 1;
+  reportTcpConnection(connection);
+  tcp_connections_.erase(connection_it);
 }
 
 #ifdef NULL_PLUGIN
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_map>
 
 #include "absl/strings/str_join.h"
@@ -109,9 +110,10 @@ struct IstioDimensions {
   }
 
   // values is used on the datapath, only when new dimensions are found.
-  std::vector<std::string> values() {
+  // The returned views are valid as long as the dimensions are not modified.
+  std::vector<StringView> values() const {
 #define VALUES(name) name,
-    return std::vector<std::string>{STD_ISTIO_DIMENSIONS(VALUES)};
+    return std::vector<StringView>{STD_ISTIO_DIMENSIONS(VALUES)};
 #undef VALUES
   }
 
@@ -293,7 +295,7 @@ class SimpleStat {
   SimpleStat(uint32_t metric_id, ValueExtractorFn value_fn)
       : metric_id_(metric_id), value_fn_(value_fn){};
 
-  inline void record(const ::Wasm::Common::RequestInfo& request_info) {
+  inline void record(const ::Wasm::Common::RequestInfo& request_info) const {
     recordMetric(metric_id_, value_fn_(request_info));
   };
 
@@ -304,29 +306,80 @@ class SimpleStat {
 };
 
 // StatGen creates a SimpleStat based on resolved metric_id.
+// Tags are encoded into the metric name in one place, encodeTags(). The host
+// still parses them out of the name with regex tag extractors, so this does
+// not reduce stat creation or scrape time work.
 class StatGen {
  public:
   explicit StatGen(std::string name, MetricType metric_type,
                    ValueExtractorFn value_fn, std::string field_separator,
                    std::string value_separator)
       : name_(name),
+        metric_type_(metric_type),
         value_fn_(value_fn),
-        metric_(metric_type, name, IstioDimensions::metricTags(),
-                field_separator, value_separator){};
+        field_separator_(field_separator) {
+    // Pre-compute "<tag><value_separator>" once, instead of once per series.
+    for (const auto& tag : IstioDimensions::metricTags()) {
+      tag_keys_.push_back(absl::StrCat(tag.name, value_separator));
+      encoded_size_ += tag_keys_.back().size() + field_separator_.size();
+    }
+  };
 
   StatGen() = delete;
   inline StringView name() const { return name_; };
 
   // Resolve metric based on provided dimension values.
-  SimpleStat resolve(std::vector<std::string>& vals) {
-    auto metric_id = metric_.resolveWithFields(vals);
+  // The values must be ordered as IstioDimensions::metricTags().
+  SimpleStat resolve(const std::vector<StringView>& vals) {
+    uint32_t metric_id = 0;
+    if (WasmResult::Ok !=
+        defineMetric(metric_type_, encodeTags(vals), &metric_id)) {
+      LOG_WARN(absl::StrCat("cannot define metric ", name_));
+    }
     return SimpleStat(metric_id, value_fn_);
   };
 
  private:
+  // The host stats API accepts a flat metric name. Tags are appended as
+  // tag{value_separator}value{field_separator} followed by the metric name,
+  // and are recovered by the host tag extractors. Passing tags structured
+  // needs a host ABI that the pinned Envoy does not have.
+  std::string encodeTags(const std::vector<StringView>& vals) const {
+    size_t size = encoded_size_ + name_.size();
+    for (const auto& val : vals) {
+      size += val.size();
+    }
+    std::string encoded;
+    encoded.reserve(size);
+    for (size_t i = 0; i < tag_keys_.size() && i < vals.size(); i++) {
+      encoded.append(tag_keys_[i]);
+      encoded.append(vals[i].data(), vals[i].size());
+      encoded.append(field_separator_);
+    }
+    encoded.append(name_);
+    return encoded;
+  }
+
   std::string name_;
+  MetricType metric_type_;
   ValueExtractorFn value_fn_;
-  Metric metric_;
+  std::string field_separator_;
+  std::vector<std::string> tag_keys_;
+  size_t encoded_size_ = 0;
+};
+
+// TcpConnectionInfo carries the state of a TCP connection between the stream
+// context, which observes data events, and the root context, which reports the
+// accumulated counters periodically.
+struct TcpConnectionInfo {
+  ::Wasm::Common::RequestInfo request_info;
+
+  // Metrics resolved for the connection dimensions. Dimensions depend on peer
+  // metadata, which is only known after the metadata exchange completes, so the
+  // metrics are resolved once per connection on the first data event that
+  // carries it, or at close.
+  std::vector<SimpleStat> stats;
+  bool resolved = false;
 };
 
 // PluginRootContext is the root context for all streams processed by the
@@ -345,15 +398,39 @@ class PluginRootContext : public RootContext {
   ~PluginRootContext() = default;
 
   bool onConfigure(std::unique_ptr<WasmData>) override;
-  void report(const ::Wasm::Common::RequestInfo& request_info);
+  void onStart(std::unique_ptr<WasmData>) override;
+  void onTick() override;
+  void report(const ::Wasm::Common::RequestInfo& request_info,
+              StringView peer_id);
+
+  // TCP connections are tracked by the root context from open to close, and
+  // their counters are flushed on tick.
+  void addTcpConnection(uint32_t context_id,
+                        std::shared_ptr<TcpConnectionInfo> connection);
+  // Resolves connection metrics if peer metadata is available. If
+  // peer_required is false, missing peer metadata resolves to unknown.
+  void resolveTcpConnection(TcpConnectionInfo* connection, bool peer_required);
+  // Reports the remaining counters of a closed connection and stops tracking.
+  void closeTcpConnection(uint32_t context_id);
   bool outbound() const { return outbound_; };
   bool useHostHeaderFallback() const { return use_host_header_fallback_; };
+  bool shareRequestInfo() const { return config_.share_request_info(); };
+  StringView peerMetadataIdKey() const { return peer_metadata_id_key_; };
+  // Request info fields consumed by the configured metrics.
+  ::Wasm::Common::RequestInfoFields requestInfoFields() const {
+    return request_info_fields_;
+  };
 
  private:
   stats::PluginConfig config_;
   wasm::common::NodeInfo local_node_info_;
   ::Wasm::Common::NodeInfoCache node_info_cache_;
 
+  // Looks up metrics for the currently mapped dimensions, and creates them on
+  // a miss.
+  const std::vector<SimpleStat>& resolveStats(std::vector<StatGen>& stat_gens);
+  void reportTcpConnection(TcpConnectionInfo* connection);
+
   IstioDimensions istio_dimensions_;
 
   StringView peer_metadata_id_key_;
@@ -361,6 +438,7 @@ class PluginRootContext : public RootContext {
   bool outbound_;
   bool debug_;
   bool use_host_header_fallback_;
+  ::Wasm::Common::RequestInfoFields request_info_fields_;
 
   int64_t cache_hits_accumulator_ = 0;
   uint32_t cache_hits_;
@@ -374,6 +452,12 @@ class PluginRootContext : public RootContext {
 
   // Peer stats to be generated for a dimensioned metrics set.
   std::vector<StatGen> stats_;
+  std::vector<StatGen> tcp_stats_;
+
+  // Open TCP connections keyed by context id.
+  std::unordered_map<uint32_t, std::shared_ptr<TcpConnectionInfo>>
+      tcp_connections_;
+  uint32_t tcp_reporting_duration_milliseconds_;
 };
 
 class PluginRootContextOutbound : public PluginRootContext {
@@ -395,9 +479,62 @@ class PluginContext : public Context {
 
   void onLog() override {
     auto rootCtx = rootContext();
+    if (tcp_connection_) {
+      rootCtx->closeTcpConnection(id());
+      tcp_connection_ = nullptr;
+      return;
+    }
+    // Reuse request info of a telemetry plugin that ran earlier in the stream,
+    // and only add the fields it did not populate.
+    std::string peer_id;
+    const bool share = rootCtx->shareRequestInfo();
+    const bool shared =
+        share && ::Wasm::Common::getSharedRequestInfo(&request_info_, &peer_id);
     ::Wasm::Common::populateHTTPRequestInfo(
-        rootCtx->outbound(), rootCtx->useHostHeaderFallback(), &request_info_);
-    rootCtx->report(request_info_);
+        rootCtx->outbound(), rootCtx->useHostHeaderFallback(), &request_info_,
+        rootCtx->requestInfoFields());
+    if (!shared) {
+      getStringValue({"filter_state", rootCtx->peerMetadataIdKey()}, &peer_id);
+      if (share) {
+        ::Wasm::Common::setSharedRequestInfo(request_info_, peer_id);
+      }
+    }
+    rootCtx->report(request_info_, peer_id);
+  };
+
+  FilterStatus onNewConnection() override {
+    tcp_connection_ = std::make_shared<TcpConnectionInfo>();
+    tcp_connection_->request_info.start_timestamp =
+        getCurrentTimeNanoseconds();
+    tcp_connection_->request_info.tcp_connections_opened = 1;
+    rootContext()->addTcpConnection(id(), tcp_connection_);
+    return FilterStatus::Continue;
+  };
+
+  // Data events only update counters. Metrics are resolved at most once per
+  // connection, and reported by the root context on tick.
+  FilterStatus onDownstreamData(size_t size, bool) override {
+    if (tcp_connection_) {
+      auto& request_info = tcp_connection_->request_info;
+      request_info.tcp_received_bytes += size;
+      request_info.tcp_total_received_bytes += size;
+      if (!tcp_connection_->resolved) {
+        rootContext()->resolveTcpConnection(tcp_connection_.get(), true);
+      }
+    }
+    return FilterStatus::Continue;
+  };
+
+  FilterStatus onUpstreamData(size_t size, bool) override {
+    if (tcp_connection_) {
+      auto& request_info = tcp_connection_->request_info;
+      request_info.tcp_sent_bytes += size;
+      request_info.tcp_total_sent_bytes += size;
+      if (!tcp_connection_->resolved) {
+        rootContext()->resolveTcpConnection(tcp_connection_.get(), true);
+      }
+    }
+    return FilterStatus::Continue;
   };
 
   // TODO remove the following 3 functions when streamInfo adds support for
@@ -423,6 +560,8 @@ class PluginContext : public Context {
   };
 
   ::Wasm::Common::RequestInfo request_info_;
+  // Set only if the context processes a TCP connection.
+  std::shared_ptr<TcpConnectionInfo> tcp_connection_;
 };
 
 #ifdef NULL_PLUGIN
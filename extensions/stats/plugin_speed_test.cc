@@ -0,0 +1,210 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "benchmark/benchmark.h"
+#include "extensions/common/test_host.h"
+#include "extensions/stats/plugin.h"
+
+// Counts heap allocations so that benchmarks can report allocations/request.
+static std::atomic<uint64_t> allocation_count{0};
+
+void* operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// WASM_PROLOG
+#ifdef NULL_PLUGIN
+namespace Envoy {
+namespace Extensions {
+namespace Common {
+namespace Wasm {
+namespace Null {
+namespace Plugin {
+#endif  // NULL_PLUGIN
+
+// END WASM_PROLOG
+
+namespace Stats {
+
+using ::Wasm::Common::Testing::MockHost;
+using ::Wasm::Common::Testing::TestPlugin;
+using ::Wasm::Common::Testing::TestRootContext;
+using ::Wasm::Common::Testing::TestStreamContext;
+
+// StatsPluginFixture loads the stats plugin in the null VM and reports a
+// request per call to report(). Host stats are backed by an isolated store.
+class StatsPluginFixture {
+ public:
+  StatsPluginFixture() {
+    host_.setInboundRequest();
+    plugin_.load("stats", "envoy.wasm.stats", "stats_inbound",
+                 envoy::api::v2::core::TrafficDirection::INBOUND,
+                 R"({"max_peer_cache_size": 500})",
+                 new TestRootContext(&host_));
+  }
+
+  MockHost& host() { return host_; }
+
+  // Reports a single HTTP request with the current mock host properties.
+  void report() {
+    TestStreamContext context(&plugin_, &host_);
+    context.onCreate(plugin_.rootContext()->id());
+    context.onLog();
+  }
+
+ private:
+  MockHost host_;
+  TestPlugin plugin_;
+};
+
+// Runs report_fn once per iteration and reports allocations per request in
+// addition to the time per request.
+template <typename ReportFn>
+void runReport(benchmark::State& state, ReportFn report_fn) {
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    const uint64_t before = allocation_count.load(std::memory_order_relaxed);
+    report_fn();
+    allocations += allocation_count.load(std::memory_order_relaxed) - before;
+  }
+  state.counters["allocs_per_request"] = benchmark::Counter(
+      static_cast<double>(allocations), benchmark::Counter::kAvgIterations);
+}
+
+// Same peer and dimensions on every request. This is the steady state of a
+// proxy.
+static void BM_ReportCacheHit(benchmark::State& state) {
+  StatsPluginFixture fixture;
+  fixture.report();
+  runReport(state, [&fixture] { fixture.report(); });
+}
+BENCHMARK(BM_ReportCacheHit);
+
+// Known peer, but every request maps to new dimensions, so metrics are
+// defined with the host on every request.
+static void BM_ReportCacheMiss(benchmark::State& state) {
+  StatsPluginFixture fixture;
+  int64_t code = 1000;
+  runReport(state, [&fixture, &code] {
+    fixture.host().setResponseCode(code++);
+    fixture.report();
+  });
+}
+BENCHMARK(BM_ReportCacheMiss);
+
+// Every request comes from a peer that is not in the peer metadata cache,
+// while dimensions stay the same.
+static void BM_ReportPeerMetadataMiss(benchmark::State& state) {
+  StatsPluginFixture fixture;
+  uint64_t peer = 0;
+  runReport(state, [&fixture, &peer] {
+    fixture.host().setPeer(absl::StrCat("ratings-v1-", peer++, ".default"));
+    fixture.report();
+  });
+}
+BENCHMARK(BM_ReportPeerMetadataMiss);
+
+// Requests rotate over a fixed number of series that are all resolved, which
+// exercises the metrics map at size.
+static void BM_ReportManySeries(benchmark::State& state) {
+  StatsPluginFixture fixture;
+  const int64_t series = state.range(0);
+  for (int64_t i = 0; i < series; i++) {
+    fixture.host().setResponseCode(1000 + i);
+    fixture.report();
+  }
+  int64_t i = 0;
+  runReport(state, [&fixture, &i, series] {
+    fixture.host().setResponseCode(1000 + (i++ % series));
+    fixture.report();
+  });
+}
+BENCHMARK(BM_ReportManySeries)->Arg(100)->Arg(10000);
+
+IstioDimensions testDimensions(bool outbound) {
+  wasm::common::NodeInfo local_node;
+  local_node.set_workload_name("productpage-v1");
+  local_node.set_namespace_("default");
+  (*local_node.mutable_labels())["app"] = "productpage";
+  (*local_node.mutable_labels())["version"] = "v1";
+  wasm::common::NodeInfo peer_node;
+  peer_node.set_workload_name("ratings-v1");
+  peer_node.set_namespace_("default");
+  (*peer_node.mutable_labels())["app"] = "ratings";
+  (*peer_node.mutable_labels())["version"] = "v1";
+  ::Wasm::Common::RequestInfo request_info;
+  request_info.request_protocol = "http";
+  request_info.response_code = 200;
+  request_info.destination_service_host =
+      "ratings.default.svc.cluster.local";
+  request_info.destination_service_name = "ratings";
+
+  IstioDimensions dimensions;
+  dimensions.init(outbound, local_node);
+  dimensions.map(peer_node, request_info);
+  return dimensions;
+}
+
+static void BM_IstioDimensionsHash(benchmark::State& state) {
+  const IstioDimensions dimensions = testDimensions(state.range(0));
+  IstioDimensions::HashIstioDimensions hasher;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hasher(dimensions));
+  }
+}
+BENCHMARK(BM_IstioDimensionsHash)->Arg(0)->Arg(1);
+
+static void BM_IstioDimensionsEqual(benchmark::State& state) {
+  const IstioDimensions lhs = testDimensions(state.range(0));
+  const IstioDimensions rhs = testDimensions(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs == rhs);
+  }
+}
+BENCHMARK(BM_IstioDimensionsEqual)->Arg(0)->Arg(1);
+
+}  // namespace Stats
+
+// WASM_EPILOG
+#ifdef NULL_PLUGIN
+}  // namespace Plugin
+}  // namespace Null
+}  // namespace Wasm
+}  // namespace Common
+}  // namespace Extensions
+}  // namespace Envoy
+#endif
+
+// Boilerplate main(), which discovers benchmarks in the same file and runs
+// them.
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -15,9 +15,13 @@
 
 #include "extensions/stats/plugin.h"
 
+#include <map>
 #include <set>
 
 #include "absl/hash/hash_testing.h"
+#include "absl/strings/match.h"
+#include "common/buffer/buffer_impl.h"
+#include "extensions/common/test_host.h"
 #include "gtest/gtest.h"
 
 // WASM_PROLOG
@@ -70,6 +74,192 @@ TEST(IstioDimensions, Hash) {
   EXPECT_EQ(hashes.size(), 7);
 }
 
+using ::Wasm::Common::Testing::kPeerId;
+using ::Wasm::Common::Testing::MockHost;
+using ::Wasm::Common::Testing::TestPlugin;
+using ::Wasm::Common::Testing::TestRootContext;
+using ::Wasm::Common::Testing::TestStreamContext;
+
+// TcpStatsTest loads the inbound stats plugin, and runs TCP connections
+// through it. Connection counters are flushed on tick and at close.
+class TcpStatsTest : public testing::Test {
+ protected:
+  TcpStatsTest() {
+    host_.setInboundRequest();
+    plugin_.load("stats", "envoy.wasm.stats", "stats_inbound",
+                 envoy::api::v2::core::TrafficDirection::INBOUND, "{}",
+                 new TestRootContext(&host_));
+  }
+
+  // Opens a connection. The host creates the plugin context on the new
+  // connection.
+  std::unique_ptr<TestStreamContext> open() {
+    auto connection = std::make_unique<TestStreamContext>(&plugin_, &host_);
+    connection->onNewConnection();
+    return connection;
+  }
+
+  void receive(TestStreamContext* connection, const std::string& data) {
+    ::Envoy::Buffer::OwnedImpl buffer(data);
+    connection->onData(buffer, false);
+  }
+
+  void send(TestStreamContext* connection, const std::string& data) {
+    ::Envoy::Buffer::OwnedImpl buffer(data);
+    connection->onWrite(buffer, false);
+  }
+
+  void tick() { plugin_.rootContext()->onTick(); }
+
+  // Sums the counters of a metric over the series whose name contains the
+  // given tag.
+  uint64_t counter(absl::string_view metric, absl::string_view tag = "") {
+    uint64_t value = 0;
+    for (const auto& counter : plugin_.statsStore().counters()) {
+      const std::string name = counter->name();
+      if (absl::EndsWith(name, metric) && absl::StrContains(name, tag)) {
+        value += counter->value();
+      }
+    }
+    return value;
+  }
+
+  MockHost host_;
+  TestPlugin plugin_;
+};
+
+TEST_F(TcpStatsTest, OpenAndCloseCounters) {
+  auto connection = open();
+  receive(connection.get(), "hello");
+  tick();
+  EXPECT_EQ(counter("istio_tcp_connections_opened_total"), 1);
+  EXPECT_EQ(counter("istio_tcp_connections_closed_total"), 0);
+
+  connection->onLog();
+  tick();
+  EXPECT_EQ(counter("istio_tcp_connections_opened_total"), 1);
+  EXPECT_EQ(counter("istio_tcp_connections_closed_total"), 1);
+}
+
+TEST_F(TcpStatsTest, ByteDeltasFlushedOnTick) {
+  auto connection = open();
+  receive(connection.get(), "0123456789");
+  send(connection.get(), "01234567890123456789");
+  tick();
+  EXPECT_EQ(counter("istio_tcp_received_bytes_total"), 10);
+  EXPECT_EQ(counter("istio_tcp_sent_bytes_total"), 20);
+
+  // Only bytes since the previous tick are added.
+  receive(connection.get(), "01234");
+  tick();
+  tick();
+  EXPECT_EQ(counter("istio_tcp_received_bytes_total"), 15);
+  EXPECT_EQ(counter("istio_tcp_sent_bytes_total"), 20);
+
+  // Close reports the bytes since the last tick only.
+  send(connection.get(), "012");
+  connection->onLog();
+  tick();
+  EXPECT_EQ(counter("istio_tcp_received_bytes_total"), 15);
+  EXPECT_EQ(counter("istio_tcp_sent_bytes_total"), 23);
+  EXPECT_EQ(counter("istio_tcp_connections_opened_total"), 1);
+  EXPECT_EQ(counter("istio_tcp_connections_closed_total"), 1);
+}
+
+TEST_F(TcpStatsTest, ResolvedWhenPeerArrives) {
+  host_.clearPeer();
+  auto connection = open();
+  receive(connection.get(), "0123456789");
+  // Counters wait for the peer metadata.
+  tick();
+  EXPECT_EQ(counter("istio_tcp_received_bytes_total"), 0);
+  EXPECT_EQ(counter("istio_tcp_connections_opened_total"), 0);
+
+  host_.setPeer(std::string(kPeerId));
+  receive(connection.get(), "01234");
+  tick();
+  const std::string peer_tag = "source_workload=.=ratings-v1;.;";
+  EXPECT_EQ(counter("istio_tcp_received_bytes_total", peer_tag), 15);
+  EXPECT_EQ(counter("istio_tcp_connections_opened_total", peer_tag), 1);
+
+  connection->onLog();
+  EXPECT_EQ(counter("istio_tcp_connections_closed_total", peer_tag), 1);
+}
+
+// A connection closed before the peer metadata arrived is reported with an
+// unknown peer.
+TEST_F(TcpStatsTest, ClosedWithoutPeer) {
+  host_.clearPeer();
+  auto connection = open();
+  receive(connection.get(), "0123456789");
+  connection->onLog();
+  const std::string unknown_tag = "source_workload=.=unknown;.;";
+  EXPECT_EQ(counter("istio_tcp_received_bytes_total", unknown_tag), 10);
+  EXPECT_EQ(counter("istio_tcp_connections_opened_total", unknown_tag), 1);
+  EXPECT_EQ(counter("istio_tcp_connections_closed_total", unknown_tag), 1);
+}
+
+// Sums the request counters of a stats plugin per series.
+std::map<std::string, uint64_t> requestCounters(TestPlugin* plugin) {
+  std::map<std::string, uint64_t> counters;
+  for (const auto& counter : plugin->statsStore().counters()) {
+    const std::string name = counter->name();
+    if (absl::EndsWith(name, "istio_requests_total")) {
+      counters[name] += counter->value();
+    }
+  }
+  return counters;
+}
+
+// Logs a request on a new stream of the plugin.
+void logRequest(TestPlugin* plugin, MockHost* host) {
+  TestStreamContext stream(plugin, host);
+  stream.onCreate(plugin->rootContext()->id());
+  stream.onLog();
+}
+
+// With share_request_info set, stackdriver logs the stream first and
+// publishes its request info, and stats on the same stream reports from it
+// what it would report from host properties.
+TEST(SharedRequestInfo, StatsReusesStackdriverRequestInfo) {
+  MockHost host;
+  host.setInboundRequest();
+
+  TestPlugin alone;
+  alone.load("stats", "envoy.wasm.stats", "stats_inbound",
+             envoy::api::v2::core::TrafficDirection::INBOUND, "{}",
+             new TestRootContext(&host));
+  logRequest(&alone, &host);
+  const auto want = requestCounters(&alone);
+  ASSERT_EQ(want.size(), 1);
+  EXPECT_TRUE(host.filterState(::Wasm::Common::kSharedRequestInfoKey).empty());
+
+  TestPlugin stackdriver;
+  stackdriver.load("stackdriver", "envoy.wasm.null.stackdriver",
+                   "stackdriver_inbound",
+                   envoy::api::v2::core::TrafficDirection::INBOUND,
+                   R"({"share_request_info": true})",
+                   new TestRootContext(&host));
+  TestPlugin stats;
+  stats.load("stats", "envoy.wasm.stats", "stats_inbound",
+             envoy::api::v2::core::TrafficDirection::INBOUND,
+             R"({"share_request_info": true})", new TestRootContext(&host));
+
+  TestStreamContext stackdriver_stream(&stackdriver, &host);
+  stackdriver_stream.onCreate(stackdriver.rootContext()->id());
+  TestStreamContext stats_stream(&stats, &host);
+  stats_stream.onCreate(stats.rootContext()->id());
+
+  stackdriver_stream.onLog();
+  ASSERT_FALSE(
+      host.filterState(::Wasm::Common::kSharedRequestInfoKey).empty());
+  // The host now answers with another response code, so stats only reports
+  // the request as before if it reuses the published request info.
+  host.setResponseCode(503);
+  stats_stream.onLog();
+  EXPECT_EQ(requestCounters(&stats), want);
+}
+
 }  // namespace Stats
 
 // WASM_EPILOG
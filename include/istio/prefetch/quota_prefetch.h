@@ -45,6 +45,11 @@ class QuotaPrefetch {
     // negative. (Its request amount is not granted).
     std::chrono::milliseconds close_wait_window;
 
+    // If true, use the token bucket implementation. Its Check() is a single
+    // atomic decrement while prefetched tokens are available, and only takes
+    // a lock to refill or to expire tokens.
+    bool use_token_bucket;
+
     // Constructor with default values.
     Options();
   };
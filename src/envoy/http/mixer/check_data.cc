@@ -16,12 +16,12 @@
 #include "src/envoy/http/mixer/check_data.h"
 
 #include "absl/strings/string_view.h"
-#include "common/common/base64.h"
 #include "src/envoy/http/jwt_auth/jwt.h"
 #include "src/envoy/http/jwt_auth/jwt_authenticator.h"
 #include "src/envoy/utils/authn.h"
 #include "src/envoy/utils/header_update.h"
 #include "src/envoy/utils/utils.h"
+#include "src/istio/utils/base64.h"
 
 using HttpCheckData = ::istio::control::http::CheckData;
 
@@ -54,7 +54,7 @@ bool CheckData::ExtractIstioAttributes(std::string* data) const {
   const HeaderEntry* entry =
       headers_.get(Utils::HeaderUpdate::IstioAttributeHeader());
   if (entry) {
-    *data = Base64::decode(std::string(entry->value().getStringView()));
+    ::istio::utils::Base64Codec::decode(entry->value().getStringView(), data);
     return true;
   }
   return false;
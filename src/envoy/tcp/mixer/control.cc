@@ -43,7 +43,9 @@ Control::Control(ControlDataSharedPtr control_data,
                      .config_pb()
                      .transport()
                      .stats_update_interval(),
-                 [this](Statistics* stat) -> bool { return GetStats(stat); }) {
+                 [this](Statistics* stat) -> bool { return GetStats(stat); }),
+      report_wheel_(dispatcher, control_data_->config().report_interval_ms(),
+                    random) {
   auto& logger = Logger::Registry::getLog(Logger::Id::config);
   LocalNode local_node;
   if (!Utils::ExtractNodeInfo(local_info.node(), &local_node)) {
@@ -24,6 +24,7 @@
 #include "include/istio/control/tcp/controller.h"
 #include "include/istio/utils/local_attributes.h"
 #include "src/envoy/tcp/mixer/config.h"
+#include "src/envoy/utils/report_wheel.h"
 #include "src/envoy/utils/stats.h"
 
 namespace Envoy {
@@ -64,6 +65,9 @@ class Control final : public ThreadLocal::ThreadLocalObject {
 
   const Config& config() const { return control_data_->config(); }
 
+  // Runs the periodic reports of the connections of this worker.
+  Utils::ReportWheel& reportWheel() { return report_wheel_; }
+
  private:
   // Call controller to get statistics.
   bool GetStats(::istio::mixerclient::Statistics* stat);
@@ -86,6 +90,9 @@ class Control final : public ThreadLocal::ThreadLocalObject {
 
   // The mixer control
   std::unique_ptr<::istio::control::tcp::Controller> controller_;
+
+  // Periodic reports of connections.
+  Utils::ReportWheel report_wheel_;
 };
 
 }  // namespace Mixer
@@ -71,23 +71,11 @@ void Filter::cacheFilterMetadata(
   for (auto &filter_pair : filter_metadata) {
     if (filter_pair.first ==
         Extensions::NetworkFilters::NetworkFilterNames::get().MongoProxy) {
-      if (cached_filter_metadata_.count(filter_pair.first) == 0) {
-        ProtobufWkt::Struct dynamic_metadata;
-        cached_filter_metadata_[filter_pair.first] = dynamic_metadata;
-      }
-
-      auto &cached_fields =
-          *cached_filter_metadata_[filter_pair.first].mutable_fields();
-      for (const auto &message_pair : filter_pair.second.fields()) {
-        cached_fields[message_pair.first].mutable_list_value()->CopyFrom(
-            message_pair.second.list_value());
-      }
+      filter_metadata_cache_.update(filter_pair.first, filter_pair.second);
     }
   }
 }
 
-void Filter::clearCachedFilterMetadata() { cached_filter_metadata_.clear(); }
-
 // Network::ReadFilter
 Network::FilterStatus Filter::onData(Buffer::Instance &data, bool) {
   if (state_ == State::NotStarted) {
@@ -105,7 +93,8 @@ Network::FilterStatus Filter::onData(Buffer::Instance &data, bool) {
   // on a timer event, it's possible that the previously set metadata is cleared
   // off by the time the event is fired. Therefore, we append metadata from each
   // onData call to a local cache and send it all at once when the timer event
-  // occurs. The local cache is cleared after reporting it on the timer event.
+  // occurs. Metadata that is not seen again is dropped from the local cache
+  // after reporting it on the timer event.
   cacheFilterMetadata(filter_callbacks_->connection()
                           .streamInfo()
                           .dynamicMetadata()
@@ -160,9 +149,8 @@ void Filter::completeCheck(const CheckResponseInfo &info) {
       filter_callbacks_->continueReading();
     }
     handler_->Report(this, ConnectionEvent::OPEN);
-    report_timer_ =
-        control_.dispatcher().createTimer([this]() { OnReportTimer(); });
-    report_timer_->enableTimer(control_.config().report_interval_ms());
+    report_entry_ =
+        control_.reportWheel().add([this]() { OnReportTimer(); });
   }
 }
 
@@ -180,9 +168,8 @@ void Filter::onEvent(Network::ConnectionEvent event) {
   if (event == Network::ConnectionEvent::RemoteClose ||
       event == Network::ConnectionEvent::LocalClose) {
     if (state_ != State::Closed && handler_) {
-      if (report_timer_) {
-        report_timer_->disableTimer();
-      }
+      report_entry_.reset();
+      filter_metadata_cache_.prune();
       handler_->Report(this, ConnectionEvent::CLOSE);
     }
     cancelCheck();
@@ -228,7 +215,7 @@ bool Filter::GetDestinationUID(std::string *uid) const {
 
 const ::google::protobuf::Map<std::string, ::google::protobuf::Struct>
     &Filter::GetDynamicFilterState() const {
-  return cached_filter_metadata_;
+  return filter_metadata_cache_.metadata();
 }
 
 void Filter::GetReportInfo(
@@ -248,9 +235,9 @@ std::string Filter::GetConnectionId() const {
 }
 
 void Filter::OnReportTimer() {
+  filter_metadata_cache_.prune();
   handler_->Report(this, ConnectionEvent::CONTINUE);
-  clearCachedFilterMetadata();
-  report_timer_->enableTimer(control_.config().report_interval_ms());
+  filter_metadata_cache_.startInterval();
 }
 
 }  // namespace Mixer
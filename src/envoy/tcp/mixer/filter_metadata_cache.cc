@@ -0,0 +1,104 @@
+/* Copyright 2020 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/envoy/tcp/mixer/filter_metadata_cache.h"
+
+#include "google/protobuf/util/message_differencer.h"
+
+namespace Envoy {
+namespace Tcp {
+namespace Mixer {
+
+namespace {
+
+// Returns true if both list values hold the same values. Lists of strings,
+// which is what protocol filters like mongo_proxy emit, are compared without
+// reflection.
+bool equalListValues(const ::google::protobuf::ListValue& lhs,
+                     const ::google::protobuf::ListValue& rhs) {
+  if (lhs.values_size() != rhs.values_size()) {
+    return false;
+  }
+  for (int i = 0; i < lhs.values_size(); i++) {
+    const auto& left = lhs.values(i);
+    const auto& right = rhs.values(i);
+    if (left.kind_case() != right.kind_case()) {
+      return false;
+    }
+    if (left.kind_case() == ::google::protobuf::Value::kStringValue) {
+      if (left.string_value() != right.string_value()) {
+        return false;
+      }
+    } else if (!::google::protobuf::util::MessageDifferencer::Equals(left,
+                                                                      right)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+void FilterMetadataCache::update(const std::string& filter_name,
+                                 const ::google::protobuf::Struct& metadata) {
+  auto& interval = intervals_[filter_name];
+  interval.seen = true;
+  auto& cached_fields = *metadata_[filter_name].mutable_fields();
+  for (const auto& field : metadata.fields()) {
+    if (!interval.unseen_fields.empty()) {
+      interval.unseen_fields.erase(field.first);
+    }
+    const auto& list_value = field.second.list_value();
+    auto cached_it = cached_fields.find(field.first);
+    // Copying into a cached list reuses its values and strings.
+    if (cached_it != cached_fields.end() &&
+        equalListValues(cached_it->second.list_value(), list_value)) {
+      continue;
+    }
+    cached_fields[field.first].mutable_list_value()->CopyFrom(list_value);
+  }
+}
+
+void FilterMetadataCache::prune() {
+  for (auto it = intervals_.begin(); it != intervals_.end();) {
+    auto& interval = it->second;
+    if (!interval.seen) {
+      metadata_.erase(it->first);
+      it = intervals_.erase(it);
+      continue;
+    }
+    auto& cached_fields = *metadata_[it->first].mutable_fields();
+    for (const auto& name : interval.unseen_fields) {
+      cached_fields.erase(name);
+    }
+    interval.unseen_fields.clear();
+    ++it;
+  }
+}
+
+void FilterMetadataCache::startInterval() {
+  for (const auto& filter : metadata_) {
+    auto& interval = intervals_[filter.first];
+    interval.seen = false;
+    interval.unseen_fields.clear();
+    for (const auto& field : filter.second.fields()) {
+      interval.unseen_fields.insert(field.first);
+    }
+  }
+}
+
+}  // namespace Mixer
+}  // namespace Tcp
+}  // namespace Envoy
@@ -0,0 +1,68 @@
+/* Copyright 2020 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "google/protobuf/map.h"
+#include "google/protobuf/struct.pb.h"
+
+namespace Envoy {
+namespace Tcp {
+namespace Mixer {
+
+// FilterMetadataCache accumulates the dynamic metadata of filters over the
+// data events of a connection, for its periodic reports. A report holds the
+// list fields seen since the previous report, with their latest values.
+// Fields are kept in memory across reports, so that the unchanged fields that
+// most data events carry are compared rather than copied again.
+class FilterMetadataCache {
+ public:
+  // Merges the list fields of the metadata of a filter.
+  void update(const std::string& filter_name,
+              const ::google::protobuf::Struct& metadata);
+
+  // Drops the metadata that was not seen since the last call to
+  // startInterval(). Called before a report.
+  void prune();
+
+  // Starts a new report interval. Called after a report.
+  void startInterval();
+
+  // Metadata by filter name. Only holds the metadata seen in the current
+  // interval after prune().
+  const ::google::protobuf::Map<std::string, ::google::protobuf::Struct>&
+  metadata() const {
+    return metadata_;
+  }
+
+ private:
+  // Whether a filter and which of its fields were seen in the current
+  // interval.
+  struct Interval {
+    bool seen = false;
+    std::unordered_set<std::string> unseen_fields;
+  };
+
+  ::google::protobuf::Map<std::string, ::google::protobuf::Struct> metadata_;
+  std::unordered_map<std::string, Interval> intervals_;
+};
+
+}  // namespace Mixer
+}  // namespace Tcp
+}  // namespace Envoy
@@ -0,0 +1,114 @@
+/* Copyright 2020 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/envoy/tcp/mixer/filter_metadata_cache.h"
+
+#include <initializer_list>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Tcp {
+namespace Mixer {
+namespace {
+
+const char kMongo[] = "envoy.filters.network.mongo_proxy";
+
+::google::protobuf::Struct metadata(
+    std::initializer_list<std::pair<std::string, std::vector<std::string>>>
+        fields) {
+  ::google::protobuf::Struct metadata;
+  for (const auto& field : fields) {
+    auto* list = (*metadata.mutable_fields())[field.first].mutable_list_value();
+    for (const auto& value : field.second) {
+      list->add_values()->set_string_value(value);
+    }
+  }
+  return metadata;
+}
+
+std::vector<std::string> values(const FilterMetadataCache& cache,
+                                const std::string& field) {
+  std::vector<std::string> values;
+  const auto& fields = cache.metadata().at(kMongo).fields();
+  for (const auto& value : fields.at(field).list_value().values()) {
+    values.push_back(value.string_value());
+  }
+  return values;
+}
+
+// Reports as the filter does on the report timer.
+void report(FilterMetadataCache* cache) {
+  cache->prune();
+  cache->startInterval();
+}
+
+TEST(FilterMetadataCacheTest, RepeatedMetadata) {
+  FilterMetadataCache cache;
+  cache.update(kMongo, metadata({{"db.coll", {"query", "insert"}}}));
+  cache.update(kMongo, metadata({{"db.coll", {"query", "insert"}}}));
+  cache.prune();
+  EXPECT_EQ(values(cache, "db.coll"),
+            std::vector<std::string>({"query", "insert"}));
+  cache.startInterval();
+
+  // Metadata repeated in the next interval is kept for the next report.
+  cache.update(kMongo, metadata({{"db.coll", {"query", "insert"}}}));
+  cache.prune();
+  EXPECT_EQ(cache.metadata().at(kMongo).fields().size(), 1);
+  EXPECT_EQ(values(cache, "db.coll"),
+            std::vector<std::string>({"query", "insert"}));
+}
+
+TEST(FilterMetadataCacheTest, ChangedMetadata) {
+  FilterMetadataCache cache;
+  cache.update(kMongo, metadata({{"db.coll", {"query"}}}));
+  cache.update(kMongo, metadata({{"db.coll", {"query", "update"}}}));
+  cache.prune();
+  EXPECT_EQ(values(cache, "db.coll"),
+            std::vector<std::string>({"query", "update"}));
+  cache.startInterval();
+
+  cache.update(kMongo, metadata({{"db.coll", {"delete"}}}));
+  cache.prune();
+  EXPECT_EQ(values(cache, "db.coll"), std::vector<std::string>({"delete"}));
+}
+
+TEST(FilterMetadataCacheTest, UnseenMetadataIsDropped) {
+  FilterMetadataCache cache;
+  cache.update(kMongo, metadata({{"db.a", {"query"}}, {"db.b", {"insert"}}}));
+  report(&cache);
+
+  // Only the fields seen since the last report are reported.
+  cache.update(kMongo, metadata({{"db.b", {"insert"}}}));
+  cache.prune();
+  EXPECT_EQ(cache.metadata().at(kMongo).fields().count("db.a"), 0);
+  EXPECT_EQ(values(cache, "db.b"), std::vector<std::string>({"insert"}));
+  cache.startInterval();
+
+  // A filter with no data events since the last report is not reported.
+  cache.prune();
+  EXPECT_TRUE(cache.metadata().empty());
+
+  cache.update(kMongo, metadata({{"db.a", {"query"}}}));
+  cache.prune();
+  EXPECT_EQ(values(cache, "db.a"), std::vector<std::string>({"query"}));
+}
+
+}  // namespace
+}  // namespace Mixer
+}  // namespace Tcp
+}  // namespace Envoy
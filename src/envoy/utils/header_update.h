@@ -15,10 +15,10 @@
 
 #pragma once
 
-#include "common/common/base64.h"
 #include "common/common/logger.h"
 #include "envoy/http/header_map.h"
 #include "include/istio/control/http/controller.h"
+#include "src/istio/utils/base64.h"
 
 namespace Envoy {
 namespace Utils {
@@ -41,7 +41,7 @@ class HeaderUpdate : public ::istio::control::http::HeaderUpdate,
 
   // base64 encode data, and add it to the HTTP header.
   void AddIstioAttributes(const std::string& data) override {
-    std::string base64 = Base64::encode(data.c_str(), data.size());
+    std::string base64 = ::istio::utils::Base64Codec::encode(data);
     ENVOY_LOG(debug, "Mixer forward attributes set: {}", base64);
     headers_->setReferenceKey(kIstioAttributeHeader, base64);
   }
@@ -0,0 +1,72 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/envoy/utils/report_wheel.h"
+
+#include <algorithm>
+
+namespace Envoy {
+namespace Utils {
+
+ReportWheel::Entry::~Entry() {
+  list_->erase(it_);
+  wheel_.size_--;
+}
+
+ReportWheel::ReportWheel(Event::Dispatcher& dispatcher,
+                         std::chrono::milliseconds interval,
+                         Runtime::RandomGenerator& random, uint32_t slots)
+    : timer_(dispatcher.createTimer([this]() { onTick(); })),
+      random_(random),
+      slots_(std::max<uint32_t>(slots, 1)) {
+  tick_ = std::max(interval / slots_.size(), std::chrono::milliseconds(1));
+}
+
+ReportWheel::EntryPtr ReportWheel::add(std::function<void()> callback) {
+  EntryPtr entry(new Entry(*this, std::move(callback)));
+  // Between half and one rotation ahead of the current slot.
+  const size_t half = slots_.size() / 2;
+  const size_t ahead = slots_.size() - half + random_.random() % (half + 1);
+  auto& slot = slots_[(hand_ + ahead) % slots_.size()];
+  entry->list_ = &slot;
+  entry->it_ = slot.insert(slot.end(), entry.get());
+  if (size_++ == 0) {
+    timer_->enableTimer(tick_);
+  }
+  return entry;
+}
+
+void ReportWheel::onTick() {
+  hand_ = (hand_ + 1) % slots_.size();
+  auto& slot = slots_[hand_];
+  due_.splice(due_.end(), slot);
+  for (Entry* entry : due_) {
+    entry->list_ = &due_;
+  }
+  // Every entry moves back to its slot before its callback runs, so that a
+  // callback can destroy any entry.
+  while (!due_.empty()) {
+    Entry* entry = due_.front();
+    slot.splice(slot.end(), due_, due_.begin());
+    entry->list_ = &slot;
+    entry->callback_();
+  }
+  if (size_ > 0) {
+    timer_->enableTimer(tick_);
+  }
+}
+
+}  // namespace Utils
+}  // namespace Envoy
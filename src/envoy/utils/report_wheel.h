@@ -0,0 +1,84 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/runtime/runtime.h"
+
+namespace Envoy {
+namespace Utils {
+
+// ReportWheel runs periodic callbacks, e.g. reports of long-lived
+// connections, from one dispatcher timer. It is a hashed timer wheel with one
+// rotation per interval: the interval is split into slots, and the timer
+// fires once per slot to run all callbacks in it. Every callback is placed in
+// a random slot between half and one interval ahead, so callbacks that are
+// added together do not run together, and then runs once per interval.
+// ReportWheel is not thread safe, and is meant to be owned by a worker.
+class ReportWheel {
+ public:
+  // Entry is the registration of a callback. Destroying it removes the
+  // callback from the wheel, also from within a callback.
+  class Entry {
+   public:
+    ~Entry();
+
+   private:
+    friend class ReportWheel;
+
+    Entry(ReportWheel& wheel, std::function<void()> callback)
+        : wheel_(wheel), callback_(std::move(callback)) {}
+
+    ReportWheel& wheel_;
+    std::function<void()> callback_;
+    // The list that holds this entry, and the position in it.
+    std::list<Entry*>* list_{};
+    std::list<Entry*>::iterator it_;
+  };
+  typedef std::unique_ptr<Entry> EntryPtr;
+
+  ReportWheel(Event::Dispatcher& dispatcher, std::chrono::milliseconds interval,
+              Runtime::RandomGenerator& random, uint32_t slots = 64);
+
+  // Adds a callback, which first runs after half to one interval, and then
+  // once per interval.
+  EntryPtr add(std::function<void()> callback);
+
+  size_t size() const { return size_; }
+
+ private:
+  // Runs the callbacks of the current slot and advances to the next one.
+  void onTick();
+
+  Event::TimerPtr timer_;
+  Runtime::RandomGenerator& random_;
+  std::chrono::milliseconds tick_;
+  std::vector<std::list<Entry*>> slots_;
+  // Entries of the current slot that have yet to run in this tick.
+  std::list<Entry*> due_;
+  size_t hand_{};
+  size_t size_{};
+};
+
+}  // namespace Utils
+}  // namespace Envoy
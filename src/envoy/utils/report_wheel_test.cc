@@ -0,0 +1,115 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/envoy/utils/report_wheel.h"
+
+#include "gmock/gmock.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/runtime/mocks.h"
+#include "test/test_common/utility.h"
+
+using Envoy::Utils::ReportWheel;
+using testing::_;
+using testing::NiceMock;
+using testing::Return;
+
+namespace {
+
+class ReportWheelTest : public ::testing::Test {
+ protected:
+  ReportWheelTest()
+      : timer_(new NiceMock<Envoy::Event::MockTimer>(&dispatcher_)) {
+    ON_CALL(random_, random()).WillByDefault(Return(0));
+  }
+
+  // Fires the timer n times.
+  void tick(int n) {
+    for (int i = 0; i < n; i++) {
+      timer_->callback_();
+    }
+  }
+
+  NiceMock<Envoy::Event::MockDispatcher> dispatcher_;
+  NiceMock<Envoy::Runtime::MockRandomGenerator> random_;
+  // Owned by the wheel.
+  Envoy::Event::MockTimer* timer_;
+};
+
+// With 4 slots, entries run after 2 to 4 ticks, and then every 4 ticks.
+TEST_F(ReportWheelTest, RunsOncePerInterval) {
+  // Once on the first add, and after every tick.
+  EXPECT_CALL(*timer_, enableTimer(std::chrono::milliseconds(100), _))
+      .Times(13);
+  ReportWheel wheel(dispatcher_, std::chrono::milliseconds(400), random_, 4);
+
+  int runs_a = 0;
+  int runs_b = 0;
+  auto a = wheel.add([&runs_a]() { runs_a++; });
+  EXPECT_CALL(random_, random()).WillOnce(Return(2));
+  auto b = wheel.add([&runs_b]() { runs_b++; });
+  EXPECT_EQ(wheel.size(), 2);
+
+  tick(1);
+  EXPECT_EQ(runs_a, 0);
+  tick(1);
+  EXPECT_EQ(runs_a, 1);
+  EXPECT_EQ(runs_b, 0);
+  tick(2);
+  EXPECT_EQ(runs_a, 1);
+  EXPECT_EQ(runs_b, 1);
+  tick(4);
+  EXPECT_EQ(runs_a, 2);
+  EXPECT_EQ(runs_b, 2);
+
+  a.reset();
+  tick(4);
+  EXPECT_EQ(runs_a, 2);
+  EXPECT_EQ(runs_b, 3);
+  EXPECT_EQ(wheel.size(), 1);
+}
+
+// Callbacks may remove any entry, including their own and due ones.
+TEST_F(ReportWheelTest, RemoveFromCallback) {
+  ReportWheel wheel(dispatcher_, std::chrono::milliseconds(400), random_, 4);
+
+  int runs = 0;
+  ReportWheel::EntryPtr a, b, c;
+  a = wheel.add([&]() {
+    runs++;
+    a.reset();
+    c.reset();
+  });
+  b = wheel.add([&]() { runs++; });
+  c = wheel.add([&]() { runs++; });
+
+  tick(2);
+  EXPECT_EQ(runs, 2);
+  EXPECT_EQ(wheel.size(), 1);
+  tick(4);
+  EXPECT_EQ(runs, 3);
+}
+
+// The timer only runs while there are entries.
+TEST_F(ReportWheelTest, IdleWithoutEntries) {
+  ReportWheel wheel(dispatcher_, std::chrono::milliseconds(400), random_, 4);
+  auto a = wheel.add([]() {});
+  a.reset();
+  EXPECT_CALL(*timer_, enableTimer(_, _)).Times(0);
+  tick(1);
+  EXPECT_CALL(*timer_, enableTimer(_, _));
+  a = wheel.add([]() {});
+}
+
+}  // namespace
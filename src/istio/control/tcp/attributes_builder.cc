@@ -84,7 +84,7 @@ void AttributesBuilder::ExtractCheckAttributes(CheckData *check_data) {
 void AttributesBuilder::ExtractReportAttributes(
     const ::google::protobuf::util::Status &status, ReportData *report_data,
     ReportData::ConnectionEvent event,
-    ReportData::ReportInfo *last_report_info) {
+    ReportData::ReportInfo *last_report_info, bool *destination_extracted) {
   utils::AttributesBuilder builder(attributes_);
 
   ReportData::ReportInfo info;
@@ -117,21 +117,29 @@ void AttributesBuilder::ExtractReportAttributes(
                       kConnectionContinue);
   }
 
-  std::string dest_ip;
-  int dest_port;
-  // Do not overwrite destination IP and port if it has already been set.
-  if (report_data->GetDestinationIpPort(&dest_ip, &dest_port)) {
-    if (!builder.HasAttribute(utils::AttributeName::kDestinationIp)) {
-      builder.AddBytes(utils::AttributeName::kDestinationIp, dest_ip);
+  if (!*destination_extracted) {
+    std::string dest_ip;
+    int dest_port;
+    // Do not overwrite destination IP and port if it has already been set.
+    const bool has_ip_port =
+        report_data->GetDestinationIpPort(&dest_ip, &dest_port);
+    if (has_ip_port) {
+      if (!builder.HasAttribute(utils::AttributeName::kDestinationIp)) {
+        builder.AddBytes(utils::AttributeName::kDestinationIp, dest_ip);
+      }
+      if (!builder.HasAttribute(utils::AttributeName::kDestinationPort)) {
+        builder.AddInt64(utils::AttributeName::kDestinationPort, dest_port);
+      }
     }
-    if (!builder.HasAttribute(utils::AttributeName::kDestinationPort)) {
-      builder.AddInt64(utils::AttributeName::kDestinationPort, dest_port);
-    }
-  }
 
-  std::string uid;
-  if (report_data->GetDestinationUID(&uid)) {
-    builder.AddString(utils::AttributeName::kDestinationUID, uid);
+    std::string uid;
+    const bool has_uid = report_data->GetDestinationUID(&uid);
+    if (has_uid) {
+      builder.AddString(utils::AttributeName::kDestinationUID, uid);
+    }
+    // The upstream host may not be known yet, e.g. for the open report, so
+    // destination attributes are extracted again until all were found.
+    *destination_extracted = has_ip_port && has_uid;
   }
 
   builder.FlattenMapOfStringToStruct(report_data->GetDynamicFilterState());
@@ -32,11 +32,15 @@ class AttributesBuilder {
 
   // Extract attributes for Check.
   void ExtractCheckAttributes(CheckData* check_data);
-  // Extract attributes for Report.
+  // Extract attributes for Report. Reports of a connection update the same
+  // attributes. Destination attributes do not change over a connection, so
+  // they are only extracted while *destination_extracted is false, which is
+  // set once all of them were found.
   void ExtractReportAttributes(const ::google::protobuf::util::Status& status,
                                ReportData* report_data,
                                ReportData::ConnectionEvent event,
-                               ReportData::ReportInfo* last_report_info);
+                               ReportData::ReportInfo* last_report_info,
+                               bool* destination_extracted);
 
  private:
   istio::mixer::v1::Attributes* attributes_;
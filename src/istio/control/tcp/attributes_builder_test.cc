@@ -489,16 +489,15 @@ TEST(AttributesBuilderTest, TestReportAttributes) {
   filter_metadata["foo.bar.com"] = struct_obj;
   filter_metadata["istio.mixer"] = struct_obj;  // to be ignored
 
+  // Destination attributes are only extracted for the first report.
   EXPECT_CALL(mock_data, GetDestinationIpPort(_, _))
-      .Times(4)
-      .WillRepeatedly(Invoke([](std::string *ip, int *port) -> bool {
+      .WillOnce(Invoke([](std::string *ip, int *port) -> bool {
         *ip = "1.2.3.4";
         *port = 8080;
         return true;
       }));
   EXPECT_CALL(mock_data, GetDestinationUID(_))
-      .Times(4)
-      .WillRepeatedly(Invoke([](std::string *uid) -> bool {
+      .WillOnce(Invoke([](std::string *uid) -> bool {
         *uid = "pod1.ns2";
         return true;
       }));
@@ -535,10 +534,12 @@ TEST(AttributesBuilderTest, TestReportAttributes) {
 
   ReportData::ReportInfo last_report_info{0ULL, 0ULL,
                                           std::chrono::nanoseconds::zero()};
+  bool destination_extracted = false;
   // Verify first open report
   builder.ExtractReportAttributes(check_status, &mock_data,
                                   ReportData::ConnectionEvent::OPEN,
-                                  &last_report_info);
+                                  &last_report_info,
+                                  &destination_extracted);
   ClearContextTime(&attributes);
 
   std::string out_str;
@@ -555,7 +556,8 @@ TEST(AttributesBuilderTest, TestReportAttributes) {
   // Verify delta one report
   builder.ExtractReportAttributes(check_status, &mock_data,
                                   ReportData::ConnectionEvent::CONTINUE,
-                                  &last_report_info);
+                                  &last_report_info,
+                                  &destination_extracted);
   ClearContextTime(&attributes);
 
   TextFormat::PrintToString(attributes, &out_str);
@@ -572,7 +574,8 @@ TEST(AttributesBuilderTest, TestReportAttributes) {
   // Verify delta two report
   builder.ExtractReportAttributes(check_status, &mock_data,
                                   ReportData::ConnectionEvent::CONTINUE,
-                                  &last_report_info);
+                                  &last_report_info,
+                                  &destination_extracted);
   ClearContextTime(&attributes);
 
   out_str.clear();
@@ -590,7 +593,8 @@ TEST(AttributesBuilderTest, TestReportAttributes) {
   // Verify final report
   builder.ExtractReportAttributes(check_status, &mock_data,
                                   ReportData::ConnectionEvent::CLOSE,
-                                  &last_report_info);
+                                  &last_report_info,
+                                  &destination_extracted);
   ClearContextTime(&attributes);
 
   out_str.clear();
@@ -604,6 +608,69 @@ TEST(AttributesBuilderTest, TestReportAttributes) {
       MessageDifferencer::Equals(attributes, expected_final_attributes));
 }
 
+// Destination attributes are extracted again until the upstream host is known,
+// which it may not be for the open report.
+TEST(AttributesBuilderTest, TestReportAttributesWithoutUpstreamHost) {
+  ::testing::NiceMock<MockReportData> mock_data;
+  ::google::protobuf::Map<std::string, ::google::protobuf::Struct>
+      filter_metadata;
+  EXPECT_CALL(mock_data, GetDynamicFilterState())
+      .WillRepeatedly(ReturnRef(filter_metadata));
+  EXPECT_CALL(mock_data, GetReportInfo(_))
+      .WillRepeatedly(Invoke([](ReportData::ReportInfo *info) {
+        info->received_bytes = 0;
+        info->send_bytes = 0;
+        info->duration = std::chrono::nanoseconds(1);
+      }));
+  EXPECT_CALL(mock_data, GetDestinationIpPort(_, _))
+      .WillOnce(Return(false))
+      .WillOnce(Invoke([](std::string *ip, int *port) -> bool {
+        *ip = "1.2.3.4";
+        *port = 8080;
+        return true;
+      }));
+  EXPECT_CALL(mock_data, GetDestinationUID(_))
+      .WillOnce(Return(false))
+      .WillOnce(Invoke([](std::string *uid) -> bool {
+        *uid = "pod1.ns2";
+        return true;
+      }));
+
+  istio::mixer::v1::Attributes attributes;
+  AttributesBuilder builder(&attributes);
+  ReportData::ReportInfo last_report_info{0ULL, 0ULL,
+                                          std::chrono::nanoseconds::zero()};
+  bool destination_extracted = false;
+  builder.ExtractReportAttributes(
+      ::google::protobuf::util::Status::OK, &mock_data,
+      ReportData::ConnectionEvent::OPEN, &last_report_info,
+      &destination_extracted);
+  EXPECT_FALSE(destination_extracted);
+  EXPECT_EQ(0, attributes.attributes().count(
+                   utils::AttributeName::kDestinationUID));
+
+  builder.ExtractReportAttributes(
+      ::google::protobuf::util::Status::OK, &mock_data,
+      ReportData::ConnectionEvent::CONTINUE, &last_report_info,
+      &destination_extracted);
+  EXPECT_TRUE(destination_extracted);
+  EXPECT_EQ("pod1.ns2", attributes.attributes()
+                            .at(utils::AttributeName::kDestinationUID)
+                            .string_value());
+  EXPECT_EQ("1.2.3.4", attributes.attributes()
+                           .at(utils::AttributeName::kDestinationIp)
+                           .bytes_value());
+
+  // Not looked up again.
+  builder.ExtractReportAttributes(
+      ::google::protobuf::util::Status::OK, &mock_data,
+      ReportData::ConnectionEvent::CLOSE, &last_report_info,
+      &destination_extracted);
+  EXPECT_EQ("pod1.ns2", attributes.attributes()
+                            .at(utils::AttributeName::kDestinationUID)
+                            .string_value());
+}
+
 }  // namespace
 }  // namespace tcp
 }  // namespace control
@@ -80,7 +80,7 @@ void RequestHandlerImpl::Report(ReportData* report_data,
 
   AttributesBuilder builder(attributes_->attributes());
   builder.ExtractReportAttributes(check_context_->status(), report_data, event,
-                                  &last_report_info_);
+                                  &last_report_info_, &destination_extracted_);
 
   client_context_->SendReport(attributes_);
 }
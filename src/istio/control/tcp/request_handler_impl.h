@@ -58,6 +58,10 @@ class RequestHandlerImpl : public RequestHandler {
   // Delta information includes incremented sent bytes and received bytes
   // between last report and this report.
   ReportData::ReportInfo last_report_info_;
+
+  // Whether all destination attributes have been extracted by Report()
+  // calls.
+  bool destination_extracted_{};
 };
 
 }  // namespace tcp
@@ -19,6 +19,7 @@
 
 #include "src/istio/prefetch/circular_queue.h"
 #include "src/istio/prefetch/time_based_counter.h"
+#include "src/istio/prefetch/token_bucket_prefetch.h"
 #include "src/istio/utils/logger.h"
 
 using namespace std::chrono;
@@ -301,11 +302,15 @@ bool QuotaPrefetchImpl::Check(int amount, Tick t) {
 QuotaPrefetch::Options::Options()
     : predict_window(kPredictWindowInMs),
       min_prefetch_amount(kMinPrefetchAmount),
-      close_wait_window(kCloseWaitWindowInMs) {}
+      close_wait_window(kCloseWaitWindowInMs),
+      use_token_bucket(false) {}
 
 std::unique_ptr<QuotaPrefetch> QuotaPrefetch::Create(TransportFunc transport,
                                                      const Options& options,
                                                      Tick t) {
+  if (options.use_token_bucket) {
+    return CreateTokenBucketPrefetch(transport, options, t);
+  }
   return std::unique_ptr<QuotaPrefetch>(
       new QuotaPrefetchImpl(transport, options, t));
 }
@@ -0,0 +1,121 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "include/istio/prefetch/quota_prefetch.h"
+
+using namespace std::chrono;
+using Tick = ::istio::prefetch::QuotaPrefetch::Tick;
+using DoneFunc = ::istio::prefetch::QuotaPrefetch::DoneFunc;
+
+namespace istio {
+namespace prefetch {
+namespace {
+
+// Grants every requested amount in full. Like the mixer client, responses
+// arrive later and outside of Check(): checking threads deliver them between
+// checks.
+class Granter {
+ public:
+  QuotaPrefetch::TransportFunc GetTransportFunc() {
+    return [this](int amount, DoneFunc fn, Tick) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.emplace_back(amount, fn);
+      has_pending_.store(true, std::memory_order_release);
+    };
+  }
+
+  void Deliver(Tick t) {
+    if (!has_pending_.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::vector<std::pair<int, DoneFunc>> ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready.swap(pending_);
+      has_pending_.store(false, std::memory_order_release);
+    }
+    for (const auto& response : ready) {
+      response.second(response.first, hours(1), t);
+    }
+  }
+
+ private:
+  std::atomic<bool> has_pending_{false};
+  std::mutex mutex_;
+  std::vector<std::pair<int, DoneFunc>> pending_;
+};
+
+// A prefetch shared by all benchmark threads.
+struct Fixture {
+  explicit Fixture(bool use_token_bucket) : t(system_clock::now()) {
+    QuotaPrefetch::Options options;
+    options.use_token_bucket = use_token_bucket;
+    prefetch = QuotaPrefetch::Create(granter.GetTransportFunc(), options, t);
+  }
+
+  Tick t;
+  Granter granter;
+  std::unique_ptr<QuotaPrefetch> prefetch;
+};
+
+// Checks one token per iteration, and reports the fraction of checks which
+// were rejected as the granted tokens ran out before the refill arrived.
+void RunCheck(benchmark::State& state, Fixture& fixture) {
+  int64_t rejected = 0;
+  for (auto _ : state) {
+    if (!fixture.prefetch->Check(1, fixture.t)) {
+      rejected++;
+    }
+    fixture.granter.Deliver(fixture.t);
+  }
+  state.counters["rejected_per_check"] = benchmark::Counter(
+      static_cast<double>(rejected), benchmark::Counter::kAvgIterations);
+}
+
+// The default implementation, which locks a mutex and scans its circular
+// queue on every check.
+static void BM_CheckCircularQueue(benchmark::State& state) {
+  static Fixture fixture(false);
+  RunCheck(state, fixture);
+}
+BENCHMARK(BM_CheckCircularQueue)->ThreadRange(1, 16)->UseRealTime();
+
+// The token bucket implementation, which takes tokens with an atomic
+// decrement.
+static void BM_CheckTokenBucket(benchmark::State& state) {
+  static Fixture fixture(true);
+  RunCheck(state, fixture);
+}
+BENCHMARK(BM_CheckTokenBucket)->ThreadRange(1, 16)->UseRealTime();
+
+}  // namespace
+}  // namespace prefetch
+}  // namespace istio
+
+// Boilerplate main(), which discovers benchmarks in the same file and runs
+// them.
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+}
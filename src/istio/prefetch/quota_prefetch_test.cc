@@ -15,8 +15,12 @@
 
 #include "include/istio/prefetch/quota_prefetch.h"
 
+#include <atomic>
 #include <list>
+#include <mutex>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -220,6 +224,7 @@ class QuotaPrefetchTest : public ::testing::Test {
                         const TestResult& result) {
     Tick t;
     QuotaPrefetch::Options options;
+    options.use_token_bucket = use_token_bucket_;
     auto client = QuotaPrefetch::Create(GetTransportFunc(), options, t);
     if (rolling_window) {
       rate_server_ = std::unique_ptr<RateServer>(
@@ -275,6 +280,7 @@ class QuotaPrefetchTest : public ::testing::Test {
                       const TestResult& result) {
     Tick t;
     QuotaPrefetch::Options options;
+    options.use_token_bucket = use_token_bucket_;
     auto client1 = QuotaPrefetch::Create(GetTransportFunc(), options, t);
     auto client2 = QuotaPrefetch::Create(GetTransportFunc(), options, t);
     if (rolling_window) {
@@ -313,6 +319,7 @@ class QuotaPrefetchTest : public ::testing::Test {
 
   std::unique_ptr<RateServer> rate_server_;
   Delay delay_;
+  bool use_token_bucket_ = false;
 };
 
 TEST_F(QuotaPrefetchTest, TestBigRollingWindow) {
@@ -418,6 +425,122 @@ TEST_F(QuotaPrefetchTest, TestNotEnoughAmount) {
   delay_.OnTimer(t);
 }
 
+TEST_F(QuotaPrefetchTest, TestTokenBucketBigRollingWindow) {
+  use_token_bucket_ = true;
+  TestSingleClient(true,  // use rolling window,
+                   kPerMinuteWindow,
+                   {.margin1 = 0.0,
+                    .margin2 = 0.006,
+                    .margin3 = 0.002,
+                    .margin4 = 0.0,
+                    .margin5 = 0.06});
+}
+
+TEST_F(QuotaPrefetchTest, TestTokenBucketSmallRollingWindow) {
+  use_token_bucket_ = true;
+  TestSingleClient(true,  // use rolling window,
+                   kPerSecondWindow,
+                   {.margin1 = 0.29,
+                    .margin2 = 0.25,
+                    .margin3 = 0.2,
+                    .margin4 = 0.18,
+                    .margin5 = 0.25});
+}
+
+TEST_F(QuotaPrefetchTest, TestTokenBucketBigTimeBased) {
+  use_token_bucket_ = true;
+  TestSingleClient(false,  // use time based.
+                   kPerMinuteWindow,
+                   {.margin1 = 0.0,
+                    .margin2 = 0.0,
+                    .margin3 = 0.085,
+                    .margin4 = 0.0,
+                    .margin5 = 0.1});
+}
+
+TEST_F(QuotaPrefetchTest, TestTokenBucketSmallTimeBased) {
+  use_token_bucket_ = true;
+  TestSingleClient(false,  // use time based
+                   kPerSecondWindow,
+                   {.margin1 = 0.0,
+                    .margin2 = 0.0,
+                    .margin3 = 0.03,
+                    .margin4 = 0.03,
+                    .margin5 = 0.32});
+}
+
+TEST_F(QuotaPrefetchTest, TestTokenBucketTwoClientBigTimeBased) {
+  use_token_bucket_ = true;
+  TestTwoClients(false,  // use time based
+                 kPerMinuteWindow,
+                 {.margin1 = 0.0,
+                  .margin2 = 0.0,
+                  .margin3 = 0.06,
+                  .margin4 = 0.0,
+                  .margin5 = 0.001});
+}
+
+TEST_F(QuotaPrefetchTest, TestTokenBucketNotEnoughAmount) {
+  Tick t;
+  QuotaPrefetch::Options options;
+  options.use_token_bucket = true;
+  auto client = QuotaPrefetch::Create(GetTransportFunc(), options, t);
+  rate_server_ =
+      std::unique_ptr<RateServer>(new RollingWindow(5, milliseconds(1000), t));
+
+  // First one is always true, use it to trigger prefetch
+  EXPECT_TRUE(client->Check(1, t));
+  // Alloc response is called OnTimer.
+  delay_.OnTimer(t);
+
+  // Only 4 tokens remain, so asking for 5 should fail.
+  t += milliseconds(1);
+  EXPECT_FALSE(client->Check(5, t));
+  delay_.OnTimer(t);
+
+  // Since last one fails, still has 4 tokens.
+  t += milliseconds(1);
+  EXPECT_TRUE(client->Check(4, t));
+  delay_.OnTimer(t);
+}
+
+// Concurrent checks never pass more than the granted amount.
+TEST(TokenBucketPrefetchTest, TestConcurrentChecks) {
+  Tick t;
+  QuotaPrefetch::Options options;
+  options.use_token_bucket = true;
+  options.min_prefetch_amount = 1000;
+  std::vector<DoneFunc> pending;
+  auto client = QuotaPrefetch::Create(
+      [&pending](int, DoneFunc fn, Tick) { pending.push_back(fn); }, options,
+      t);
+
+  // The first check adds 1000 tokens before they are granted.
+  EXPECT_TRUE(client->Check(1, t));
+  ASSERT_EQ(pending.size(), 1);
+  // Only 500 are granted. This closes prefetch for the close wait window.
+  pending[0](500, milliseconds(60000), t);
+
+  const int kThreads = 4;
+  const int kChecks = 1000;
+  std::atomic<int> passed(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&client, &passed, t] {
+      for (int j = 0; j < kChecks; j++) {
+        if (client->Check(1, t + milliseconds(1))) {
+          passed++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(passed.load(), 499);
+  EXPECT_EQ(pending.size(), 1);
+}
+
 }  // namespace
 }  // namespace prefetch
 }  // namespace istio
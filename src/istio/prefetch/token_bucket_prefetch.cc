@@ -0,0 +1,367 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/istio/prefetch/token_bucket_prefetch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <mutex>
+
+#include "src/istio/prefetch/time_based_counter.h"
+#include "src/istio/utils/logger.h"
+
+using namespace std::chrono;
+
+namespace istio {
+namespace prefetch {
+namespace {
+
+// TimeBasedCounter window size
+const int kTimeBasedWindowSize = 20;
+
+// Maximum expiration for prefetch amount.
+// It is only used when a prefetch amount is added to the pool
+// before it is granted. Usually is 1 minute.
+const int kMaxExpirationInMs = 60000;
+
+// Expiration time when there are no tokens.
+const int64_t kNoExpiration = std::numeric_limits<int64_t>::min();
+
+class TokenBucketPrefetch : public QuotaPrefetch {
+ public:
+  // The slot id type.
+  typedef uint64_t SlotId;
+
+  // The struture to store granted amount.
+  struct Slot {
+    // available amount
+    int64_t available;
+    // the time the amount will be expired, in nanoseconds since epoch.
+    int64_t expire_time;
+    // the always increment ID to detect if a Slot has been re-cycled.
+    SlotId id;
+  };
+
+  // The mode.
+  enum Mode {
+    OPEN = 0,
+    CLOSE,
+  };
+
+  TokenBucketPrefetch(TransportFunc transport, const Options& options, Tick t)
+      : tokens_(0),
+        expire_time_(kNoExpiration),
+        refill_level_(0),
+        counter_(kTimeBasedWindowSize, options.predict_window, t),
+        accounted_(0),
+        desired_(options.min_prefetch_amount),
+        mode_(OPEN),
+        inflight_count_(0),
+        transport_(transport),
+        options_(options),
+        next_slot_id_(0) {}
+
+  bool Check(int amount, Tick t) override;
+
+ private:
+  static int64_t ToNanos(Tick t) {
+    return duration_cast<nanoseconds>(t.time_since_epoch()).count();
+  }
+
+  // Takes amount tokens without a lock. Sets refill if the tokens available
+  // were below the refill level.
+  bool TakeTokens(int amount, Tick t, bool* refill);
+  // Accounts the tokens taken since the last call to the slots, and drops
+  // expired slots.
+  void Settle(Tick t);
+  // Check to see if need to do a prefetch.
+  void AttemptPrefetch(int amount, Tick t);
+  // Make a prefetch call.
+  void Prefetch(int req_amount, bool use_not_granted, Tick t);
+  // Add the amount to the bucket, and return slot id.
+  SlotId Add(int amount, Tick expiration);
+  // Remove delta tokens of the slot from the bucket.
+  void Remove(Slot* slot, int64_t delta);
+  // Accounts the amount taken from tokens_ to the slots in FIFO order.
+  void AccountTaken(int64_t taken);
+  // On quota allocation response.
+  void OnResponse(SlotId slot_id, int req_amount, int resp_amount,
+                  milliseconds expiration, Tick t);
+  // Publishes the earliest expiration and the refill level to Check().
+  void UpdateFastPath();
+
+  // The available tokens. Check() takes tokens from it without the lock.
+  std::atomic<int64_t> tokens_;
+  // The earliest expiration of the slots, in nanoseconds since epoch.
+  std::atomic<int64_t> expire_time_;
+  // Check() refills if the tokens left drop below it.
+  std::atomic<int64_t> refill_level_;
+
+  // The mutex guarding all member variables below.
+  std::mutex mutex_;
+  // The FIFO queue to store prefetched amount.
+  std::deque<Slot> slots_;
+  // The counter to count number of requests in the pass window.
+  TimeBasedCounter counter_;
+  // The sum of available amount in slots. The difference to tokens_ is the
+  // amount taken since the last Settle().
+  int64_t accounted_;
+  // The desired amount of the last prefetch decision.
+  int desired_;
+  // The current mode.
+  Mode mode_;
+  // Last prefetch time.
+  Tick last_prefetch_time_;
+  // inflight request count;
+  int inflight_count_;
+  // The transport to allocate quota.
+  TransportFunc transport_;
+  // Save the options.
+  Options options_;
+  // next slot id
+  SlotId next_slot_id_;
+};
+
+bool TokenBucketPrefetch::TakeTokens(int amount, Tick t, bool* refill) {
+  if (ToNanos(t) >= expire_time_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  int64_t left = tokens_.fetch_sub(amount, std::memory_order_acq_rel) - amount;
+  if (left < 0) {
+    // Give back, the caller retries under the lock.
+    tokens_.fetch_add(amount, std::memory_order_acq_rel);
+    return false;
+  }
+  // Decide on the amount available before this check, as AttemptPrefetch()
+  // does.
+  *refill = left + amount < refill_level_.load(std::memory_order_relaxed);
+  return true;
+}
+
+void TokenBucketPrefetch::Settle(Tick t) {
+  int64_t taken = accounted_ - tokens_.load(std::memory_order_acquire);
+  if (taken > 0) {
+    counter_.Inc(static_cast<int>(taken), t);
+    AccountTaken(taken);
+  } else if (taken < 0 && !slots_.empty()) {
+    // A concurrent Check() gave back tokens which an earlier Settle() had
+    // seen as taken.
+    slots_.back().available -= taken;
+    accounted_ -= taken;
+  } else if (taken < 0) {
+    // Given back tokens of slots which expired in the meantime.
+    tokens_.fetch_add(taken, std::memory_order_acq_rel);
+  }
+
+  // Drop expired slots, and used up slots but the last one. A Check() may
+  // still give back tokens to it.
+  int64_t now = ToNanos(t);
+  for (auto it = slots_.begin(); it != slots_.end();) {
+    if (now < it->expire_time &&
+        (it->available > 0 || std::next(it) == slots_.end())) {
+      ++it;
+      continue;
+    }
+    if (it->available > 0) {
+      MIXER_DEBUG("Expired: %ld", it->available);
+      tokens_.fetch_sub(it->available, std::memory_order_acq_rel);
+      accounted_ -= it->available;
+    }
+    it = slots_.erase(it);
+  }
+}
+
+void TokenBucketPrefetch::AttemptPrefetch(int amount, Tick t) {
+  if (mode_ == CLOSE && (inflight_count_ > 0 ||
+                         (duration_cast<milliseconds>(t - last_prefetch_time_) <
+                          options_.close_wait_window))) {
+    return;
+  }
+
+  int64_t avail = accounted_;
+  int pass_count = counter_.Count(t);
+  desired_ = std::max(pass_count, options_.min_prefetch_amount);
+  MIXER_TRACE(
+      "Prefetch decision: available=%ld, desired=%d, inflight_count=%d, "
+      "requested=%d",
+      avail, desired_, inflight_count_, amount);
+  if ((avail < desired_ / 2 && inflight_count_ == 0) || avail < amount) {
+    bool use_not_granted = (avail == 0 && mode_ == OPEN);
+    Prefetch(std::max(amount, desired_), use_not_granted, t);
+  }
+}
+
+void TokenBucketPrefetch::Prefetch(int req_amount, bool use_not_granted,
+                                   Tick t) {
+  SlotId slot_id = 0;
+  if (use_not_granted) {
+    // add the prefetch amount to available queue before it is granted.
+    slot_id = Add(req_amount, t + milliseconds(kMaxExpirationInMs));
+  }
+
+  MIXER_DEBUG("Prefetch amount %d for slotid: %lu", req_amount, slot_id);
+
+  last_prefetch_time_ = t;
+  ++inflight_count_;
+  transport_(
+      req_amount,
+      [this, slot_id, req_amount](int resp_amount, milliseconds expiration,
+                                  Tick t1) {
+        OnResponse(slot_id, req_amount, resp_amount, expiration, t1);
+      },
+      t);
+}
+
+TokenBucketPrefetch::SlotId TokenBucketPrefetch::Add(int amount,
+                                                     Tick expire_time) {
+  SlotId id = ++next_slot_id_;
+  slots_.push_back(Slot{amount, ToNanos(expire_time), id});
+  accounted_ += amount;
+  tokens_.fetch_add(amount, std::memory_order_acq_rel);
+  return id;
+}
+
+void TokenBucketPrefetch::Remove(Slot* slot, int64_t delta) {
+  slot->available -= delta;
+  accounted_ -= delta;
+  tokens_.fetch_sub(delta, std::memory_order_acq_rel);
+}
+
+void TokenBucketPrefetch::AccountTaken(int64_t taken) {
+  for (auto& slot : slots_) {
+    if (taken == 0) {
+      return;
+    }
+    int64_t d = std::min(slot.available, taken);
+    slot.available -= d;
+    accounted_ -= d;
+    taken -= d;
+  }
+}
+
+void TokenBucketPrefetch::OnResponse(SlotId slot_id, int req_amount,
+                                     int resp_amount, milliseconds expiration,
+                                     Tick t) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  --inflight_count_;
+  Settle(t);
+
+  MIXER_DEBUG("OnResponse: req: %d, resp: %d, expire: %ld, id: %lu", req_amount,
+              resp_amount, expiration.count(), slot_id);
+
+  // resp_amount of -1 indicates any network failures.
+  // Use fail open policy to handle any netowrk failures.
+  if (resp_amount == -1) {
+    resp_amount = req_amount;
+    expiration = milliseconds(kMaxExpirationInMs);
+  }
+
+  if (slot_id != 0) {
+    // The prefetched amount was added to the available queue
+    auto slot =
+        std::find_if(slots_.begin(), slots_.end(),
+                     [slot_id](const Slot& s) { return s.id == slot_id; });
+    if (resp_amount < req_amount) {
+      int64_t delta = req_amount - resp_amount;
+      // Substract it from its own request node.
+      if (slot != slots_.end()) {
+        int64_t d = std::min(slot->available, delta);
+        Remove(&*slot, d);
+        delta -= d;
+      }
+      // Substract it from other prefetched amounts
+      for (auto& other : slots_) {
+        if (delta == 0) {
+          break;
+        }
+        int64_t d = std::min(other.available, delta);
+        Remove(&other, d);
+        delta -= d;
+      }
+    }
+    // Adjust the expiration
+    if (slot != slots_.end() && slot->available > 0) {
+      slot->expire_time = ToNanos(t + expiration);
+    }
+  } else {
+    // prefetched amount was NOT added to the pool yet.
+    if (resp_amount > 0) {
+      Add(resp_amount, t + expiration);
+    }
+  }
+
+  if (resp_amount == req_amount) {
+    mode_ = OPEN;
+  } else {
+    mode_ = CLOSE;
+  }
+  UpdateFastPath();
+}
+
+void TokenBucketPrefetch::UpdateFastPath() {
+  int64_t expire_time = kNoExpiration;
+  for (const auto& slot : slots_) {
+    if (expire_time == kNoExpiration || slot.expire_time < expire_time) {
+      expire_time = slot.expire_time;
+    }
+  }
+  expire_time_.store(expire_time, std::memory_order_release);
+  // While a prefetch is in flight, only running out of tokens calls
+  // AttemptPrefetch() again.
+  refill_level_.store(inflight_count_ == 0 ? desired_ / 2 : 0,
+                      std::memory_order_relaxed);
+}
+
+bool TokenBucketPrefetch::Check(int amount, Tick t) {
+  bool refill = false;
+  if (TakeTokens(amount, t, &refill)) {
+    if (refill) {
+      // Refill is best effort, a concurrent Check() may be doing it.
+      std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+      if (lock.owns_lock()) {
+        Settle(t);
+        AttemptPrefetch(amount, t);
+        UpdateFastPath();
+      }
+    }
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Settle(t);
+  AttemptPrefetch(amount, t);
+  UpdateFastPath();
+  bool ret = TakeTokens(amount, t, &refill);
+  if (!ret) {
+    // Taken tokens are counted by Settle().
+    counter_.Inc(amount, t);
+    MIXER_DEBUG("Rejected amount: %d", amount);
+  }
+  return ret;
+}
+
+}  // namespace
+
+std::unique_ptr<QuotaPrefetch> CreateTokenBucketPrefetch(
+    QuotaPrefetch::TransportFunc transport,
+    const QuotaPrefetch::Options& options, QuotaPrefetch::Tick t) {
+  return std::unique_ptr<QuotaPrefetch>(
+      new TokenBucketPrefetch(transport, options, t));
+}
+
+}  // namespace prefetch
+}  // namespace istio
@@ -0,0 +1,37 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ISTIO_PREFETCH_TOKEN_BUCKET_PREFETCH_H_
+#define ISTIO_PREFETCH_TOKEN_BUCKET_PREFETCH_H_
+
+#include "include/istio/prefetch/quota_prefetch.h"
+
+namespace istio {
+namespace prefetch {
+
+// Creates a quota prefetch which keeps all available tokens in one atomic
+// counter. Check() decrements the counter without a lock. The prefetched
+// amounts with their expirations, the request prediction and the prefetch
+// calls are handled under a lock, when the tokens run low, run out or the
+// earliest prefetched amount expires. It uses the same prefetch algorithm as
+// the default implementation.
+std::unique_ptr<QuotaPrefetch> CreateTokenBucketPrefetch(
+    QuotaPrefetch::TransportFunc transport,
+    const QuotaPrefetch::Options& options, QuotaPrefetch::Tick t);
+
+}  // namespace prefetch
+}  // namespace istio
+
+#endif  // ISTIO_PREFETCH_TOKEN_BUCKET_PREFETCH_H_
@@ -0,0 +1,429 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/istio/utils/base64.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86_64 1
+#include <immintrin.h>
+#endif
+
+namespace istio {
+namespace utils {
+
+namespace {
+
+constexpr char kStandardTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr char kUrlTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Values of characters that are not in the alphabet.
+constexpr uint8_t kInvalid = 64;
+
+struct DecodeTable {
+  uint8_t values[256];
+};
+
+constexpr DecodeTable makeDecodeTable(const char* alphabet) {
+  DecodeTable table{};
+  for (int i = 0; i < 256; i++) {
+    table.values[i] = kInvalid;
+  }
+  for (int i = 0; i < 64; i++) {
+    table.values[static_cast<uint8_t>(alphabet[i])] = i;
+  }
+  return table;
+}
+
+constexpr DecodeTable kStandardDecodeTable = makeDecodeTable(kStandardTable);
+constexpr DecodeTable kUrlDecodeTable = makeDecodeTable(kUrlTable);
+
+// Output bytes past the decoded length that the block loops may write.
+constexpr size_t kDecodeSlack = 8;
+
+const char* encodeTable(Base64Codec::Alphabet alphabet) {
+  return alphabet == Base64Codec::Alphabet::Url ? kUrlTable : kStandardTable;
+}
+
+const uint8_t* decodeTable(Base64Codec::Alphabet alphabet) {
+  return alphabet == Base64Codec::Alphabet::Url ? kUrlDecodeTable.values
+                                                : kStandardDecodeTable.values;
+}
+
+// Encodes full 3 byte groups. Returns the number of bytes consumed.
+size_t encodeScalar(const uint8_t* in, size_t length, char* out,
+                    const char* table) {
+  size_t i = 0;
+  for (; i + 3 <= length; i += 3, out += 4) {
+    const uint32_t v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+    out[0] = table[v >> 18];
+    out[1] = table[(v >> 12) & 0x3f];
+    out[2] = table[(v >> 6) & 0x3f];
+    out[3] = table[v & 0x3f];
+  }
+  return i;
+}
+
+// Decodes full 4 character groups. Returns the number of characters consumed,
+// or length + 1 if input is not valid.
+size_t decodeScalar(const char* in, size_t length, uint8_t* out,
+                    const uint8_t* table) {
+  size_t i = 0;
+  for (; i + 4 <= length; i += 4, out += 3) {
+    const uint32_t a = table[static_cast<uint8_t>(in[i])];
+    const uint32_t b = table[static_cast<uint8_t>(in[i + 1])];
+    const uint32_t c = table[static_cast<uint8_t>(in[i + 2])];
+    const uint32_t d = table[static_cast<uint8_t>(in[i + 3])];
+    if ((a | b | c | d) & kInvalid) {
+      return length + 1;
+    }
+    const uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+    out[0] = v >> 16;
+    out[1] = v >> 8;
+    out[2] = v;
+  }
+  return i;
+}
+
+#ifdef BASE64_X86_64
+
+// The block loops follow W. Muła and D. Lemire, "Faster Base64 Encoding and
+// Decoding Using AVX2 Instructions". Characters are classified with range
+// compares, which serves both alphabets with the same code.
+
+// Converts 6-bit indices to characters.
+__attribute__((target("ssse3"))) __m128i indicesToChars128(__m128i indices,
+                                                            __m128i lut) {
+  __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+  return _mm_add_epi8(indices, _mm_shuffle_epi8(lut, reduced));
+}
+
+// Offsets from 6-bit indices to characters, selected by indicesToChars.
+__attribute__((target("ssse3"))) __m128i encodeLut(const char* table) {
+  const char c62 = table[62] - 62;
+  const char c63 = table[63] - 63;
+  return _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       '0' - 52, c62, c63, 'A', 0, 0);
+}
+
+// Splits each 3 byte group of the 12 low bytes into 4 6-bit indices.
+__attribute__((target("ssse3"))) __m128i splitIndices128(__m128i in) {
+  in = _mm_shuffle_epi8(
+      in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3"))) size_t encodeSSSE3(const uint8_t* in,
+                                                    size_t length, char* out,
+                                                    const char* table) {
+  const __m128i lut = encodeLut(table);
+  size_t i = 0;
+  // Each block loads 16 bytes and encodes 12 of them.
+  for (; i + 16 <= length; i += 12, out += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                     indicesToChars128(splitIndices128(block), lut));
+  }
+  return i;
+}
+
+// Converts 16 characters to 6-bit values. Returns false if a character is
+// not in the alphabet.
+__attribute__((target("ssse3"))) bool charsToValues128(__m128i c,
+                                                       const char* table,
+                                                       __m128i* values) {
+  const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                                      _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), c));
+  const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), c));
+  const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+  const __m128i v62 = _mm_cmpeq_epi8(c, _mm_set1_epi8(table[62]));
+  const __m128i v63 = _mm_cmpeq_epi8(c, _mm_set1_epi8(table[63]));
+  const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                                     _mm_or_si128(digit, _mm_or_si128(v62, v63)));
+  if (_mm_movemask_epi8(valid) != 0xffff) {
+    return false;
+  }
+  __m128i offset = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+  offset = _mm_or_si128(offset, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+  offset = _mm_or_si128(offset, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+  offset = _mm_or_si128(offset,
+                        _mm_and_si128(v62, _mm_set1_epi8(62 - table[62])));
+  offset = _mm_or_si128(offset,
+                        _mm_and_si128(v63, _mm_set1_epi8(63 - table[63])));
+  *values = _mm_add_epi8(c, offset);
+  return true;
+}
+
+// Packs 4 6-bit values into 3 bytes in each 32-bit lane, in the 12 low bytes.
+__attribute__((target("ssse3"))) __m128i packValues128(__m128i values) {
+  const __m128i merged =
+      _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                                13, 12, -1, -1, -1, -1));
+}
+
+// Writes 16 bytes per block of which 12 are output, see kDecodeSlack.
+__attribute__((target("ssse3"))) size_t decodeSSSE3(const char* in,
+                                                    size_t length, uint8_t* out,
+                                                    const char* table) {
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16, out += 12) {
+    __m128i values;
+    if (!charsToValues128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), table,
+            &values)) {
+      return length + 1;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packValues128(values));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t encodeAVX2(const uint8_t* in,
+                                                  size_t length, char* out,
+                                                  const char* table) {
+  const __m256i lut = _mm256_broadcastsi128_si256(encodeLut(table));
+  const __m256i split_shuffle = _mm256_broadcastsi128_si256(
+      _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  size_t i = 0;
+  // Each block loads 16 bytes at offsets 0 and 12, and encodes 24 bytes.
+  for (; i + 28 <= length; i += 24, out += 32) {
+    __m256i block = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12)), 1);
+    block = _mm256_shuffle_epi8(block, split_shuffle);
+    const __m256i t0 = _mm256_and_si256(block, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(block, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    reduced =
+        _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out),
+        _mm256_add_epi8(indices, _mm256_shuffle_epi8(lut, reduced)));
+  }
+  return i;
+}
+
+// Writes 32 bytes per block of which 24 are output, see kDecodeSlack.
+__attribute__((target("avx2"))) size_t decodeAVX2(const char* in,
+                                                  size_t length, uint8_t* out,
+                                                  const char* table) {
+  const __m256i pack_shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32, out += 24) {
+    const __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    const __m256i upper =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+    const __m256i lower =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+    const __m256i digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    const __m256i v62 = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(table[62]));
+    const __m256i v63 = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(table[63]));
+    const __m256i valid =
+        _mm256_or_si256(_mm256_or_si256(upper, lower),
+                        _mm256_or_si256(digit, _mm256_or_si256(v62, v63)));
+    if (_mm256_movemask_epi8(valid) != -1) {
+      return length + 1;
+    }
+    __m256i offset = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+    offset = _mm256_or_si256(
+        offset, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+    offset = _mm256_or_si256(
+        offset, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+    offset = _mm256_or_si256(
+        offset, _mm256_and_si256(v62, _mm256_set1_epi8(62 - table[62])));
+    offset = _mm256_or_si256(
+        offset, _mm256_and_si256(v63, _mm256_set1_epi8(63 - table[63])));
+    const __m256i values = _mm256_add_epi8(c, offset);
+
+    const __m256i merged =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    packed = _mm256_shuffle_epi8(packed, pack_shuffle);
+    // Move the 12 output bytes of the high lane next to the low lane.
+    packed = _mm256_permutevar8x32_epi32(
+        packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+  }
+  return i;
+}
+
+#endif  // BASE64_X86_64
+
+}  // namespace
+
+Base64Codec::Isa Base64Codec::bestIsa() {
+#ifdef BASE64_X86_64
+  static const Isa isa = __builtin_cpu_supports("avx2")
+                             ? Isa::AVX2
+                             : __builtin_cpu_supports("ssse3") ? Isa::SSSE3
+                                                               : Isa::Scalar;
+  return isa;
+#else
+  return Isa::Scalar;
+#endif
+}
+
+std::string Base64Codec::encode(absl::string_view input, Alphabet alphabet,
+                                bool add_padding, Isa isa) {
+  const char* table = encodeTable(alphabet);
+  const size_t length = input.size();
+  const size_t output_length =
+      add_padding ? (length + 2) / 3 * 4 : (length * 4 + 2) / 3;
+  std::string output(output_length, '\0');
+
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(input.data());
+  char* out = &output[0];
+  size_t i = 0;
+#ifdef BASE64_X86_64
+  if (isa == Isa::AVX2) {
+    i += encodeAVX2(in, length, out, table);
+  }
+  if (isa != Isa::Scalar) {
+    i += encodeSSSE3(in + i, length - i, out + i / 3 * 4, table);
+  }
+#else
+  (void)isa;
+#endif
+  i += encodeScalar(in + i, length - i, out + i / 3 * 4, table);
+
+  out += i / 3 * 4;
+  switch (length - i) {
+    case 1:
+      out[0] = table[in[i] >> 2];
+      out[1] = table[(in[i] & 0x03) << 4];
+      if (add_padding) {
+        out[2] = '=';
+        out[3] = '=';
+      }
+      break;
+    case 2:
+      out[0] = table[in[i] >> 2];
+      out[1] = table[((in[i] & 0x03) << 4) | (in[i + 1] >> 4)];
+      out[2] = table[(in[i + 1] & 0x0f) << 2];
+      if (add_padding) {
+        out[3] = '=';
+      }
+      break;
+    default:
+      break;
+  }
+  return output;
+}
+
+bool Base64Codec::decode(absl::string_view input, std::string* output,
+                         Alphabet alphabet, Isa isa) {
+  output->clear();
+  size_t length = input.size();
+  if (length > 0 && input[length - 1] == '=') {
+    if (length % 4 != 0) {
+      return false;
+    }
+    length--;
+    if (input[length - 1] == '=') {
+      length--;
+    }
+  }
+  if (length % 4 == 1) {
+    return false;
+  }
+
+  const size_t output_length =
+      length / 4 * 3 + (length % 4 == 0 ? 0 : length % 4 - 1);
+  output->resize(output_length + kDecodeSlack);
+
+  const uint8_t* table = decodeTable(alphabet);
+  const char* in = input.data();
+  uint8_t* out = reinterpret_cast<uint8_t*>(&(*output)[0]);
+  size_t i = 0;
+#ifdef BASE64_X86_64
+  if (isa == Isa::AVX2) {
+    i += decodeAVX2(in, length, out, encodeTable(alphabet));
+  }
+  if (isa != Isa::Scalar && i <= length) {
+    i += decodeSSSE3(in + i, length - i, out + i / 4 * 3,
+                     encodeTable(alphabet));
+  }
+#else
+  (void)isa;
+#endif
+  if (i <= length) {
+    i += decodeScalar(in + i, length - i, out + i / 4 * 3, table);
+  }
+  if (i > length) {
+    output->clear();
+    return false;
+  }
+
+  // The last group of 2 or 3 characters carries 1 or 2 bytes. Its unused
+  // bits must be zero.
+  out += i / 4 * 3;
+  bool valid = true;
+  switch (length - i) {
+    case 2: {
+      const uint8_t a = table[static_cast<uint8_t>(in[i])];
+      const uint8_t b = table[static_cast<uint8_t>(in[i + 1])];
+      valid = ((a | b) & kInvalid) == 0 && (b & 0x0f) == 0;
+      out[0] = (a << 2) | (b >> 4);
+      break;
+    }
+    case 3: {
+      const uint8_t a = table[static_cast<uint8_t>(in[i])];
+      const uint8_t b = table[static_cast<uint8_t>(in[i + 1])];
+      const uint8_t c = table[static_cast<uint8_t>(in[i + 2])];
+      valid = ((a | b | c) & kInvalid) == 0 && (c & 0x03) == 0;
+      out[0] = (a << 2) | (b >> 4);
+      out[1] = (b << 4) | (c >> 2);
+      break;
+    }
+    default:
+      break;
+  }
+  if (!valid) {
+    output->clear();
+    return false;
+  }
+  output->resize(output_length);
+  return true;
+}
+
+}  // namespace utils
+}  // namespace istio
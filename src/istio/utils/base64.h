@@ -0,0 +1,70 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace istio {
+namespace utils {
+
+// Base64Codec encodes and decodes base64 (RFC 4648 section 4) and base64url
+// (RFC 4648 section 5). Peer metadata headers, JWT segments and Istio
+// attribute headers are decoded on every request, so on x86-64 the codec
+// processes blocks of 12 bytes with SSSE3, or 24 bytes with AVX2, when the CPU
+// supports it. Remaining bytes, and all input on other platforms such as wasm,
+// go through a scalar implementation that handles 3 bytes at a time.
+class Base64Codec {
+ public:
+  enum class Alphabet {
+    // '+' and '/' for the last two values.
+    Standard,
+    // '-' and '_' for the last two values.
+    Url,
+  };
+
+  // Instruction set of the block loops. Exposed for tests and benchmarks.
+  enum class Isa {
+    Scalar,
+    SSSE3,
+    AVX2,
+  };
+
+  // Returns the best instruction set supported by the CPU.
+  static Isa bestIsa();
+
+  static std::string encode(absl::string_view input,
+                            Alphabet alphabet = Alphabet::Standard,
+                            bool add_padding = true) {
+    return encode(input, alphabet, add_padding, bestIsa());
+  }
+  static std::string encode(absl::string_view input, Alphabet alphabet,
+                            bool add_padding, Isa isa);
+
+  // Decodes input with or without padding. Padded input must be a multiple of
+  // 4 characters long. Returns false and clears output if input is not valid,
+  // including unused bits that are not zero in the last character.
+  static bool decode(absl::string_view input, std::string* output,
+                     Alphabet alphabet = Alphabet::Standard) {
+    return decode(input, output, alphabet, bestIsa());
+  }
+  static bool decode(absl::string_view input, std::string* output,
+                     Alphabet alphabet, Isa isa);
+};
+
+}  // namespace utils
+}  // namespace istio
@@ -0,0 +1,154 @@
+/* Copyright 2019 Istio Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/istio/utils/base64.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace istio {
+namespace utils {
+namespace {
+
+using Alphabet = Base64Codec::Alphabet;
+using Isa = Base64Codec::Isa;
+
+// Instruction sets supported by the CPU running the test.
+std::vector<Isa> supportedIsas() {
+  std::vector<Isa> isas = {Isa::Scalar};
+  if (Base64Codec::bestIsa() != Isa::Scalar) {
+    isas.push_back(Isa::SSSE3);
+  }
+  if (Base64Codec::bestIsa() == Isa::AVX2) {
+    isas.push_back(Isa::AVX2);
+  }
+  return isas;
+}
+
+std::string randomBytes(std::mt19937* rng, size_t length) {
+  std::uniform_int_distribution<int> dist(0, 255);
+  std::string bytes(length, '\0');
+  for (auto& c : bytes) {
+    c = static_cast<char>(dist(*rng));
+  }
+  return bytes;
+}
+
+std::string decode(absl::string_view input, Alphabet alphabet, Isa isa) {
+  std::string output;
+  EXPECT_TRUE(Base64Codec::decode(input, &output, alphabet, isa)) << input;
+  return output;
+}
+
+// Test vectors of RFC 4648 section 10.
+TEST(Base64CodecTest, Rfc4648Vectors) {
+  const std::vector<std::pair<std::string, std::string>> vectors = {
+      {"", ""},         {"f", "Zg=="},         {"fo", "Zm8="},
+      {"foo", "Zm9v"},  {"foob", "Zm9vYg=="},  {"fooba", "Zm9vYmE="},
+      {"foobar", "Zm9vYmFy"},
+  };
+  for (Isa isa : supportedIsas()) {
+    for (const auto& v : vectors) {
+      EXPECT_EQ(Base64Codec::encode(v.first, Alphabet::Standard, true, isa),
+                v.second);
+      EXPECT_EQ(decode(v.second, Alphabet::Standard, isa), v.first);
+    }
+  }
+}
+
+TEST(Base64CodecTest, Alphabets) {
+  const std::string input("\xfb\xff\xbf", 3);
+  EXPECT_EQ(Base64Codec::encode(input), "+/+/");
+  EXPECT_EQ(Base64Codec::encode(input, Alphabet::Url), "-_-_");
+  std::string output;
+  EXPECT_FALSE(Base64Codec::decode("-_-_", &output));
+  EXPECT_FALSE(Base64Codec::decode("+/+/", &output, Alphabet::Url));
+  EXPECT_TRUE(Base64Codec::decode("-_-_", &output, Alphabet::Url));
+  EXPECT_EQ(output, input);
+}
+
+TEST(Base64CodecTest, Padding) {
+  EXPECT_EQ(Base64Codec::encode("fo", Alphabet::Standard, false), "Zm8");
+  std::string output;
+  EXPECT_TRUE(Base64Codec::decode("Zm8", &output));
+  EXPECT_EQ(output, "fo");
+  EXPECT_TRUE(Base64Codec::decode("Zg", &output));
+  EXPECT_EQ(output, "f");
+  // Padding is only valid on a full group.
+  EXPECT_FALSE(Base64Codec::decode("Zg=", &output));
+  EXPECT_FALSE(Base64Codec::decode("Zm8==", &output));
+  EXPECT_FALSE(Base64Codec::decode("Zg===", &output));
+  EXPECT_FALSE(Base64Codec::decode("====", &output));
+  EXPECT_FALSE(Base64Codec::decode("=", &output));
+  // A single character does not carry a byte.
+  EXPECT_FALSE(Base64Codec::decode("Z", &output));
+  EXPECT_FALSE(Base64Codec::decode("Zm9vY", &output));
+  EXPECT_TRUE(output.empty());
+}
+
+TEST(Base64CodecTest, UnusedBitsMustBeZero) {
+  std::string output;
+  EXPECT_FALSE(Base64Codec::decode("Zh==", &output));
+  EXPECT_FALSE(Base64Codec::decode("Zm9=", &output));
+  EXPECT_FALSE(Base64Codec::decode("Zh", &output));
+}
+
+// All instruction sets agree with the scalar codec on every length across
+// block boundaries.
+TEST(Base64CodecTest, RoundTrip) {
+  std::mt19937 rng(7);
+  for (size_t length = 0; length < 200; length++) {
+    const std::string input = randomBytes(&rng, length);
+    for (Alphabet alphabet : {Alphabet::Standard, Alphabet::Url}) {
+      for (bool padding : {true, false}) {
+        const std::string expected =
+            Base64Codec::encode(input, alphabet, padding, Isa::Scalar);
+        for (Isa isa : supportedIsas()) {
+          const std::string encoded =
+              Base64Codec::encode(input, alphabet, padding, isa);
+          EXPECT_EQ(encoded, expected);
+          EXPECT_EQ(decode(encoded, alphabet, isa), input);
+        }
+      }
+    }
+  }
+}
+
+// A character outside the alphabet is rejected at every position, including
+// inside SIMD blocks.
+TEST(Base64CodecTest, InvalidCharacters) {
+  std::mt19937 rng(11);
+  const std::string encoded =
+      Base64Codec::encode(randomBytes(&rng, 96), Alphabet::Standard, true);
+  for (Isa isa : supportedIsas()) {
+    for (size_t pos = 0; pos < encoded.size(); pos++) {
+      for (char c : {'=', '-', '_', '.', ' ', '\0', '\x80', '\xff'}) {
+        std::string invalid = encoded;
+        invalid[pos] = c;
+        std::string output;
+        EXPECT_FALSE(
+            Base64Codec::decode(invalid, &output, Alphabet::Standard, isa))
+            << pos << " " << static_cast<int>(c);
+        EXPECT_TRUE(output.empty());
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace utils
+}  // namespace istio